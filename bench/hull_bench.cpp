@@ -0,0 +1,417 @@
+/**
+ * Convex Hull Kernel Benchmark
+ * ----------------------------
+ * Times the hull pipeline in-process, without process startup or iostream
+ * input in the numbers: lexicographic sort, the monotone chain of
+ * common/convex_hull.hpp instantiated for std::vector, std::deque and
+ * std::list (the q2 variants) and for float coordinates, the shoelace area,
+ * the servers' convexHullArea call with and without the fixed-size small-n
+ * kernels, and the from_chars point parser.
+ *
+ * Every kernel runs on every point distribution of
+ * common/point_distributions.hpp and every size. Small inputs are
+ * looped until one repeat takes at least MIN_REPEAT_MS, and each repeat
+ * reports the time per call, so 10 points and 10^8 points are measured with
+ * the same resolution. --sizes takes ranges too: "--sizes 3-16 --kernels
+ * hull-area,hull-area-gen" shows the small-n kernels' gain at each size.
+ *
+ * Usage:
+ *   ./hull_bench [--sizes 10,1000,3-16,...] [--dists uniform-square,...]
+ *                [--kernels sort,hull-vector,...] [--repeats N] [--seed S]
+ *                [--json results.json]
+ *   ./hull_bench --compare baseline.json candidate.json [--threshold PERCENT]
+ *
+ * --compare matches results by kernel, distribution and size and exits with
+ * status 1 if any median got slower by more than the threshold (default 5%).
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <deque>
+#include <list>
+#include <map>
+#include <string>
+#include <string_view>
+#include <algorithm>
+#include <chrono>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include "../common/convex_hull.hpp"
+#include "../common/point_distributions.hpp"
+#include "../common/point_parser.hpp"
+
+using namespace std;
+using hull::Point;
+
+const double MIN_REPEAT_MS = 20.0;
+
+// Up to this many points, the hull-area kernels cycle through ROTATION_SETS different point sets:
+// with one set replayed, the branch predictor learns a small input's comparisons by heart
+const size_t ROTATION_MAX_POINTS = 64;
+const size_t ROTATION_SETS = 256;
+
+// ---------------------------------------------------------------------------
+// Kernels
+// ---------------------------------------------------------------------------
+
+/**
+ * Inputs shared by every kernel for one (distribution, size) pair. Each kernel
+ * returns a value derived from its result so the work cannot be optimized out.
+ */
+struct Dataset {
+    vector<Point> points;
+    vector<Point> sorted;
+    vector<Point> hullPoints;
+    deque<Point> asDeque;
+    list<Point> asList;
+    vector<hull::BasicPoint<float>> asFloat;
+    vector<vector<Point>> rotation;
+    size_t rotationIndex = 0;
+    string text;
+    vector<Point> scratch;
+};
+
+struct Kernel {
+    string name;
+    function<double(Dataset&)> run;
+};
+
+string formatPoints(const vector<Point>& points) {
+    string text;
+    text.reserve(points.size() * 24);
+    char buffer[64];
+    for (const Point& p : points) {
+        char* end = to_chars(buffer, buffer + sizeof(buffer), p.x).ptr;
+        *end++ = ',';
+        end = to_chars(end, buffer + sizeof(buffer), p.y).ptr;
+        *end++ = '\n';
+        text.append(buffer, end - buffer);
+    }
+    return text;
+}
+
+const vector<Point>& nextInput(Dataset& d) {
+    if (d.rotation.empty()) return d.points;
+    return d.rotation[d.rotationIndex++ % d.rotation.size()];
+}
+
+const vector<Kernel> KERNELS = {
+    // Includes restoring the unsorted input, a memcpy
+    {"sort", [](Dataset& d) {
+        d.scratch.assign(d.points.begin(), d.points.end());
+        hull::sortPoints(d.scratch);
+        return d.scratch[d.scratch.size() / 2].x;
+    }},
+    {"chain-sorted", [](Dataset& d) {
+        return (double)hull::monotoneChainSorted(d.sorted).size();
+    }},
+    {"hull-vector", [](Dataset& d) {
+        return (double)hull::monotoneChain(d.points).size();
+    }},
+    {"hull-deque", [](Dataset& d) {
+        return (double)hull::monotoneChain(d.asDeque).size();
+    }},
+    {"hull-list", [](Dataset& d) {
+        return (double)hull::monotoneChain(d.asList).size();
+    }},
+    {"hull-f32", [](Dataset& d) {
+        return (double)hull::monotoneChain(d.asFloat).size();
+    }},
+    // What the servers call for CH; 3..16 points go to the fixed-size kernels
+    {"hull-area", [](Dataset& d) {
+        return hull::convexHullArea(nextInput(d));
+    }},
+    // The same through the general path at every size: copy, std::sort, chain into a vector
+    {"hull-area-gen", [](Dataset& d) {
+        vector<Point> points = nextInput(d);
+        hull::sortPoints(points);
+        return hull::polygonArea(hull::monotoneChainSorted(points));
+    }},
+    {"area", [](Dataset& d) {
+        return hull::polygonArea(d.hullPoints);
+    }},
+    {"parse", [](Dataset& d) {
+        d.scratch.clear();
+        vector<LineError> errors;
+        size_t linesParsed = 0;
+        parsePointLines(d.text, d.points.size(), d.scratch, errors, linesParsed);
+        return (double)linesParsed;
+    }},
+};
+
+// ---------------------------------------------------------------------------
+// Measurement
+// ---------------------------------------------------------------------------
+
+struct Result {
+    string kernel;
+    string distribution;
+    size_t points = 0;
+    size_t hullSize = 0;
+    int repeats = 0;
+    long iterations = 0;     ///< Calls per repeat
+    double minMs = 0, medianMs = 0, meanMs = 0, stddevMs = 0;
+};
+
+volatile double sink;
+
+double nowMs() {
+    return chrono::duration<double, milli>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Result measure(const Kernel& kernel, Dataset& data, int repeats) {
+    // Calibrate: enough calls per repeat to take MIN_REPEAT_MS
+    long iterations = 1;
+    while (true) {
+        double start = nowMs();
+        for (long i = 0; i < iterations; i++) sink = kernel.run(data);
+        double elapsed = nowMs() - start;
+        if (elapsed >= MIN_REPEAT_MS || iterations >= (1L << 30)) break;
+        iterations = elapsed <= 0 ? iterations * 10
+                                  : max(iterations + 1, (long)(iterations * MIN_REPEAT_MS * 1.2 / elapsed));
+    }
+
+    vector<double> samples;
+    for (int r = 0; r < repeats; r++) {
+        double start = nowMs();
+        for (long i = 0; i < iterations; i++) sink = kernel.run(data);
+        samples.push_back((nowMs() - start) / iterations);
+    }
+    sort(samples.begin(), samples.end());
+
+    Result result;
+    result.kernel = kernel.name;
+    result.repeats = repeats;
+    result.iterations = iterations;
+    result.minMs = samples.front();
+    result.medianMs = samples.size() % 2 ? samples[samples.size() / 2]
+                                         : (samples[samples.size() / 2 - 1] + samples[samples.size() / 2]) / 2;
+    for (double s : samples) result.meanMs += s;
+    result.meanMs /= samples.size();
+    for (double s : samples) result.stddevMs += (s - result.meanMs) * (s - result.meanMs);
+    result.stddevMs = sqrt(result.stddevMs / samples.size());
+    return result;
+}
+
+// One result per line, so --compare can read the file back without a JSON library
+string toJson(const Result& r) {
+    ostringstream out;
+    out << setprecision(9)
+        << "{\"kernel\":\"" << r.kernel << "\",\"distribution\":\"" << r.distribution
+        << "\",\"points\":" << r.points << ",\"hull_size\":" << r.hullSize
+        << ",\"repeats\":" << r.repeats << ",\"iterations\":" << r.iterations
+        << ",\"min_ms\":" << r.minMs << ",\"median_ms\":" << r.medianMs
+        << ",\"mean_ms\":" << r.meanMs << ",\"stddev_ms\":" << r.stddevMs
+        << ",\"ns_per_point\":" << r.medianMs * 1e6 / r.points << "}";
+    return out.str();
+}
+
+// ---------------------------------------------------------------------------
+// --compare
+// ---------------------------------------------------------------------------
+
+string jsonField(const string& line, const string& name) {
+    string key = "\"" + name + "\":";
+    size_t start = line.find(key);
+    if (start == string::npos) return "";
+    start += key.size();
+    if (line[start] == '"') {
+        size_t end = line.find('"', start + 1);
+        return line.substr(start + 1, end - start - 1);
+    }
+    size_t end = line.find_first_of(",}", start);
+    return line.substr(start, end - start);
+}
+
+bool readResults(const string& path, map<string, double>& medians) {
+    ifstream in(path);
+    if (!in) {
+        cerr << "Error: cannot read " << path << endl;
+        return false;
+    }
+    string line;
+    while (getline(in, line)) {
+        if (line.find("\"kernel\"") == string::npos) continue;
+        string key = jsonField(line, "kernel") + " " + jsonField(line, "distribution") + " " + jsonField(line, "points");
+        medians[key] = atof(jsonField(line, "median_ms").c_str());
+    }
+    return true;
+}
+
+int compareResults(const string& basePath, const string& newPath, double thresholdPercent) {
+    map<string, double> base, candidate;
+    if (!readResults(basePath, base) || !readResults(newPath, candidate)) return 2;
+
+    int regressions = 0, compared = 0;
+    cout << left << setw(44) << "kernel distribution points" << right
+         << setw(14) << "base ms" << setw(14) << "new ms" << setw(10) << "change" << endl;
+    for (const auto& [key, baseMs] : base) {
+        auto it = candidate.find(key);
+        if (it == candidate.end() || baseMs <= 0) continue;
+        compared++;
+        double change = (it->second - baseMs) / baseMs * 100;
+        bool regressed = change > thresholdPercent;
+        if (regressed) regressions++;
+        cout << left << setw(44) << key << right << fixed << setprecision(4)
+             << setw(14) << baseMs << setw(14) << it->second
+             << setw(9) << setprecision(1) << showpos << change << "%" << noshowpos
+             << (regressed ? "  REGRESSION" : "") << endl;
+    }
+    cout << compared << " results compared, " << regressions << " slower by more than "
+         << thresholdPercent << "%" << endl;
+    return regressions ? 1 : 0;
+}
+
+// ---------------------------------------------------------------------------
+
+vector<string> splitList(const string& text) {
+    vector<string> items;
+    stringstream in(text);
+    string item;
+    while (getline(in, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+void usage() {
+    cerr << "Usage: hull_bench [--sizes 10,1000,3-16,...] [--dists name,...] [--kernels name,...]\n"
+            "                  [--repeats N] [--seed S] [--json FILE]\n"
+            "       hull_bench --compare BASE.json NEW.json [--threshold PERCENT]\n"
+            "Distributions:";
+    for (const string& name : pointgen::names()) cerr << " " << name;
+    cerr << "\nKernels:";
+    for (const Kernel& kernel : KERNELS) cerr << " " << kernel.name;
+    cerr << endl;
+}
+
+int main(int argc, char* argv[]) {
+    vector<size_t> sizes = {10, 100, 1000, 10000, 100000, 1000000};
+    vector<string> dists = pointgen::names();
+    vector<string> kernelNames;
+    for (const Kernel& kernel : KERNELS) kernelNames.push_back(kernel.name);
+    int repeats = 5;
+    uint64_t seed = 42;
+    string jsonPath;
+    double threshold = 5.0;
+    vector<string> compareFiles;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--sizes" && hasValue) {
+            sizes.clear();
+            for (const string& s : splitList(argv[++i])) {
+                // "3-16" is every size from 3 to 16
+                size_t dash = s.find('-', 1);
+                size_t from = (size_t)atof(s.c_str());
+                size_t to = dash == string::npos ? from : (size_t)atof(s.c_str() + dash + 1);
+                for (size_t n = from; n <= to; n++) sizes.push_back(n);
+            }
+        } else if (arg == "--dists" && hasValue) {
+            dists = splitList(argv[++i]);
+        } else if (arg == "--kernels" && hasValue) {
+            kernelNames = splitList(argv[++i]);
+        } else if (arg == "--repeats" && hasValue) {
+            repeats = max(1, atoi(argv[++i]));
+        } else if (arg == "--seed" && hasValue) {
+            seed = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--json" && hasValue) {
+            jsonPath = argv[++i];
+        } else if (arg == "--threshold" && hasValue) {
+            threshold = atof(argv[++i]);
+        } else if (arg == "--compare" && i + 2 < argc) {
+            compareFiles = {argv[i + 1], argv[i + 2]};
+            i += 2;
+        } else {
+            usage();
+            return 2;
+        }
+    }
+
+    if (!compareFiles.empty()) {
+        return compareResults(compareFiles[0], compareFiles[1], threshold);
+    }
+
+    vector<const Kernel*> kernels;
+    for (const string& name : kernelNames) {
+        auto it = find_if(KERNELS.begin(), KERNELS.end(), [&](const Kernel& k) { return k.name == name; });
+        if (it == KERNELS.end()) {
+            cerr << "Error: unknown kernel " << name << endl;
+            usage();
+            return 2;
+        }
+        kernels.push_back(&*it);
+    }
+    for (const string& name : dists) {
+        if (!pointgen::known(name)) {
+            cerr << "Error: unknown distribution " << name << endl;
+            usage();
+            return 2;
+        }
+    }
+
+    cout << "=== Convex hull kernel benchmark: " << repeats << " repeats, seed " << seed << " ===" << endl;
+    cout << left << setw(14) << "kernel" << setw(17) << "distribution" << right << setw(11) << "points"
+         << setw(9) << "hull" << setw(14) << "median ms" << setw(12) << "stddev %" << setw(12) << "ns/point" << endl;
+
+    auto wants = [&kernelNames](const string& name) {
+        return find(kernelNames.begin(), kernelNames.end(), name) != kernelNames.end();
+    };
+
+    vector<Result> results;
+    for (const string& dist : dists) {
+        for (size_t n : sizes) {
+            if (n < 3) continue;
+            Dataset data;
+            data.points = pointgen::generate(dist, n, seed);
+            data.sorted = data.points;
+            hull::sortPoints(data.sorted);
+            data.hullPoints = hull::monotoneChainSorted(data.sorted);
+            // The container copies and text cost several times the points at 10^8; build only what runs
+            if (wants("hull-deque")) data.asDeque.assign(data.points.begin(), data.points.end());
+            if (wants("hull-list")) data.asList.assign(data.points.begin(), data.points.end());
+            if (wants("hull-f32")) {
+                for (const Point& p : data.points) data.asFloat.emplace_back((float)p.x, (float)p.y);
+            }
+            if (wants("parse")) data.text = formatPoints(data.points);
+            if (n <= ROTATION_MAX_POINTS && (wants("hull-area") || wants("hull-area-gen"))) {
+                vector<Point> pool = pointgen::generate(dist, n * ROTATION_SETS, seed + 1);
+                for (size_t i = 0; i < ROTATION_SETS; i++) {
+                    data.rotation.emplace_back(pool.begin() + i * n, pool.begin() + (i + 1) * n);
+                }
+            }
+            data.scratch.reserve(n);
+
+            for (const Kernel* kernel : kernels) {
+                Result result = measure(*kernel, data, repeats);
+                result.distribution = dist;
+                result.points = n;
+                result.hullSize = data.hullPoints.size();
+                results.push_back(result);
+
+                cout << left << setw(14) << result.kernel << setw(17) << dist << right << setw(11) << n
+                     << setw(9) << result.hullSize << fixed << setprecision(4) << setw(14) << result.medianMs
+                     << setprecision(1) << setw(12) << (result.meanMs > 0 ? result.stddevMs / result.meanMs * 100 : 0)
+                     << setprecision(2) << setw(12) << result.medianMs * 1e6 / n << endl;
+            }
+        }
+    }
+
+    if (!jsonPath.empty()) {
+        ofstream out(jsonPath);
+        out << "{\"benchmark\":\"hull_bench\",\"seed\":" << seed << ",\"results\":[\n";
+        for (size_t i = 0; i < results.size(); i++) {
+            out << toJson(results[i]) << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+        out << "]}\n";
+        cout << "Wrote " << results.size() << " results to " << jsonPath << endl;
+    }
+    return 0;
+}
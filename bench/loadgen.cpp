@@ -0,0 +1,782 @@
+/**
+ * Convex Hull Server Load Generator
+ * ---------------------------------
+ * Opens many connections to one of the servers (q4, q6, q7, q9, q10) and
+ * replays a command mix open-loop: requests are scheduled at a fixed total
+ * rate regardless of how fast replies come back, and each latency is measured
+ * from the request's scheduled time, not from when it could actually be
+ * written. A server that stalls is therefore charged for every request that
+ * should have been sent during the stall (no coordinated omission). The
+ * latency from the actual write is reported next to it as "service".
+ *
+ * Each worker thread drives its share of the connections and the rate from
+ * one epoll loop, with a timerfd waking it at the next scheduled send.
+ * Replies are matched to requests in order per connection:
+ *
+ *     Newgraph      ends at "Graph created ..." or an error
+ *     STATS         ends at "END"
+ *     others        one line
+ *
+ * Lines that arrive while nothing is outstanding (the greeting) are skipped.
+ *
+ * Usage:
+ *   ./loadgen [--host 127.0.0.1] [--port 9034] [--connections 100] [--threads 2]
+ *             [--rate 10000] [--duration 10] [--warmup 2]
+ *             [--mix ch-heavy|mutation-heavy|bulk|ch=80,newpoint=10,...]
+ *             [--graph-points 1000] [--no-bulk] [--seed S] [--json FILE]
+ *
+ * --no-bulk sends Newgraph point lines one by one, for q4.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
+#include <string_view>
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <csignal>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "../common/stats.hpp"
+
+using namespace std;
+
+enum Kind {
+    KIND_CH,
+    KIND_NEWPOINT,
+    KIND_REMOVEPOINT,
+    KIND_NEWGRAPH,
+    KIND_STATS,
+    KIND_COUNT
+};
+
+const char* const KIND_NAMES[KIND_COUNT] = {"ch", "newpoint", "removepoint", "newgraph", "stats"};
+
+const map<string, string> PRESET_MIXES = {
+    {"ch-heavy", "ch=90,newpoint=5,removepoint=5"},
+    {"mutation-heavy", "ch=10,newpoint=45,removepoint=45"},
+    {"bulk", "newgraph=20,ch=80"},
+};
+
+struct Options {
+    string host = "127.0.0.1";
+    int port = 9034;
+    int connections = 100;
+    int threads = 2;
+    double rate = 10000;          ///< Requests per second, all connections together
+    double duration = 10;         ///< Seconds of measured load
+    double warmup = 2;            ///< Seconds of load before measuring
+    double drain = 5;             ///< Seconds to wait for outstanding replies at the end
+    string mix = "ch-heavy";
+    double weights[KIND_COUNT] = {};
+    int graphPoints = 1000;
+    bool bulk = true;
+    uint64_t seed = 42;
+    string jsonPath;
+};
+
+// Latency histograms and counters of one thread, merged at the end
+struct Results {
+    stats::HistogramCounts latency[KIND_COUNT];    ///< From the scheduled time
+    stats::HistogramCounts service[KIND_COUNT];    ///< From the write
+    uint64_t completed[KIND_COUNT] = {};
+    uint64_t errors[KIND_COUNT] = {};              ///< Replies starting with "Error"
+    uint64_t sent = 0;
+    uint64_t unanswered = 0;                       ///< Still outstanding after the drain
+    uint64_t connectionsLost = 0;
+
+    void add(const Results& other) {
+        for (int k = 0; k < KIND_COUNT; k++) {
+            latency[k].add(other.latency[k]);
+            service[k].add(other.service[k]);
+            completed[k] += other.completed[k];
+            errors[k] += other.errors[k];
+        }
+        sent += other.sent;
+        unanswered += other.unanswered;
+        connectionsLost += other.connectionsLost;
+    }
+};
+
+struct Pending {
+    Kind kind;
+    uint64_t scheduledAt;
+    uint64_t sentAt;
+    uint64_t endOffset;    ///< Stream offset just past the request's last byte
+    bool measured;         ///< Scheduled after the warmup
+    bool error = false;
+};
+
+struct Connection {
+    int fd = -1;
+    bool alive = true;
+    bool awaitingGreeting = false;   ///< Connected, greeting not seen yet
+    bool established = false;
+    bool wantsWrite = false;
+    string out;
+    size_t outSent = 0;
+    uint64_t streamWritten = 0;      ///< Bytes written over the connection's lifetime
+    uint64_t streamQueued = 0;
+    deque<Pending> pending;
+    size_t firstUnsent = 0;          ///< Index into pending of the oldest request not fully written
+    string in;
+    vector<pair<double, double>> added;   ///< Points this connection added and may remove
+};
+
+volatile sig_atomic_t interrupted = 0;
+
+// ---------------------------------------------------------------------------
+
+bool parseMix(const string& text, double weights[KIND_COUNT]) {
+    string spec = PRESET_MIXES.count(text) ? PRESET_MIXES.at(text) : text;
+    fill(weights, weights + KIND_COUNT, 0.0);
+    stringstream in(spec);
+    string item;
+    double total = 0;
+    while (getline(in, item, ',')) {
+        size_t equals = item.find('=');
+        if (equals == string::npos) return false;
+        string name = item.substr(0, equals);
+        auto kind = find(KIND_NAMES, KIND_NAMES + KIND_COUNT, name);
+        if (kind == KIND_NAMES + KIND_COUNT) return false;
+        double weight = atof(item.c_str() + equals + 1);
+        if (weight < 0) return false;
+        weights[kind - KIND_NAMES] = weight;
+        total += weight;
+    }
+    return total > 0;
+}
+
+int resolve(const Options& options, sockaddr_in& address) {
+    addrinfo hints = {}, *result = nullptr;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(options.host.c_str(), nullptr, &hints, &result) != 0 || !result) return -1;
+    address = *(sockaddr_in*)result->ai_addr;
+    address.sin_port = htons(options.port);
+    freeaddrinfo(result);
+    return 0;
+}
+
+string randomPointText(mt19937_64& rng, pair<double, double>* point = nullptr) {
+    uniform_int_distribution<int> coord(-1000000, 1000000);
+    double x = coord(rng) / 100.0, y = coord(rng) / 100.0;
+    if (point) *point = {x, y};
+    ostringstream text;
+    text << fixed << setprecision(2) << x << "," << y;
+    return text.str();
+}
+
+string newgraphRequest(const Options& options, mt19937_64& rng) {
+    string request = "Newgraph " + to_string(options.graphPoints) + (options.bulk ? " bulk\n" : "\n");
+    for (int i = 0; i < options.graphPoints; i++) request += randomPointText(rng) + "\n";
+    return request;
+}
+
+bool isFinalLine(Kind kind, string_view line) {
+    switch (kind) {
+        case KIND_NEWGRAPH: return line.substr(0, 13) == "Graph created" || line.substr(0, 5) == "Error";
+        case KIND_STATS:    return line == "END" || line.substr(0, 5) == "Error";
+        default:            return true;
+    }
+}
+
+/**
+ * @brief Loads the initial graph over a blocking connection, so CH and
+ * Removepoint have something to work on from the first request.
+ */
+bool seedGraph(const Options& options, const sockaddr_in& address) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (const sockaddr*)&address, sizeof(address)) < 0) {
+        perror("connect");
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    mt19937_64 rng(options.seed);
+    string request = newgraphRequest(options, rng);
+    if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) != (ssize_t)request.size()) {
+        close(fd);
+        return false;
+    }
+
+    string buffer;
+    char chunk[4096];
+    bool done = false;
+    while (!done) {
+        ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+        if (received <= 0) break;
+        buffer.append(chunk, received);
+        size_t newline;
+        while ((newline = buffer.find('\n')) != string::npos) {
+            string line = buffer.substr(0, newline);
+            buffer.erase(0, newline + 1);
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (isFinalLine(KIND_NEWGRAPH, line)) {
+                cout << "Seeded graph: " << line << endl;
+                done = true;
+                break;
+            }
+        }
+    }
+    close(fd);
+    return done;
+}
+
+// ---------------------------------------------------------------------------
+
+/**
+ * @brief One epoll loop driving a share of the connections at a share of the rate.
+ */
+class Worker {
+public:
+    Worker(const Options& options, const sockaddr_in& address, int connections, double rate, uint64_t seed)
+        : options(options), address(address), connectionCount(connections),
+          interval(rate > 0 ? (uint64_t)(1e9 / rate) : 0), rng(seed) {
+        double total = 0;
+        for (int k = 0; k < KIND_COUNT; k++) total += options.weights[k];
+        double cumulative = 0;
+        for (int k = 0; k < KIND_COUNT; k++) {
+            cumulative += options.weights[k] / total;
+            thresholds[k] = cumulative;
+        }
+    }
+
+    ~Worker() {
+        for (Connection& connection : connections) {
+            if (connection.fd >= 0) close(connection.fd);
+        }
+        if (timer >= 0) close(timer);
+        if (epoll >= 0) close(epoll);
+    }
+
+    /**
+     * @brief Opens the connections, at most CONNECT_WINDOW at a time. A
+     * connection counts once the server's greeting arrives: the servers listen
+     * with a backlog of 10, and a connection the kernel completed but the
+     * server never accepted would otherwise be reset in the middle of the run.
+     * Returns the number connected.
+     */
+    int connectAll() {
+        epoll = epoll_create1(0);
+        timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+        epoll_event timerEvent = {};
+        timerEvent.events = EPOLLIN;
+        timerEvent.data.u64 = TIMER_TAG;
+        epoll_ctl(epoll, EPOLL_CTL_ADD, timer, &timerEvent);
+
+        connections.resize(connectionCount);
+        size_t started = 0;
+        int inFlight = 0, connected = 0;
+        epoll_event events[256];
+        uint64_t deadline = stats::nowNanos() + CONNECT_TIMEOUT_NANOS;
+
+        while (stats::nowNanos() < deadline && !interrupted) {
+            while (inFlight < CONNECT_WINDOW && started < connections.size()) {
+                if (startConnect(started++)) inFlight++;
+            }
+            if (inFlight == 0) break;
+
+            int ready = epoll_wait(epoll, events, 256, 100);
+            for (int e = 0; e < ready; e++) {
+                if (events[e].data.u64 == TIMER_TAG) continue;
+                size_t index = events[e].data.u64;
+                Connection& connection = connections[index];
+                if (!connection.alive || connection.established) continue;
+
+                if (!connection.awaitingGreeting) {
+                    // Connected: wait for the greeting
+                    int error = 0;
+                    socklen_t length = sizeof(error);
+                    getsockopt(connection.fd, SOL_SOCKET, SO_ERROR, &error, &length);
+                    if (error != 0) {
+                        dropConnection(connection);
+                        inFlight--;
+                        continue;
+                    }
+                    connection.awaitingGreeting = true;
+                    epoll_event event = {};
+                    event.events = EPOLLIN;
+                    event.data.u64 = index;
+                    epoll_ctl(epoll, EPOLL_CTL_MOD, connection.fd, &event);
+                    continue;
+                }
+
+                char chunk[4096];
+                ssize_t received = recv(connection.fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+                if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) continue;
+                inFlight--;
+                if (received <= 0) {
+                    dropConnection(connection);
+                    continue;
+                }
+                connection.in.append(chunk, received);
+                connection.established = true;
+                connection.awaitingGreeting = false;
+                connected++;
+            }
+        }
+
+        // Still connecting at the deadline
+        for (Connection& connection : connections) {
+            if (connection.alive && !connection.established) dropConnection(connection);
+        }
+        return connected;
+    }
+
+    /**
+     * @brief Sends on schedule from start until start + warmup + duration,
+     * then waits up to the drain time for the remaining replies.
+     */
+    void run(uint64_t start) {
+        uint64_t measureFrom = start + (uint64_t)(options.warmup * 1e9);
+        uint64_t stopSending = measureFrom + (uint64_t)(options.duration * 1e9);
+        uint64_t deadline = stopSending + (uint64_t)(options.drain * 1e9);
+        uint64_t next = start;
+        size_t roundRobin = 0;
+        epoll_event events[256];
+
+        while (!interrupted) {
+            uint64_t now = stats::nowNanos();
+            if (now >= stopSending && outstanding == 0) break;
+            if (now >= deadline) break;
+
+            // Everything that is due, each stamped with its own scheduled time
+            while (interval && next <= now && next < stopSending) {
+                long index = nextConnection(roundRobin);
+                if (index < 0) break;
+                if (connections[index].out.empty()) written.push_back(index);
+                issue(connections[index], next, next >= measureFrom);
+                next += interval;
+            }
+            for (size_t index : written) flush(index, now);
+            written.clear();
+
+            uint64_t wakeAt = (interval && next < stopSending) ? next : min(deadline, now + 100000000);
+            armTimer(wakeAt);
+            int ready = epoll_wait(epoll, events, 256, -1);
+            if (ready < 0 && errno != EINTR) break;
+
+            now = stats::nowNanos();
+            for (int e = 0; e < ready; e++) {
+                if (events[e].data.u64 == TIMER_TAG) {
+                    uint64_t expirations;
+                    ssize_t ignored = read(timer, &expirations, sizeof(expirations));
+                    (void)ignored;
+                    continue;
+                }
+                size_t index = events[e].data.u64;
+                if (events[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) receive(index, now);
+                if ((events[e].events & EPOLLOUT) && connections[index].alive) flush(index, now);
+            }
+        }
+
+        for (Connection& connection : connections) {
+            for (size_t i = 0; i < connection.pending.size(); i++) {
+                if (connection.pending[i].measured) results.unanswered++;
+            }
+        }
+    }
+
+    int liveConnections() const {
+        return (int)count_if(connections.begin(), connections.end(), [](const Connection& c) { return c.alive; });
+    }
+
+    Results results;
+
+private:
+    static constexpr uint64_t TIMER_TAG = UINT64_MAX;
+    static constexpr int CONNECT_WINDOW = 8;
+    static constexpr uint64_t CONNECT_TIMEOUT_NANOS = 30000000000ULL;
+
+    // Starts a non-blocking connect; false if it failed at once
+    bool startConnect(size_t index) {
+        Connection& connection = connections[index];
+        connection.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (connection.fd < 0) {
+            connection.alive = false;
+            return false;
+        }
+        int one = 1;
+        setsockopt(connection.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (connect(connection.fd, (const sockaddr*)&address, sizeof(address)) < 0 && errno != EINPROGRESS) {
+            dropConnection(connection);
+            return false;
+        }
+        epoll_event event = {};
+        event.events = EPOLLOUT;
+        event.data.u64 = index;
+        epoll_ctl(epoll, EPOLL_CTL_ADD, connection.fd, &event);
+        return true;
+    }
+
+    void dropConnection(Connection& connection) {
+        if (connection.fd >= 0) {
+            epoll_ctl(epoll, EPOLL_CTL_DEL, connection.fd, nullptr);
+            close(connection.fd);
+        }
+        connection.fd = -1;
+        connection.alive = false;
+        connection.awaitingGreeting = false;
+    }
+
+    void armTimer(uint64_t at) {
+        itimerspec spec = {};
+        spec.it_value.tv_sec = at / 1000000000ULL;
+        spec.it_value.tv_nsec = at % 1000000000ULL;
+        if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) spec.it_value.tv_nsec = 1;
+        timerfd_settime(timer, TFD_TIMER_ABSTIME, &spec, nullptr);
+    }
+
+    // Index of the next live connection, or -1 if all are gone
+    long nextConnection(size_t& roundRobin) {
+        for (size_t tried = 0; tried < connections.size(); tried++) {
+            size_t index = roundRobin++ % connections.size();
+            if (connections[index].alive) return index;
+        }
+        return -1;
+    }
+
+    Kind pickKind() {
+        double draw = uniform(rng);
+        for (int k = 0; k < KIND_COUNT; k++) {
+            if (draw < thresholds[k] && options.weights[k] > 0) return (Kind)k;
+        }
+        return KIND_CH;
+    }
+
+    void issue(Connection& connection, uint64_t scheduledAt, bool measured) {
+        Kind kind = pickKind();
+        string request;
+        switch (kind) {
+            case KIND_CH:
+                request = "CH\n";
+                break;
+            case KIND_NEWPOINT: {
+                pair<double, double> point;
+                request = "Newpoint " + randomPointText(rng, &point) + "\n";
+                connection.added.push_back(point);
+                break;
+            }
+            case KIND_REMOVEPOINT:
+                if (connection.added.empty()) {
+                    request = "Removepoint " + randomPointText(rng) + "\n";
+                } else {
+                    // Remove a point this connection added, so the graph size stays steady
+                    size_t pick = rng() % connection.added.size();
+                    auto [x, y] = connection.added[pick];
+                    connection.added[pick] = connection.added.back();
+                    connection.added.pop_back();
+                    ostringstream text;
+                    text << fixed << setprecision(2) << "Removepoint " << x << "," << y << "\n";
+                    request = text.str();
+                }
+                break;
+            case KIND_NEWGRAPH:
+                request = newgraphRequest(options, rng);
+                connection.added.clear();
+                break;
+            default:
+                request = "STATS\n";
+                break;
+        }
+
+        connection.out += request;
+        connection.streamQueued += request.size();
+        connection.pending.push_back({kind, scheduledAt, 0, connection.streamQueued, measured});
+        outstanding++;
+        results.sent++;
+    }
+
+    void flush(size_t index, uint64_t now) {
+        Connection& connection = connections[index];
+        if (!connection.alive || connection.outSent == connection.out.size()) return;
+
+        while (connection.outSent < connection.out.size()) {
+            ssize_t written = send(connection.fd, connection.out.data() + connection.outSent,
+                                   connection.out.size() - connection.outSent, MSG_NOSIGNAL);
+            if (written > 0) {
+                connection.outSent += written;
+                connection.streamWritten += written;
+            } else if (written < 0 && errno == EINTR) {
+                continue;
+            } else if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            } else {
+                lose(index);
+                return;
+            }
+        }
+
+        while (connection.firstUnsent < connection.pending.size() &&
+               connection.pending[connection.firstUnsent].endOffset <= connection.streamWritten) {
+            connection.pending[connection.firstUnsent++].sentAt = now;
+        }
+
+        bool backlog = connection.outSent < connection.out.size();
+        if (!backlog) {
+            connection.out.clear();
+            connection.outSent = 0;
+        } else if (connection.outSent > (1 << 20)) {
+            connection.out.erase(0, connection.outSent);
+            connection.outSent = 0;
+        }
+        if (backlog != connection.wantsWrite) {
+            epoll_event event = {};
+            event.events = backlog ? EPOLLIN | EPOLLOUT : EPOLLIN;
+            event.data.u64 = index;
+            epoll_ctl(epoll, EPOLL_CTL_MOD, connection.fd, &event);
+            connection.wantsWrite = backlog;
+        }
+    }
+
+    void receive(size_t index, uint64_t now) {
+        Connection& connection = connections[index];
+        char chunk[16384];
+        while (connection.alive) {
+            ssize_t received = recv(connection.fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+            if (received > 0) {
+                connection.in.append(chunk, received);
+                if ((size_t)received < sizeof(chunk)) break;
+            } else if (received < 0 && errno == EINTR) {
+                continue;
+            } else if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            } else {
+                lose(index);
+                return;
+            }
+        }
+
+        size_t lineStart = 0, newline;
+        while ((newline = connection.in.find('\n', lineStart)) != string::npos) {
+            string_view line(connection.in.data() + lineStart, newline - lineStart);
+            if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+            lineStart = newline + 1;
+            if (connection.pending.empty()) continue;   // Greeting
+
+            Pending& request = connection.pending.front();
+            if (line.substr(0, 5) == "Error") request.error = true;
+            if (!isFinalLine(request.kind, line)) continue;
+
+            if (request.measured) {
+                results.latency[request.kind].buckets[stats::Buckets::indexOf(now - request.scheduledAt)]++;
+                uint64_t sentAt = request.sentAt ? request.sentAt : now;
+                results.service[request.kind].buckets[stats::Buckets::indexOf(now - sentAt)]++;
+                results.completed[request.kind]++;
+                if (request.error) results.errors[request.kind]++;
+            }
+            connection.pending.pop_front();
+            if (connection.firstUnsent > 0) connection.firstUnsent--;
+            outstanding--;
+        }
+        connection.in.erase(0, lineStart);
+    }
+
+    void lose(size_t index) {
+        Connection& connection = connections[index];
+        if (!connection.alive) return;
+        connection.alive = false;
+        results.connectionsLost++;
+        epoll_ctl(epoll, EPOLL_CTL_DEL, connection.fd, nullptr);
+        close(connection.fd);
+        connection.fd = -1;
+        for (const Pending& request : connection.pending) {
+            if (request.measured) results.unanswered++;
+        }
+        outstanding -= connection.pending.size();
+        connection.pending.clear();
+    }
+
+    const Options& options;
+    sockaddr_in address;
+    int connectionCount;
+    uint64_t interval;      ///< Nanoseconds between this worker's requests
+    mt19937_64 rng;
+    uniform_real_distribution<double> uniform{0.0, 1.0};
+    double thresholds[KIND_COUNT] = {};
+    vector<Connection> connections;
+    vector<size_t> written;      ///< Connections that got new requests this round
+    size_t outstanding = 0;
+    int epoll = -1;
+    int timer = -1;
+};
+
+// ---------------------------------------------------------------------------
+
+string micros(uint64_t nanos) {
+    ostringstream out;
+    out << fixed << setprecision(1) << nanos / 1000.0;
+    return out.str();
+}
+
+const double QUANTILES[] = {0.50, 0.90, 0.99, 0.999, 0.9999, 1.0};
+const char* const QUANTILE_NAMES[] = {"p50", "p90", "p99", "p999", "p9999", "max"};
+
+void printRow(const string& name, uint64_t completed, uint64_t errors, const stats::HistogramCounts& latency,
+              const stats::HistogramCounts& service) {
+    cout << left << setw(13) << name << right << setw(10) << completed << setw(8) << errors;
+    for (double q : QUANTILES) cout << setw(11) << micros(latency.percentile(q));
+    cout << setw(13) << micros(service.percentile(0.99)) << endl;
+}
+
+void jsonQuantiles(ostream& out, const stats::HistogramCounts& histogram) {
+    out << "{";
+    for (size_t i = 0; i < size(QUANTILES); i++) {
+        out << (i ? "," : "") << "\"" << QUANTILE_NAMES[i] << "_us\":" << histogram.percentile(QUANTILES[i]) / 1000.0;
+    }
+    out << "}";
+}
+
+void usage() {
+    cerr << "Usage: loadgen [--host H] [--port P] [--connections N] [--threads T] [--rate R]\n"
+            "               [--duration S] [--warmup S] [--drain S] [--mix NAME|kind=weight,...]\n"
+            "               [--graph-points N] [--no-bulk] [--seed S] [--json FILE]\n"
+            "Mixes:";
+    for (const auto& [name, spec] : PRESET_MIXES) cerr << " " << name << " (" << spec << ")";
+    cerr << "\nKinds:";
+    for (const char* name : KIND_NAMES) cerr << " " << name;
+    cerr << endl;
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--host" && hasValue) options.host = argv[++i];
+        else if (arg == "--port" && hasValue) options.port = atoi(argv[++i]);
+        else if (arg == "--connections" && hasValue) options.connections = max(1, atoi(argv[++i]));
+        else if (arg == "--threads" && hasValue) options.threads = max(1, atoi(argv[++i]));
+        else if (arg == "--rate" && hasValue) options.rate = atof(argv[++i]);
+        else if (arg == "--duration" && hasValue) options.duration = atof(argv[++i]);
+        else if (arg == "--warmup" && hasValue) options.warmup = atof(argv[++i]);
+        else if (arg == "--drain" && hasValue) options.drain = atof(argv[++i]);
+        else if (arg == "--mix" && hasValue) options.mix = argv[++i];
+        else if (arg == "--graph-points" && hasValue) options.graphPoints = max(3, atoi(argv[++i]));
+        else if (arg == "--no-bulk") options.bulk = false;
+        else if (arg == "--seed" && hasValue) options.seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--json" && hasValue) options.jsonPath = argv[++i];
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (!parseMix(options.mix, options.weights)) {
+        cerr << "Error: invalid mix " << options.mix << endl;
+        usage();
+        return 2;
+    }
+    options.threads = min(options.threads, options.connections);
+
+    // Thousands of connections need more descriptors than the usual soft limit
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    signal(SIGINT, [](int) { interrupted = 1; });
+
+    sockaddr_in address;
+    if (resolve(options, address) < 0) {
+        cerr << "Error: cannot resolve " << options.host << endl;
+        return 1;
+    }
+    if (!seedGraph(options, address)) {
+        cerr << "Error: could not load the initial graph on " << options.host << ":" << options.port << endl;
+        return 1;
+    }
+
+    vector<unique_ptr<Worker>> workers;
+    int connected = 0;
+    for (int t = 0; t < options.threads; t++) {
+        int share = options.connections / options.threads + (t < options.connections % options.threads);
+        workers.push_back(make_unique<Worker>(options, address, share, options.rate / options.threads,
+                                              options.seed + 1 + t));
+        connected += workers.back()->connectAll();
+    }
+    cout << "Connected " << connected << "/" << options.connections << " connections, "
+         << options.threads << " threads, mix " << options.mix << ", " << options.rate << " req/s" << endl;
+    if (connected == 0) return 1;
+
+    // Let the greetings arrive before the first request
+    uint64_t start = stats::nowNanos() + 200000000;
+    vector<thread> threads;
+    for (auto& worker : workers) {
+        threads.emplace_back([&worker, start] { worker->run(start); });
+    }
+    for (thread& t : threads) t.join();
+
+    Results total;
+    for (auto& worker : workers) total.add(worker->results);
+    stats::HistogramCounts allLatency, allService;
+    uint64_t completed = 0, errors = 0;
+    for (int k = 0; k < KIND_COUNT; k++) {
+        allLatency.add(total.latency[k]);
+        allService.add(total.service[k]);
+        completed += total.completed[k];
+        errors += total.errors[k];
+    }
+
+    double throughput = completed / options.duration;
+    cout << "Sent " << total.sent << " requests; measured " << completed << " replies in " << options.duration
+         << " s = " << fixed << setprecision(0) << throughput << " replies/s (target " << options.rate << ")" << endl;
+    cout << "Unanswered " << total.unanswered << ", connections lost " << total.connectionsLost << endl;
+    cout << "Latency from the scheduled send, microseconds:" << endl;
+    cout << left << setw(13) << "command" << right << setw(10) << "replies" << setw(8) << "errors";
+    for (const char* name : QUANTILE_NAMES) cout << setw(11) << name;
+    cout << setw(13) << "service p99" << endl;
+    for (int k = 0; k < KIND_COUNT; k++) {
+        if (total.completed[k] == 0) continue;
+        printRow(KIND_NAMES[k], total.completed[k], total.errors[k], total.latency[k], total.service[k]);
+    }
+    printRow("all", completed, errors, allLatency, allService);
+
+    if (!options.jsonPath.empty()) {
+        ofstream out(options.jsonPath);
+        out << "{\"benchmark\":\"loadgen\",\"host\":\"" << options.host << "\",\"port\":" << options.port
+            << ",\"connections\":" << options.connections << ",\"connected\":" << connected
+            << ",\"threads\":" << options.threads << ",\"mix\":\"" << options.mix << "\""
+            << ",\"target_rate\":" << options.rate << ",\"duration_s\":" << options.duration
+            << ",\"sent\":" << total.sent << ",\"replies\":" << completed << ",\"errors\":" << errors
+            << ",\"unanswered\":" << total.unanswered << ",\"connections_lost\":" << total.connectionsLost
+            << ",\"throughput\":" << throughput << ",\"latency\":";
+        jsonQuantiles(out, allLatency);
+        out << ",\"service\":";
+        jsonQuantiles(out, allService);
+        out << ",\"commands\":{";
+        bool first = true;
+        for (int k = 0; k < KIND_COUNT; k++) {
+            if (total.completed[k] == 0) continue;
+            out << (first ? "" : ",") << "\"" << KIND_NAMES[k] << "\":{\"replies\":" << total.completed[k]
+                << ",\"errors\":" << total.errors[k] << ",\"latency\":";
+            jsonQuantiles(out, total.latency[k]);
+            out << ",\"service\":";
+            jsonQuantiles(out, total.service[k]);
+            out << "}";
+            first = false;
+        }
+        out << "}}\n";
+        cout << "Wrote results to " << options.jsonPath << endl;
+    }
+    return total.unanswered > 0 || total.connectionsLost > 0 ? 1 : 0;
+}
@@ -0,0 +1,136 @@
+/**
+ * Point Parser Microbenchmark
+ * ---------------------------
+ * Compares the servers' original parsePointFromString (substr + remove_if +
+ * stod + exceptions) with the from_chars based parser in common/point_parser.hpp,
+ * both line by line and as one batch over the whole buffer.
+ *
+ * Usage: ./parse_bench [points] [bad_line_percent]
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <stdexcept>
+#include <cstdlib>
+#include "../common/point_parser.hpp"
+
+using namespace std;
+
+struct Point {
+    double x, y;
+    Point() : x(0), y(0) {}
+    Point(double x, double y) : x(x), y(y) {}
+};
+
+// The parser the servers used before common/point_parser.hpp, kept verbatim for comparison
+Point legacyParsePointFromString(const string& pointString) {
+    try {
+        size_t comma = pointString.find(',');
+        if (comma == string::npos) {
+            throw invalid_argument("Invalid point format: missing comma");
+        }
+        
+        string xStr = pointString.substr(0, comma);
+        string yStr = pointString.substr(comma + 1);
+        
+        xStr.erase(remove_if(xStr.begin(), xStr.end(), ::isspace), xStr.end());
+        yStr.erase(remove_if(yStr.begin(), yStr.end(), ::isspace), yStr.end());
+        
+        if (xStr.empty() || yStr.empty()) {
+            throw invalid_argument("Invalid point format: empty coordinate");
+        }
+        
+        return Point(stod(xStr), stod(yStr));
+    } catch (const exception& e) {
+        throw invalid_argument("Invalid point format: " + string(e.what()));
+    }
+}
+
+string makeInput(size_t numPoints, int badPercent) {
+    mt19937_64 rng(42);
+    uniform_real_distribution<double> coord(-10000.0, 10000.0);
+    uniform_int_distribution<int> percent(0, 99);
+
+    string input;
+    input.reserve(numPoints * 24);
+    for (size_t i = 0; i < numPoints; i++) {
+        if (percent(rng) < badPercent) {
+            input += "12.5 oops\n";
+        } else {
+            input += to_string(coord(rng)) + "," + to_string(coord(rng)) + "\n";
+        }
+    }
+    return input;
+}
+
+template <typename Func>
+double timeMs(Func func) {
+    auto start = chrono::steady_clock::now();
+    func();
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+void report(const string& name, double ms, size_t points, size_t accepted, size_t bytes) {
+    cout << left << setw(28) << name << right << fixed << setprecision(2)
+         << setw(10) << ms << " ms"
+         << setw(10) << (ms * 1e6 / points) << " ns/point"
+         << setw(10) << (bytes / 1e6) / (ms / 1e3) << " MB/s"
+         << "   accepted=" << accepted << endl;
+}
+
+int main(int argc, char* argv[]) {
+    size_t numPoints = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+    int badPercent = argc > 2 ? atoi(argv[2]) : 0;
+
+    string input = makeInput(numPoints, badPercent);
+    cout << "=== Point parser benchmark: " << numPoints << " lines, "
+         << badPercent << "% malformed, " << input.size() / 1e6 << " MB ===" << endl;
+
+    // Original framing and parsing: substr per line, exceptions for bad lines
+    vector<Point> points;
+    points.reserve(numPoints);
+    double ms = timeMs([&] {
+        size_t start = 0, end;
+        while ((end = input.find('\n', start)) != string::npos) {
+            string line = input.substr(start, end - start);
+            start = end + 1;
+            try {
+                points.push_back(legacyParsePointFromString(line));
+            } catch (const exception&) {
+            }
+        }
+    });
+    report("legacy (stod + throw)", ms, numPoints, points.size(), input.size());
+
+    // New parser, one string_view per line
+    points.clear();
+    ms = timeMs([&] {
+        string_view rest(input);
+        size_t end;
+        while ((end = rest.find('\n')) != string_view::npos) {
+            double x, y;
+            if (parsePoint(rest.substr(0, end), x, y) == ParseStatus::Ok) {
+                points.emplace_back(x, y);
+            }
+            rest.remove_prefix(end + 1);
+        }
+    });
+    report("parsePoint (per line)", ms, numPoints, points.size(), input.size());
+
+    // New parser, whole buffer in one batch
+    points.clear();
+    vector<LineError> errors;
+    size_t linesParsed = 0;
+    ms = timeMs([&] {
+        parsePointLines(input, numPoints, points, errors, linesParsed);
+    });
+    report("parsePointLines (batch)", ms, numPoints, points.size(), input.size());
+
+    return 0;
+}
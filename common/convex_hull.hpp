@@ -0,0 +1,391 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief The convex hull kernel used by every binary: Andrew's monotone chain.
+ *
+ * Header-only templates, so each caller gets code specialized and inlined for
+ * its own types:
+ *
+ *   coordinates  BasicPoint<T> for any arithmetic T. hull::Point is
+ *                BasicPoint<double>, the type the calculators and servers
+ *                store. Any struct with x and y members also works.
+ *   containers   the container overloads take any sequence with bidirectional
+ *                iterators, push_back and pop_back (vector, deque, list) and
+ *                return the hull in the same container type. The iterator
+ *                overloads work on plain arrays such as a mapped point file.
+ *   collinear    DropCollinear (the default, and what the binaries have always
+ *                done) keeps only the corners. KeepCollinear also keeps
+ *                points lying on the hull's edges, each distinct point once.
+ *
+ * The hull is counter-clockwise, starting at the lexicographically smallest
+ * point. Integer coordinates are multiplied in long long, which is exact while
+ * |coordinate| < 2^30. float coordinates are multiplied in double.
+ */
+namespace hull {
+
+template <typename T>
+struct BasicPoint {
+    typedef T Coord;
+    T x, y;
+    constexpr BasicPoint() : x(0), y(0) {}
+    constexpr BasicPoint(T x, T y) : x(x), y(y) {}
+};
+
+typedef BasicPoint<double> Point;
+
+// Coordinate type of a point type
+template <typename P>
+using CoordOf = typename std::decay<decltype(std::declval<const P&>().x)>::type;
+
+// Type areas are reported in
+template <typename T>
+using Real = typename std::common_type<T, double>::type;
+
+// Type cross products and area sums are computed in
+template <typename T>
+using Wide = typename std::conditional<std::is_integral<T>::value, long long, Real<T>>::type;
+
+// > 0 for a counter-clockwise turn O -> A -> B, < 0 for clockwise, 0 if collinear
+template <typename P>
+inline Wide<CoordOf<P>> cross(const P& o, const P& a, const P& b) {
+    typedef Wide<CoordOf<P>> W;
+    return (W(a.x) - W(o.x)) * (W(b.y) - W(o.y)) - (W(a.y) - W(o.y)) * (W(b.x) - W(o.x));
+}
+
+template <typename P>
+inline bool lexicographicLess(const P& a, const P& b) {
+    return (a.x != b.x) ? a.x < b.x : a.y < b.y;
+}
+
+template <typename P>
+inline bool samePoint(const P& a, const P& b) {
+    return a.x == b.x && a.y == b.y;
+}
+
+/**
+ * @brief Collinear-point policies: whether the chain drops its last vertex
+ * when the next point makes the given turn.
+ */
+struct DropCollinear {
+    static constexpr bool keepsCollinear = false;
+    template <typename W> static bool pops(W turn) { return turn <= 0; }
+};
+
+struct KeepCollinear {
+    static constexpr bool keepsCollinear = true;
+    template <typename W> static bool pops(W turn) { return turn < 0; }
+};
+
+template <typename Iterator>
+constexpr bool isRandomAccess() {
+    return std::is_base_of<std::random_access_iterator_tag,
+                           typename std::iterator_traits<Iterator>::iterator_category>::value;
+}
+
+// Sorts [first, last) with lexicographicLess
+template <typename RandomIt>
+inline void sortPoints(RandomIt first, RandomIt last) {
+    typedef typename std::iterator_traits<RandomIt>::value_type P;
+    std::sort(first, last, lexicographicLess<P>);
+}
+
+// Sorts a whole container; one without random access (std::list) is sorted through a vector
+template <typename Container>
+inline void sortPoints(Container& points) {
+    if constexpr (isRandomAccess<typename Container::iterator>()) {
+        sortPoints(points.begin(), points.end());
+    } else {
+        std::vector<typename Container::value_type> sorted(points.begin(), points.end());
+        sortPoints(sorted.begin(), sorted.end());
+        std::copy(sorted.begin(), sorted.end(), points.begin());
+    }
+}
+
+namespace detail {
+
+// A vector chain is sized for the worst case (every point a vertex) so it never regrows;
+// pages past the actual hull are never touched
+template <typename P, typename Allocator, typename BidirIt>
+inline void reserveChain(std::vector<P, Allocator>& hull, BidirIt first, BidirIt last) {
+    if constexpr (isRandomAccess<BidirIt>()) {
+        hull.reserve(std::distance(first, last) + 1);
+    }
+}
+
+template <typename Hull, typename BidirIt>
+inline void reserveChain(Hull&, BidirIt, BidirIt) {}
+
+// Appends p to a chain after popping the vertices it makes redundant, leaving at least minSize
+template <typename Policy, typename Hull, typename P>
+inline void extendChain(Hull& hull, size_t minSize, const P& p) {
+    if (Policy::keepsCollinear && !hull.empty() && samePoint(hull.back(), p)) return;
+    while (hull.size() >= minSize + 2) {
+        auto last = std::prev(hull.end());
+        if (!Policy::pops(cross(*std::prev(last), *last, p))) break;
+        hull.pop_back();
+    }
+    hull.push_back(p);
+}
+
+// True if every point of a sorted range lies on the line through its extremes
+template <typename BidirIt>
+inline bool allCollinear(BidirIt first, BidirIt last) {
+    BidirIt back = std::prev(last);
+    for (BidirIt it = first; it != last; ++it) {
+        if (cross(*first, *back, *it) != 0) return false;
+    }
+    return true;
+}
+
+} // namespace detail
+
+/**
+ * @brief Replaces hull with the hull of [first, last), which must already be
+ * sorted with sortPoints().
+ */
+template <typename Policy = DropCollinear, typename BidirIt, typename Hull>
+inline void monotoneChainSorted(BidirIt first, BidirIt last, Hull& hull) {
+    hull.clear();
+    if (first == last) return;
+    if (std::next(first) == last) {
+        hull.push_back(*first);
+        return;
+    }
+
+    // A segment; walking it back would add every inner point a second time
+    if (Policy::keepsCollinear && detail::allCollinear(first, last)) {
+        for (BidirIt it = first; it != last; ++it) {
+            if (hull.empty() || !samePoint(hull.back(), *it)) hull.push_back(*it);
+        }
+        return;
+    }
+
+    // Lower hull left to right, then upper hull back
+    detail::reserveChain(hull, first, last);
+    for (BidirIt it = first; it != last; ++it) detail::extendChain<Policy>(hull, 0, *it);
+    size_t lowerSize = hull.size();
+    for (BidirIt it = std::prev(last); it != first;) detail::extendChain<Policy>(hull, lowerSize - 1, *--it);
+
+    // The last vertex is the first one again
+    if (hull.size() > 1) hull.pop_back();
+}
+
+// Hull of a container already sorted with sortPoints(), in the same container type
+template <typename Policy = DropCollinear, typename Container>
+inline Container monotoneChainSorted(const Container& points) {
+    Container hull;
+    monotoneChainSorted<Policy>(points.begin(), points.end(), hull);
+    return hull;
+}
+
+/**
+ * @brief Small inputs: SMALL_HULL_MIN..SMALL_HULL_MAX points.
+ *
+ * Below the threshold the general path costs more than the geometry: heap
+ * allocations for the copy and the hull, std::sort's introsort through a
+ * comparator, and a loop whose trip count is unknown. monotoneChain,
+ * monotoneChainInPlace and convexHullArea dispatch these sizes to a kernel
+ * instantiated per size N instead. It copies the points into a stack array,
+ * sorts them with a fixed compare-exchange network, and runs the same chain
+ * code (so the same policy semantics) into a stack buffer. With N a
+ * compile-time constant, the network and the chain loops unroll.
+ */
+constexpr size_t SMALL_HULL_MIN = 3;
+constexpr size_t SMALL_HULL_MAX = 16;
+
+/**
+ * @brief Fixed-capacity vector on the stack: the chain buffer of the small
+ * kernels. Points must be default-constructible.
+ */
+template <typename P, size_t Capacity>
+class StackChain {
+public:
+    typedef P value_type;
+    typedef P* iterator;
+    typedef const P* const_iterator;
+
+    void clear() { count = 0; }
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+    P& back() { return items[count - 1]; }
+    void push_back(const P& p) { items[count++] = p; }
+    void pop_back() { count--; }
+    P* begin() { return items; }
+    P* end() { return items + count; }
+    const P* begin() const { return items; }
+    const P* end() const { return items + count; }
+
+private:
+    P items[Capacity];
+    size_t count = 0;
+};
+
+// Chain buffer for any small size: both chains together hold at most 2N vertices
+template <typename P>
+using SmallHull = StackChain<P, 2 * SMALL_HULL_MAX>;
+
+namespace detail {
+
+struct Exchange {
+    unsigned char a, b;
+};
+
+// Visits the compare-exchanges of Batcher's merge exchange network for n inputs (Knuth, TAOCP 5.2.2, Algorithm M)
+template <typename Visit>
+constexpr void mergeExchange(size_t n, Visit visit) {
+    if (n < 2) return;
+    size_t t = 0;
+    while ((size_t(1) << t) < n) t++;
+    for (size_t p = size_t(1) << (t - 1); p > 0; p >>= 1) {
+        size_t q = size_t(1) << (t - 1), r = 0, d = p;
+        while (d > 0) {
+            for (size_t i = 0; i + d < n; i++) {
+                if ((i & p) == r) visit(i, i + d);
+            }
+            d = q - p;
+            q >>= 1;
+            r = p;
+        }
+    }
+}
+
+template <size_t N>
+constexpr size_t networkSize() {
+    size_t count = 0;
+    mergeExchange(N, [&count](size_t, size_t) { count++; });
+    return count;
+}
+
+template <size_t N>
+constexpr std::array<Exchange, networkSize<N>()> makeNetwork() {
+    std::array<Exchange, networkSize<N>()> network{};
+    size_t k = 0;
+    mergeExchange(N, [&network, &k](size_t a, size_t b) {
+        network[k].a = (unsigned char)a;
+        network[k].b = (unsigned char)b;
+        k++;
+    });
+    return network;
+}
+
+template <size_t N>
+constexpr std::array<Exchange, networkSize<N>()> SORTING_NETWORK = makeNetwork<N>();
+
+// Leaves the lexicographically smaller point in a. Forcing this branch-free with
+// bit-mask blends measured slower: most of a network's late exchanges are predictable
+template <typename P>
+inline void compareExchange(P& a, P& b) {
+    const auto ax = a.x, ay = a.y, bx = b.x, by = b.y;
+    bool swap = (bx < ax) | ((bx == ax) & (by < ay));
+    a.x = swap ? bx : ax;
+    a.y = swap ? by : ay;
+    b.x = swap ? ax : bx;
+    b.y = swap ? ay : by;
+}
+
+template <size_t N, typename P, size_t... I>
+inline void sortNetwork(P* points, std::index_sequence<I...>) {
+    (compareExchange(points[SORTING_NETWORK<N>[I].a], points[SORTING_NETWORK<N>[I].b]), ...);
+}
+
+// Hull of the N points starting at first
+template <size_t N, typename Policy, typename InputIt, typename P>
+inline void smallChain(InputIt first, SmallHull<P>& hull) {
+    std::array<P, N> points;
+    for (size_t i = 0; i < N; i++, ++first) points[i] = *first;
+    sortNetwork<N>(points.data(), std::make_index_sequence<networkSize<N>()>());
+    monotoneChainSorted<Policy>(points.begin(), points.end(), hull);
+}
+
+template <typename Policy, typename InputIt, typename P, size_t... I>
+inline void dispatchSmallChain(size_t n, InputIt first, SmallHull<P>& hull, std::index_sequence<I...>) {
+    ((n == SMALL_HULL_MIN + I && (smallChain<SMALL_HULL_MIN + I, Policy>(first, hull), true)) || ...);
+}
+
+} // namespace detail
+
+// Hull of the n points starting at first, for SMALL_HULL_MIN <= n <= SMALL_HULL_MAX; the input is not modified
+template <typename Policy = DropCollinear, typename InputIt>
+inline void smallHull(size_t n, InputIt first, SmallHull<typename std::iterator_traits<InputIt>::value_type>& hull) {
+    detail::dispatchSmallChain<Policy>(n, first, hull,
+                                       std::make_index_sequence<SMALL_HULL_MAX - SMALL_HULL_MIN + 1>());
+}
+
+inline bool isSmallHull(size_t n) {
+    return n >= SMALL_HULL_MIN && n <= SMALL_HULL_MAX;
+}
+
+// A container without random access is sorted in a vector copy, and its chains built from that
+template <typename Policy = DropCollinear, typename Container>
+inline Container monotoneChain(Container points) {
+    if (isSmallHull(points.size())) {
+        SmallHull<typename Container::value_type> hull;
+        smallHull<Policy>(points.size(), points.begin(), hull);
+        return Container(hull.begin(), hull.end());
+    }
+    if constexpr (isRandomAccess<typename Container::iterator>()) {
+        sortPoints(points);
+        return monotoneChainSorted<Policy>(points);
+    } else {
+        std::vector<typename Container::value_type> sorted(points.begin(), points.end());
+        sortPoints(sorted.begin(), sorted.end());
+        Container hull;
+        monotoneChainSorted<Policy>(sorted.begin(), sorted.end(), hull);
+        return hull;
+    }
+}
+
+// Hull of [first, last) without copying the range, for arrays too big to copy; leaves the range
+// in unspecified order (sorted above SMALL_HULL_MAX, untouched below it)
+template <typename Policy = DropCollinear, typename RandomIt>
+inline std::vector<typename std::iterator_traits<RandomIt>::value_type> monotoneChainInPlace(RandomIt first, RandomIt last) {
+    typedef typename std::iterator_traits<RandomIt>::value_type P;
+    size_t n = last - first;
+    if (isSmallHull(n)) {
+        SmallHull<P> hull;
+        smallHull<Policy>(n, first, hull);
+        return std::vector<P>(hull.begin(), hull.end());
+    }
+    std::vector<P> hull;
+    sortPoints(first, last);
+    monotoneChainSorted<Policy>(first, last, hull);
+    return hull;
+}
+
+// Shoelace formula over the vertices in order; 0 for fewer than 3 vertices
+template <typename Container>
+inline Real<CoordOf<typename Container::value_type>> polygonArea(const Container& polygon) {
+    typedef CoordOf<typename Container::value_type> T;
+    typedef Wide<T> W;
+    if (polygon.size() < 3) return 0;
+
+    W area = 0;
+    auto begin = polygon.begin(), end = polygon.end();
+    for (auto it = begin, next = std::next(begin); it != end; ++it, ++next) {
+        if (next == end) next = begin;
+        area += W(it->x) * W(next->y) - W(next->x) * W(it->y);
+    }
+    return std::abs(Real<T>(area)) / 2;
+}
+
+// Area of the hull; small inputs are handled without touching the heap
+template <typename Policy = DropCollinear, typename Container>
+inline Real<CoordOf<typename Container::value_type>> convexHullArea(const Container& points) {
+    if (isSmallHull(points.size())) {
+        SmallHull<typename Container::value_type> hull;
+        smallHull<Policy>(points.size(), points.begin(), hull);
+        return polygonArea(hull);
+    }
+    return polygonArea(monotoneChain<Policy>(points));
+}
+
+} // namespace hull
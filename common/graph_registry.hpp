@@ -0,0 +1,139 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "grid_index.hpp"
+#include "hull_cache.hpp"
+#include "sliding_hull.hpp"
+
+/**
+ * @brief Named graphs, so tenants of one server stop sharing a single graph.
+ *
+ * Every graph carries its own lock, hull cache and version counter (the
+ * cache's), so clients working on different graphs never wait for each other.
+ * The registry's own lock is only taken to find or create a graph: lookups
+ * share it, and graphs are never removed, so a Graph& stays valid for the life
+ * of the process and can be held without the registry lock.
+ *
+ * The graph named DEFAULT_NAME always exists; it is the one clients start on.
+ */
+namespace graphs {
+
+constexpr const char* DEFAULT_NAME = "default";
+constexpr size_t MAX_NAME_LENGTH = 64;
+constexpr size_t DEFAULT_MAX_GRAPHS = 1024;   ///< Bounds the memory a client can claim with new names
+
+// Letters, digits, '_', '-' and '.', 1 to MAX_NAME_LENGTH characters
+inline bool validName(std::string_view name) {
+    if (name.empty() || name.size() > MAX_NAME_LENGTH) return false;
+    for (char c : name) {
+        bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                  c == '_' || c == '-' || c == '.';
+        if (!ok) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Vertices of a graph's hull, handed to readers that do not take the graph lock.
+ * Counter-clockwise, as hull::monotoneChain returns them.
+ */
+template <typename PointT>
+struct PublishedHull {
+    std::vector<PointT> vertices;
+    std::chrono::steady_clock::time_point expires;   ///< When a window's oldest point ages out
+};
+
+/**
+ * @brief One graph; mutex guards points, window, index and hullCache.
+ * A windowed graph keeps its points in window instead of points.
+ * Mutex is constructed from a name (lockprof::Mutex), so LOCKS reports each graph separately.
+ */
+template <typename PointT, typename Mutex>
+struct Graph {
+    explicit Graph(std::string graphName)
+        : name(std::move(graphName)), lockName("graph:" + name), mutex(lockName.c_str()) {}
+
+    Graph(const Graph&) = delete;
+    Graph& operator=(const Graph&) = delete;
+
+    bool isDefault() const { return name == DEFAULT_NAME; }
+    size_t size() const { return window ? window->size() : points.size(); }
+
+    const std::string name;
+    const std::string lockName;
+    Mutex mutex;
+    std::vector<PointT> points;
+    std::unique_ptr<hull::SlidingHull<PointT>> window;   ///< Set while only the newest points count
+    std::unique_ptr<spatial::GridIndex<PointT>> index;   ///< Built by the first rectangle query, then kept in step with points
+    HullCache hullCache;          ///< Last CH area, valid until the graph changes
+    size_t reportedPoints = 0;    ///< points.size() as last added to the server's gauges
+    /// The current hull, or null once the graph changed; use std::atomic_load/atomic_store, not mutex
+    std::shared_ptr<const PublishedHull<PointT>> publishedHull;
+};
+
+template <typename PointT, typename Mutex>
+class Registry {
+public:
+    using GraphT = Graph<PointT, Mutex>;
+
+    explicit Registry(size_t maxGraphs = DEFAULT_MAX_GRAPHS) : maxGraphs(maxGraphs) {
+        auto graph = std::make_unique<GraphT>(DEFAULT_NAME);
+        defaultPtr = graph.get();
+        byName.emplace(DEFAULT_NAME, std::move(graph));
+    }
+
+    Registry(const Registry&) = delete;
+    Registry& operator=(const Registry&) = delete;
+
+    GraphT& defaultGraph() { return *defaultPtr; }
+
+    // The graph called name, or nullptr
+    GraphT* find(std::string_view name) const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        auto it = byName.find(name);
+        return it == byName.end() ? nullptr : it->second.get();
+    }
+
+    // The graph called name, created empty if needed; nullptr if name is invalid or the registry full
+    GraphT* open(std::string_view name) {
+        if (GraphT* graph = find(name)) return graph;
+        if (!validName(name)) return nullptr;
+
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        auto it = byName.find(name);   // Another client may have created it meanwhile
+        if (it != byName.end()) return it->second.get();
+        if (byName.size() >= maxGraphs) return nullptr;
+        auto graph = std::make_unique<GraphT>(std::string(name));
+        GraphT* created = graph.get();
+        byName.emplace(created->name, std::move(graph));
+        return created;
+    }
+
+    // Every graph in name order; the pointers stay valid after the lock is released
+    std::vector<GraphT*> all() const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        std::vector<GraphT*> graphs;
+        graphs.reserve(byName.size());
+        for (const auto& entry : byName) graphs.push_back(entry.second.get());
+        return graphs;
+    }
+
+    size_t capacity() const { return maxGraphs; }
+
+private:
+    mutable std::shared_mutex mutex;
+    std::map<std::string, std::unique_ptr<GraphT>, std::less<>> byName;
+    GraphT* defaultPtr;
+    const size_t maxGraphs;
+};
+
+} // namespace graphs
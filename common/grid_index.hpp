@@ -0,0 +1,167 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Uniform grid over a graph's points, for queries restricted to a rectangle.
+ *
+ * Cells are squares sized when the index is built, for about POINTS_PER_CELL
+ * points per cell over the points' bounding box, and only occupied cells are
+ * stored (hashed by cell coordinates), so points that later land far outside
+ * that box cost nothing extra. A query visits the cells overlapping the
+ * rectangle, or every occupied cell when that is fewer; cells entirely inside
+ * it are taken whole, and only the points of the cells on its border are tested.
+ *
+ * Once the point count is off by a factor of REBUILD_FACTOR from what the cells
+ * were sized for, stale() says so and the owner should build a new index.
+ * Not synchronized.
+ */
+namespace spatial {
+
+struct Rect {
+    double minX, minY, maxX, maxY;
+
+    template <typename P>
+    bool contains(const P& p) const { return p.x >= minX && p.x <= maxX && p.y >= minY && p.y <= maxY; }
+};
+
+template <typename P>
+class GridIndex {
+public:
+    static constexpr size_t POINTS_PER_CELL = 8;
+    static constexpr size_t REBUILD_FACTOR = 4;
+
+    explicit GridIndex(const std::vector<P>& points) : sizedFor(points.size()) {
+        cellSize = chooseCellSize(points);
+        for (const P& p : points) insert(p);
+    }
+
+    void insert(const P& p) {
+        cells[keyOf(cellOf(p.x), cellOf(p.y))].push_back(p);
+        count++;
+    }
+
+    // Erase one point equal to p; false if there is none
+    bool erase(const P& p) {
+        auto cell = cells.find(keyOf(cellOf(p.x), cellOf(p.y)));
+        if (cell == cells.end()) return false;
+        std::vector<P>& points = cell->second;
+        for (size_t i = 0; i < points.size(); i++) {
+            if (points[i].x != p.x || points[i].y != p.y) continue;
+            points[i] = points.back();
+            points.pop_back();
+            if (points.empty()) cells.erase(cell);
+            count--;
+            return true;
+        }
+        return false;
+    }
+
+    void clear() {
+        cells.clear();
+        count = 0;
+    }
+
+    size_t size() const { return count; }
+
+    bool stale() const {
+        size_t floor = std::max(sizedFor, (size_t)POINTS_PER_CELL);
+        return count > floor * REBUILD_FACTOR || count * REBUILD_FACTOR < sizedFor;
+    }
+
+    // Number of points inside rect, borders included
+    size_t countIn(const Rect& rect) const {
+        size_t found = 0;
+        visit(rect, [&](const std::vector<P>& points, bool whole) {
+            if (whole) {
+                found += points.size();
+                return;
+            }
+            for (const P& p : points) found += rect.contains(p);
+        });
+        return found;
+    }
+
+    // Append the points inside rect, borders included, to out
+    void collect(const Rect& rect, std::vector<P>& out) const {
+        visit(rect, [&](const std::vector<P>& points, bool whole) {
+            if (whole) {
+                out.insert(out.end(), points.begin(), points.end());
+                return;
+            }
+            for (const P& p : points) {
+                if (rect.contains(p)) out.push_back(p);
+            }
+        });
+    }
+
+private:
+    static double chooseCellSize(const std::vector<P>& points) {
+        if (points.size() < 2) return 1.0;
+        double minX = points[0].x, maxX = minX, minY = points[0].y, maxY = minY;
+        for (const P& p : points) {
+            minX = std::min(minX, (double)p.x);
+            maxX = std::max(maxX, (double)p.x);
+            minY = std::min(minY, (double)p.y);
+            maxY = std::max(maxY, (double)p.y);
+        }
+        double side = std::max(maxX - minX, maxY - minY);
+        if (!(side > 0) || !std::isfinite(side)) return 1.0;
+        double cellsPerSide = std::sqrt((double)points.size() / POINTS_PER_CELL);
+        return side / std::max(1.0, cellsPerSide);
+    }
+
+    // Cell coordinate, clamped so that far-off points share the edge cells
+    int32_t cellOf(double value) const {
+        double cell = std::floor(value / cellSize);
+        if (!(cell > INT32_MIN)) return INT32_MIN;
+        if (!(cell < INT32_MAX)) return INT32_MAX;
+        return (int32_t)cell;
+    }
+
+    static uint64_t keyOf(int32_t cx, int32_t cy) { return ((uint64_t)(uint32_t)cx << 32) | (uint32_t)cy; }
+    static int32_t cellX(uint64_t key) { return (int32_t)(uint32_t)(key >> 32); }
+    static int32_t cellY(uint64_t key) { return (int32_t)(uint32_t)key; }
+
+    // Cell fully inside rect; the clamped edge cells never are, they may hold points beyond them
+    bool wholeCell(int32_t cx, int32_t cy, const Rect& rect) const {
+        if (cx == INT32_MIN || cx == INT32_MAX || cy == INT32_MIN || cy == INT32_MAX) return false;
+        return cx * cellSize >= rect.minX && (cx + 1.0) * cellSize <= rect.maxX &&
+               cy * cellSize >= rect.minY && (cy + 1.0) * cellSize <= rect.maxY;
+    }
+
+    // Calls f(points, whole) for each occupied cell overlapping rect; whole if the cell is inside it
+    template <typename F>
+    void visit(const Rect& rect, F f) const {
+        if (count == 0 || rect.minX > rect.maxX || rect.minY > rect.maxY) return;
+        int32_t x0 = cellOf(rect.minX), x1 = cellOf(rect.maxX);
+        int32_t y0 = cellOf(rect.minY), y1 = cellOf(rect.maxY);
+
+        double spanned = ((double)x1 - x0 + 1) * ((double)y1 - y0 + 1);
+        if (spanned > (double)cells.size()) {
+            for (const auto& [key, points] : cells) {
+                int32_t cx = cellX(key), cy = cellY(key);
+                if (cx >= x0 && cx <= x1 && cy >= y0 && cy <= y1) f(points, wholeCell(cx, cy, rect));
+            }
+            return;
+        }
+        for (int64_t cx = x0; cx <= x1; cx++) {
+            for (int64_t cy = y0; cy <= y1; cy++) {
+                auto cell = cells.find(keyOf((int32_t)cx, (int32_t)cy));
+                if (cell != cells.end()) f(cell->second, wholeCell((int32_t)cx, (int32_t)cy, rect));
+            }
+        }
+    }
+
+    double cellSize;
+    size_t sizedFor;
+    size_t count = 0;
+    std::unordered_map<uint64_t, std::vector<P>> cells;
+};
+
+} // namespace spatial
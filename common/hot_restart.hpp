@@ -0,0 +1,423 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "point_file.hpp"
+#include "stats.hpp"
+#include "wal.hpp"
+
+/**
+ * @brief Zero-downtime restart: a new server process takes over from the running one.
+ *
+ * With CH_HANDOFF_PATH set, a server listens on a Unix domain socket at that
+ * path. A new process started with the same setting connects to it before
+ * binding port 9034, and the running server hands over:
+ *
+ *   1. It closes its WriteGate, so every command that would change the graph
+ *      (or save it) is refused from now on, and waits for those in flight.
+ *   2. It commits and stops its write-ahead log, so the log has one writer.
+ *   3. It copies the graph into a memfd as a float64 point file whose header
+ *      carries the log position, and sends the memfd together with its
+ *      listening sockets (port 9034 and the metrics port, if open) in one
+ *      SCM_RIGHTS message.
+ *   4. The new process maps the memfd and acknowledges.
+ *   5. The old process confirms, closes its copies of the listeners and
+ *      drains: its existing clients are still answered, read-only, until they
+ *      disconnect or CH_HANDOFF_DRAIN_SECONDS (default 30) pass, and then it
+ *      exits.
+ *   6. Only on the confirmation does the new process start accepting on the
+ *      very same sockets. Nothing is ever closed, so clients keep connecting
+ *      throughout.
+ *
+ * If the new process does not acknowledge in time, the old one shuts the
+ * handoff socket down, so a late acknowledgement fails and the new process
+ * never gets its confirmation, then reopens the gate and the log and carries
+ * on as if nothing happened. Either way exactly one process serves and writes
+ * the log.
+ */
+namespace handoff {
+
+constexpr char MAGIC[8] = {'C', 'H', 'H', 'A', 'N', 'D', 'O', 'F'};
+constexpr uint32_t VERSION = 2;
+constexpr int MESSAGE_TIMEOUT_MS = 10000;   ///< How long the new process waits for the graph and sockets
+constexpr int ACK_TIMEOUT_MS = 30000;       ///< How long the old process waits for the new one to load the graph
+constexpr int CONFIRM_TIMEOUT_MS = 5000;    ///< How long the new process waits for the go-ahead after acknowledging
+constexpr int DEFAULT_DRAIN_SECONDS = 30;
+
+// Path of the handoff socket from CH_HANDOFF_PATH, or empty when hot restart is off
+inline std::string pathFromEnv() {
+    const char* value = std::getenv("CH_HANDOFF_PATH");
+    return value ? value : "";
+}
+
+// Longest the old process keeps serving its clients, CH_HANDOFF_DRAIN_SECONDS
+inline int drainSecondsFromEnv() {
+    const char* value = std::getenv("CH_HANDOFF_DRAIN_SECONDS");
+    if (!value) return DEFAULT_DRAIN_SECONDS;
+    int seconds = std::atoi(value);
+    return seconds >= 0 ? seconds : DEFAULT_DRAIN_SECONDS;
+}
+
+// Sent with the descriptors: graph memfd, port listener, then the metrics listener if present
+struct Message {
+    char magic[8];
+    uint32_t version;
+    uint32_t listeners;
+};
+
+/**
+ * @brief Lets graph mutations through until the graph is handed over.
+ *
+ * A command that changes the graph holds a Pass for its duration. freeze()
+ * closes the gate and then waits for the passes in flight, so once it returns
+ * the graph no longer changes and can be copied without the graph lock.
+ * Commands that do not change the graph pass without touching the gate.
+ */
+class WriteGate {
+public:
+    class Pass {
+    public:
+        Pass(WriteGate& gate, bool mutates) {
+            if (!mutates) return;
+            gate.writers.fetch_add(1);
+            if (gate.closed.load()) {
+                gate.writers.fetch_sub(1);
+                allowed = false;
+            } else {
+                holder = &gate;
+            }
+        }
+        ~Pass() {
+            if (holder) holder->writers.fetch_sub(1);
+        }
+        Pass(const Pass&) = delete;
+        Pass& operator=(const Pass&) = delete;
+
+        // False when the command must be refused
+        explicit operator bool() const { return allowed; }
+
+    private:
+        WriteGate* holder = nullptr;
+        bool allowed = true;
+    };
+
+    bool frozen() const { return closed.load(); }
+
+    void freeze() {
+        closed.store(true);
+        while (writers.load() > 0) std::this_thread::yield();
+    }
+
+    void thaw() { closed.store(false); }
+
+private:
+    std::atomic<int> writers{0};
+    std::atomic<bool> closed{false};
+};
+
+// Reply to a command the frozen graph refuses
+constexpr const char* FROZEN_REPLY = "Error: Server is restarting; reconnect to change the graph";
+
+// Commands a frozen graph refuses: the ones that change it, and SAVE, whose file the new process now owns
+inline bool mutates(stats::Command command) {
+    return command == stats::CMD_NEWGRAPH || command == stats::CMD_POINT || command == stats::CMD_NEWPOINT ||
+           command == stats::CMD_REMOVEPOINT || command == stats::CMD_SAVE;
+}
+
+inline bool fillAddress(const std::string& path, sockaddr_un& address) {
+    if (path.size() >= sizeof(address.sun_path)) return false;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+/**
+ * @brief The running server's end: the Unix socket successors connect to.
+ */
+class Endpoint {
+public:
+    Endpoint() = default;
+    ~Endpoint() { close(); }
+    Endpoint(const Endpoint&) = delete;
+    Endpoint& operator=(const Endpoint&) = delete;
+
+    // Binds path, replacing whatever is there; false with error set on failure
+    bool open(const std::string& socketPath, std::string& error) {
+        sockaddr_un address;
+        if (!fillAddress(socketPath, address)) {
+            error = socketPath + ": path too long";
+            return false;
+        }
+        listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listener < 0) {
+            error = std::string("socket: ") + strerror(errno);
+            return false;
+        }
+        unlink(socketPath.c_str());
+
+        // Owner only from the moment it exists: a chmod() after bind() leaves a window to connect in
+        mode_t oldMask = umask(0077);
+        int bound = bind(listener, (sockaddr*)&address, sizeof(address));
+        umask(oldMask);
+        struct stat info;
+        if (bound < 0 || chmod(socketPath.c_str(), 0600) < 0 ||
+            listen(listener, 1) < 0 || stat(socketPath.c_str(), &info) < 0) {
+            error = socketPath + ": " + strerror(errno);
+            close();
+            return false;
+        }
+        path = socketPath;
+        inode = info.st_ino;
+        return true;
+    }
+
+    int fd() const { return listener; }
+
+    // Connection from a successor, or -1
+    int accept() { return listener < 0 ? -1 : ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC); }
+
+    // Removes the socket file too, unless a successor has already bound its own there
+    void close() {
+        if (listener < 0) return;
+        ::close(listener);
+        listener = -1;
+        struct stat info;
+        if (stat(path.c_str(), &info) == 0 && info.st_ino == inode) unlink(path.c_str());
+    }
+
+private:
+    int listener = -1;
+    std::string path;
+    ino_t inode = 0;
+};
+
+// Graph as a float64 point file in an anonymous memory file, or -1 with error set
+template <typename PointT>
+int graphToMemfd(const std::vector<PointT>& points, uint64_t lsn, std::string& error) {
+    static_assert(sizeof(PointT) == 2 * sizeof(double), "points are sent as packed float64 pairs");
+    int fd = memfd_create("convex_hull-graph", MFD_CLOEXEC);
+    if (fd < 0) {
+        error = std::string("memfd_create: ") + strerror(errno);
+        return -1;
+    }
+    pointfile::Header header = pointfile::Header();
+    memcpy(header.magic, pointfile::MAGIC, sizeof(pointfile::MAGIC));
+    header.version = pointfile::VERSION;
+    header.coordType = pointfile::COORD_FLOAT64;
+    header.count = points.size();
+    header.lsn = lsn;
+    if (!points.empty()) {
+        header.minX = header.minY = std::numeric_limits<double>::infinity();
+        header.maxX = header.maxY = -std::numeric_limits<double>::infinity();
+        for (const PointT& p : points) {
+            header.minX = std::min(header.minX, p.x);
+            header.minY = std::min(header.minY, p.y);
+            header.maxX = std::max(header.maxX, p.x);
+            header.maxY = std::max(header.maxY, p.y);
+        }
+    }
+
+    size_t size = sizeof(header) + points.size() * sizeof(PointT);
+    void* mapped = MAP_FAILED;
+    if (ftruncate(fd, size) == 0) mapped = mmap(nullptr, size, PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        error = std::string("memfd: ") + strerror(errno);
+        close(fd);
+        return -1;
+    }
+    memcpy(mapped, &header, sizeof(header));
+    if (!points.empty()) memcpy(static_cast<char*>(mapped) + sizeof(header), points.data(), points.size() * sizeof(PointT));
+    munmap(mapped, size);
+    return fd;
+}
+
+/**
+ * @brief Sends the graph and listeners to the successor and waits for it to take over.
+ * Call with the gate frozen. metricsListener may be -1.
+ */
+template <typename PointT>
+bool send(int successor, int listener, int metricsListener, const std::vector<PointT>& points,
+          uint64_t lsn, std::string& error) {
+    int graphFd = graphToMemfd(points, lsn, error);
+    if (graphFd < 0) return false;
+
+    Message message = {};
+    memcpy(message.magic, MAGIC, sizeof(MAGIC));
+    message.version = VERSION;
+    message.listeners = metricsListener >= 0 ? 2 : 1;
+    int fds[3] = {graphFd, listener, metricsListener};
+    int fdCount = 1 + message.listeners;
+
+    char control[CMSG_SPACE(sizeof(fds))] = {};
+    iovec payload = {&message, sizeof(message)};
+    msghdr header = {};
+    header.msg_iov = &payload;
+    header.msg_iovlen = 1;
+    header.msg_control = control;
+    header.msg_controllen = CMSG_SPACE(fdCount * sizeof(int));
+    cmsghdr* rights = CMSG_FIRSTHDR(&header);
+    rights->cmsg_level = SOL_SOCKET;
+    rights->cmsg_type = SCM_RIGHTS;
+    rights->cmsg_len = CMSG_LEN(fdCount * sizeof(int));
+    memcpy(CMSG_DATA(rights), fds, fdCount * sizeof(int));
+
+    ssize_t sent = sendmsg(successor, &header, MSG_NOSIGNAL);
+    close(graphFd);
+    if (sent != (ssize_t)sizeof(message)) {
+        error = std::string("sendmsg: ") + strerror(errno);
+        return false;
+    }
+
+    // The successor answers once it has the graph; it accepts only after the confirmation
+    pollfd ready = {successor, POLLIN, 0};
+    char ack = 0;
+    char confirm = 'G';
+    if (poll(&ready, 1, ACK_TIMEOUT_MS) != 1 || recv(successor, &ack, 1, 0) != 1 || ack != 'K' ||
+        ::send(successor, &confirm, 1, MSG_NOSIGNAL) != 1) {
+        // A late acknowledgement now fails, so the successor cannot start serving alongside this process
+        shutdown(successor, SHUT_RDWR);
+        error = "the new process did not take over";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief The old process's side: freezes the graph, stops the log and sends everything.
+ * On failure the gate and the log are reopened and the server carries on.
+ */
+template <typename PointT>
+bool handOver(int successor, WriteGate& gate, wal::Log& log, const std::vector<PointT>& points,
+              int listener, int metricsListener, std::string& error) {
+    gate.freeze();
+    log.stop();
+    uint64_t lsn = log.lastLsn();
+    if (send(successor, listener, metricsListener, points, lsn, error)) return true;
+    log.start(lsn);
+    gate.thaw();
+    return false;
+}
+
+/**
+ * @brief The new process's side: takes over from the server at path, if one is running.
+ *
+ * On success listener (and metricsListener, or -1) are the running server's
+ * sockets, points holds its graph and lsn its log position. Returns false with
+ * error empty when nobody is listening at path, i.e. a normal cold start.
+ */
+template <typename PointT>
+bool receive(const std::string& path, int& listener, int& metricsListener, std::vector<PointT>& points,
+             uint64_t& lsn, std::string& error) {
+    listener = metricsListener = -1;
+    sockaddr_un address;
+    if (!fillAddress(path, address)) {
+        error = path + ": path too long";
+        return false;
+    }
+    int channel = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (channel < 0) {
+        error = std::string("socket: ") + strerror(errno);
+        return false;
+    }
+    if (connect(channel, (sockaddr*)&address, sizeof(address)) < 0) {
+        if (errno != ENOENT && errno != ECONNREFUSED) error = path + ": " + strerror(errno);
+        close(channel);
+        return false;
+    }
+
+    // The old process may first wait for commands in flight
+    Message message = {};
+    int fds[3] = {-1, -1, -1};
+    char control[CMSG_SPACE(sizeof(fds))] = {};
+    iovec payload = {&message, sizeof(message)};
+    msghdr header = {};
+    header.msg_iov = &payload;
+    header.msg_iovlen = 1;
+    header.msg_control = control;
+    header.msg_controllen = sizeof(control);
+    pollfd ready = {channel, POLLIN, 0};
+    ssize_t received = poll(&ready, 1, MESSAGE_TIMEOUT_MS) == 1 ? recvmsg(channel, &header, MSG_CMSG_CLOEXEC) : -1;
+
+    int fdCount = 0;
+    for (cmsghdr* rights = CMSG_FIRSTHDR(&header); rights; rights = CMSG_NXTHDR(&header, rights)) {
+        if (rights->cmsg_level == SOL_SOCKET && rights->cmsg_type == SCM_RIGHTS) {
+            fdCount = (rights->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            memcpy(fds, CMSG_DATA(rights), std::min<size_t>(fdCount, 3) * sizeof(int));
+        }
+    }
+    auto fail = [&](const std::string& what) {
+        error = what;
+        for (int i = 0; i < fdCount && i < 3; i++) close(fds[i]);
+        close(channel);
+        listener = metricsListener = -1;
+        return false;
+    };
+    if (received == 0) return fail("the running server at " + path + " refused the handoff; see its log");
+    if (received != (ssize_t)sizeof(message) || memcmp(message.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        message.version != VERSION || fdCount != (int)message.listeners + 1) {
+        return fail("no valid handoff from " + path);
+    }
+
+    pointfile::Mapping graph;
+    if (!graph.open(fds[0], "handed-over graph", error)) return fail(error);
+    points.reserve(points.size() + graph.size());
+    graph.appendTo<PointT>(points);
+    lsn = graph.header().lsn;
+    close(fds[0]);
+    listener = fds[1];
+    metricsListener = message.listeners > 1 ? fds[2] : -1;
+
+    // The sockets are used only once the old process confirms it has let go of them
+    char ack = 'K', confirm = 0;
+    pollfd confirmed = {channel, POLLIN, 0};
+    bool acknowledged = ::send(channel, &ack, 1, MSG_NOSIGNAL) == 1 && poll(&confirmed, 1, CONFIRM_TIMEOUT_MS) == 1 &&
+                        recv(channel, &confirm, 1, 0) == 1 && confirm == 'G';
+    close(channel);
+    if (!acknowledged) {
+        // The old process gave up waiting and keeps serving; do not share its sockets
+        close(listener);
+        if (metricsListener >= 0) close(metricsListener);
+        listener = metricsListener = -1;
+        points.clear();
+        error = "the running server stopped waiting for the handoff";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief The old process after a handoff: done once its clients are gone or time is up.
+ * start() and finished() may be called from different threads.
+ */
+class Drain {
+public:
+    void start(int seconds) {
+        deadline.store(stats::nowNanos() + uint64_t(seconds) * 1000000000ull, std::memory_order_release);
+    }
+
+    bool finished() const {
+        uint64_t until = deadline.load(std::memory_order_acquire);
+        return until != 0 && (stats::activeConnections.load(std::memory_order_relaxed) == 0 ||
+                              stats::nowNanos() >= until);
+    }
+
+private:
+    std::atomic<uint64_t> deadline{0};   ///< 0 until the handoff
+};
+
+} // namespace handoff
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @brief Remembers the last CH area together with the graph version it was computed for.
+ *
+ * Every mutation of the shared graph calls invalidate(), which bumps the
+ * version. CH takes the cached area while the version is unchanged and
+ * otherwise computes it outside the graph lock and offers it back with
+ * store(), which is ignored if the graph changed in the meantime.
+ * Not synchronized: guard it with the same lock as the graph.
+ */
+class HullCache {
+public:
+    void invalidate() { version++; }
+    uint64_t currentVersion() const { return version; }
+
+    bool lookup(double& area) const {
+        if (cachedVersion != version) return false;
+        area = cachedArea;
+        return true;
+    }
+
+    void store(uint64_t forVersion, double area) {
+        if (forVersion != version) return;
+        cachedVersion = forVersion;
+        cachedArea = area;
+    }
+
+private:
+    uint64_t version = 0;
+    uint64_t cachedVersion = UINT64_MAX;
+    double cachedArea = 0.0;
+};
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+#include "convex_hull.hpp"
+
+/**
+ * @brief Queries against a hull as monotoneChain returns it: counter-clockwise,
+ * starting at the lexicographically smallest vertex, no collinear vertices.
+ *
+ * Both queries binary search the fan of triangles around vertex 0, so they take
+ * O(log h) for a hull of h vertices and never touch the points it came from.
+ */
+namespace hull {
+
+enum class Location { Outside, Boundary, Inside };
+
+namespace detail {
+
+// q on the segment a-b, given that it is on the line through them
+template <typename P>
+inline bool withinSegment(const P& a, const P& b, const P& q) {
+    return std::min(a.x, b.x) <= q.x && q.x <= std::max(a.x, b.x) &&
+           std::min(a.y, b.y) <= q.y && q.y <= std::max(a.y, b.y);
+}
+
+// The last i in [1, n-2] with q left of or on the ray from vertex 0 through vertex i
+template <typename P>
+inline size_t fanIndex(const std::vector<P>& hull, const P& q) {
+    size_t low = 1, high = hull.size() - 1;
+    while (high - low > 1) {
+        size_t middle = (low + high) / 2;
+        if (cross(hull[0], hull[middle], q) >= 0) low = middle;
+        else high = middle;
+    }
+    return low;
+}
+
+// Edge i runs from vertex i to vertex i + 1; q sees it from outside
+template <typename P>
+inline bool edgeVisible(const std::vector<P>& hull, size_t i, const P& q) {
+    return cross(hull[i], hull[(i + 1) % hull.size()], q) < 0;
+}
+
+// Offset of the first edge after from that has the visibility opposite to edge from's, for up to span edges
+template <typename P>
+inline size_t visibilityChange(const std::vector<P>& hull, size_t from, size_t span, const P& q) {
+    bool visible = edgeVisible(hull, from, q);
+    size_t low = 0, high = span;   // Edge from + low is like edge from, edge from + high is not
+    while (high - low > 1) {
+        size_t middle = (low + high) / 2;
+        if (edgeVisible(hull, (from + middle) % hull.size(), q) == visible) low = middle;
+        else high = middle;
+    }
+    return high;
+}
+
+} // namespace detail
+
+// Whether q lies inside the hull, on its boundary or outside it
+template <typename P>
+inline Location locatePoint(const std::vector<P>& hull, const P& q) {
+    size_t n = hull.size();
+    if (n == 0) return Location::Outside;
+    if (n == 1) return samePoint(hull[0], q) ? Location::Boundary : Location::Outside;
+    if (n == 2) {
+        bool onEdge = cross(hull[0], hull[1], q) == 0 && detail::withinSegment(hull[0], hull[1], q);
+        return onEdge ? Location::Boundary : Location::Outside;
+    }
+
+    // Outside the angle at vertex 0, or on one of its two edges
+    auto first = cross(hull[0], hull[1], q), last = cross(hull[0], hull[n - 1], q);
+    if (first < 0 || last > 0) return Location::Outside;
+    if (first == 0) return detail::withinSegment(hull[0], hull[1], q) ? Location::Boundary : Location::Outside;
+    if (last == 0) return detail::withinSegment(hull[0], hull[n - 1], q) ? Location::Boundary : Location::Outside;
+
+    // Inside the angle: the triangle of the fan that holds q decides
+    size_t i = detail::fanIndex(hull, q);
+    auto side = cross(hull[i], hull[i + 1], q);
+    if (side > 0) return Location::Inside;
+    return side == 0 ? Location::Boundary : Location::Outside;
+}
+
+/**
+ * @brief The two vertices where lines from q touch the hull, for q outside it.
+ *
+ * The edges q sees are consecutive; first is where they start and last where
+ * they end, so walking the hull counter-clockwise from first to last passes the
+ * side facing q. Returns false if q is inside or on the hull.
+ *
+ * Finding one edge q sees and one it does not is enough: visibility then
+ * changes once on each arc between them, and both changes are found by binary
+ * search. The fan around vertex 0 yields the pair in O(log h).
+ */
+template <typename P>
+inline bool tangentPoints(const std::vector<P>& hull, const P& q, size_t& first, size_t& last) {
+    size_t n = hull.size();
+    if (locatePoint(hull, q) != Location::Outside) return false;
+    if (n < 3) {
+        first = 0;
+        last = n - 1;
+        return true;
+    }
+
+    bool firstVisible = detail::edgeVisible(hull, 0, q);
+    bool lastVisible = detail::edgeVisible(hull, n - 1, q);
+    size_t seen, hidden;
+    if (firstVisible != lastVisible) {
+        seen = firstVisible ? 0 : n - 1;
+        hidden = firstVisible ? n - 1 : 0;
+    } else if (!firstVisible) {
+        // q lies in the angle at vertex 0, beyond the edge that closes its triangle of the fan
+        seen = detail::fanIndex(hull, q);
+        hidden = 0;
+    } else {
+        // Vertex 0 faces q; the line from q through it leaves the hull by an edge facing away
+        P mirrored = q;
+        mirrored.x = hull[0].x + (hull[0].x - q.x);
+        mirrored.y = hull[0].y + (hull[0].y - q.y);
+        seen = 0;
+        hidden = detail::fanIndex(hull, mirrored);
+    }
+
+    if (!detail::edgeVisible(hull, seen, q) || detail::edgeVisible(hull, hidden, q)) {
+        // Rounding put the pair on the wrong side of an edge: look for it edge by edge
+        for (seen = 0; seen < n && !detail::edgeVisible(hull, seen, q); seen++) {}
+        for (hidden = 0; hidden < n && detail::edgeVisible(hull, hidden, q); hidden++) {}
+        if (seen == n || hidden == n) return false;
+    }
+
+    // From the hidden edge to the seen one visibility turns on once, and off once on the way back
+    first = (hidden + detail::visibilityChange(hull, hidden, (seen + n - hidden) % n, q)) % n;
+    last = (seen + detail::visibilityChange(hull, seen, (hidden + n - seen) % n, q)) % n;
+    return true;
+}
+
+} // namespace hull
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Per-connection receive buffer that frames input into lines in place.
+ *
+ * recv() writes straight into writePtr(), and nextLine() hands out string_views
+ * into the buffer, so framing a command costs neither a copy nor an allocation.
+ * Consumed bytes are reclaimed by sliding the unread tail to the front, at most
+ * once per refill instead of once per line.
+ *
+ * Views returned by nextLine() stay valid until the next prepareWrite().
+ */
+class LineBuffer {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 64 * 1024;
+    static constexpr size_t MAX_CAPACITY = 16 * 1024 * 1024;  ///< Longest line we are willing to buffer
+
+    explicit LineBuffer(size_t capacity = DEFAULT_CAPACITY)
+        : data(capacity), head(0), tail(0), scanned(0) {}
+
+    /**
+     * @brief Makes room for the next recv().
+     * @return false if a single unterminated line already fills MAX_CAPACITY.
+     */
+    bool prepareWrite() {
+        if (head == tail) {
+            head = tail = scanned = 0;
+        } else if (head > 0 && writable() < data.size() / 4) {
+            size_t unreadBytes = tail - head;
+            memmove(data.data(), data.data() + head, unreadBytes);
+            scanned -= head;
+            head = 0;
+            tail = unreadBytes;
+        }
+
+        if (writable() == 0) {
+            if (data.size() >= MAX_CAPACITY) return false;
+            data.resize(data.size() * 2);
+        }
+        return true;
+    }
+
+    char* writePtr() { return data.data() + tail; }
+    size_t writable() const { return data.size() - tail; }
+    void commit(size_t bytes) { tail += bytes; }
+
+    /**
+     * @brief Checks for a complete line without consuming it.
+     * The newline position is remembered, so the bytes are scanned only once.
+     */
+    bool hasLine() {
+        if (scanned < head) scanned = head;
+        if (scanned < tail && data[scanned] == '\n') return true;
+
+        const void* newline = memchr(data.data() + scanned, '\n', tail - scanned);
+        if (!newline) {
+            scanned = tail;
+            return false;
+        }
+        scanned = static_cast<const char*>(newline) - data.data();
+        return true;
+    }
+
+    /**
+     * @brief Takes the next complete line, trimmed of surrounding whitespace.
+     * @return false if no complete line is buffered yet. The line may be empty.
+     */
+    bool nextLine(std::string_view& line) {
+        if (!hasLine()) return false;
+
+        line = trim(std::string_view(data.data() + head, scanned - head));
+        head = scanned + 1;
+        if (head == tail) head = tail = scanned = 0;
+        return true;
+    }
+
+    /**
+     * @brief Everything buffered up to and including the last newline.
+     * Lets a batch parser walk many lines in one pass; follow with consume().
+     */
+    std::string_view completeLines() const {
+        std::string_view unread(data.data() + head, tail - head);
+        size_t lastNewline = unread.rfind('\n');
+        return lastNewline == std::string_view::npos ? std::string_view() : unread.substr(0, lastNewline + 1);
+    }
+
+    void consume(size_t bytes) {
+        head += bytes;
+        if (head == tail) head = tail = scanned = 0;
+    }
+
+    size_t size() const { return tail - head; }
+
+    static std::string_view trim(std::string_view text) {
+        const char* whitespace = " \t\r\n";
+        size_t first = text.find_first_not_of(whitespace);
+        if (first == std::string_view::npos) return std::string_view();
+        size_t last = text.find_last_not_of(whitespace);
+        return text.substr(first, last - first + 1);
+    }
+
+private:
+    std::vector<char> data;
+    size_t head;     ///< First unread byte
+    size_t tail;     ///< One past the last received byte
+    size_t scanned;  ///< Bytes in [head, scanned) are known to hold no newline
+};
@@ -0,0 +1,369 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "stats.hpp"
+
+/**
+ * @brief Per-call-site lock contention profiling, compiled in with -DLOCK_PROFILING
+ * (make LOCK_PROFILING=1).
+ *
+ * lockprof::Mutex wraps std::mutex and lockprof::Guard replaces lock_guard.
+ * Both pick up the caller's file and line through __builtin_FILE() and
+ * __builtin_LINE() default arguments, so every lock statement becomes its own
+ * row: acquisitions, how many had to wait, and wait and hold time histograms.
+ * Locks that are not std::mutex (the Proactor's pthread mutex) embed a
+ * Tracker and report acquisitions to it directly.
+ *
+ * Like stats.hpp, each thread records into its own table and report() merges
+ * the tables on read. Without LOCK_PROFILING the wrappers reduce to the plain
+ * mutex and record nothing.
+ */
+namespace lockprof {
+
+#ifdef LOCK_PROFILING
+constexpr bool enabled = true;
+#else
+constexpr bool enabled = false;
+#endif
+
+/**
+ * @brief Power-of-two buckets: coarser than stats::Buckets, but small enough
+ * to keep two per call site in every thread of the thread-per-client servers.
+ * Bucket i holds values in [2^(i-1), 2^i).
+ */
+class Log2Histogram {
+public:
+    static constexpr int COUNT = 48;
+
+    static int indexOf(uint64_t value) { return value == 0 ? 0 : std::min(COUNT - 1, 64 - __builtin_clzll(value)); }
+    static uint64_t highestValueOf(int index) { return index == 0 ? 0 : (1ULL << index) - 1; }
+
+    void record(uint64_t nanos) { buckets[indexOf(nanos)].add(1); }
+    uint64_t bucket(int index) const { return buckets[index].load(); }
+
+private:
+    stats::Counter buckets[COUNT];
+};
+
+// Plain-integer copy of a Log2Histogram, summed across threads
+struct Log2Counts {
+    uint64_t buckets[Log2Histogram::COUNT] = {};
+
+    void add(const Log2Histogram& histogram) {
+        for (int i = 0; i < Log2Histogram::COUNT; i++) buckets[i] += histogram.bucket(i);
+    }
+
+    void add(const Log2Counts& other) {
+        for (int i = 0; i < Log2Histogram::COUNT; i++) buckets[i] += other.buckets[i];
+    }
+
+    // Upper bound of the bucket holding quantile q (0..1), in nanoseconds
+    uint64_t percentile(double q) const {
+        uint64_t count = 0;
+        for (uint64_t n : buckets) count += n;
+        if (count == 0) return 0;
+        uint64_t rank = std::max<uint64_t>(1, (uint64_t)(q * count + 0.5));
+        uint64_t seen = 0;
+        for (int i = 0; i < Log2Histogram::COUNT; i++) {
+            seen += buckets[i];
+            if (seen >= rank) return Log2Histogram::highestValueOf(i);
+        }
+        return Log2Histogram::highestValueOf(Log2Histogram::COUNT - 1);
+    }
+};
+
+// One lock statement; the lock's address tells apart locks sharing a name
+struct SiteKey {
+    const void* lock;
+    const char* file;
+    int line;
+
+    bool operator==(const SiteKey& other) const {
+        return lock == other.lock && line == other.line && strcmp(file, other.file) == 0;
+    }
+};
+
+struct SiteKeyHash {
+    size_t operator()(const SiteKey& key) const {
+        return std::hash<const void*>()(key.lock) ^ (std::hash<std::string_view>()(key.file) * 31) ^ key.line;
+    }
+};
+
+// Counters of one call site in one thread; single writer, like stats::ThreadStats
+struct SiteStats {
+    const char* lockName = "";
+    stats::Counter acquisitions;
+    stats::Counter contended;      ///< Acquisitions that had to wait
+    stats::Counter waitNanos;
+    stats::Counter holdNanos;
+    Log2Histogram wait;
+    Log2Histogram hold;
+};
+
+// Merged totals of one call site
+struct SiteReport {
+    const char* lockName = "";
+    std::string file;
+    int line = 0;
+    uint64_t acquisitions = 0;
+    uint64_t contended = 0;
+    uint64_t waitNanos = 0;
+    uint64_t holdNanos = 0;
+    Log2Counts wait;
+    Log2Counts hold;
+
+    void add(const SiteStats& site) {
+        acquisitions += site.acquisitions.load();
+        contended += site.contended.load();
+        waitNanos += site.waitNanos.load();
+        holdNanos += site.holdNanos.load();
+        wait.add(site.wait);
+        hold.add(site.hold);
+    }
+
+    void add(const SiteReport& other) {
+        acquisitions += other.acquisitions;
+        contended += other.contended;
+        waitNanos += other.waitNanos;
+        holdNanos += other.holdNanos;
+        wait.add(other.wait);
+        hold.add(other.hold);
+    }
+};
+
+/**
+ * @brief The calling thread's sites.
+ *
+ * Only the owning thread inserts, so its lookups need no lock; the table mutex
+ * only keeps an insertion from racing with report() walking the map. Nodes of
+ * an unordered_map never move, so SiteStats pointers stay valid.
+ */
+struct ThreadTable {
+    std::mutex mutex;
+    std::unordered_map<SiteKey, SiteStats, SiteKeyHash> sites;
+
+    SiteStats& site(const void* lock, const char* lockName, const char* file, int line) {
+        SiteKey key{lock, file, line};
+        auto it = sites.find(key);
+        if (it != sites.end()) return it->second;
+
+        std::lock_guard<std::mutex> guard(mutex);
+        SiteStats& created = sites[key];
+        created.lockName = lockName;
+        return created;
+    }
+};
+
+/**
+ * @brief Live thread tables plus totals of exited threads. Never destroyed.
+ */
+struct Registry {
+    std::mutex mutex;
+    std::vector<ThreadTable*> live;
+    std::unordered_map<SiteKey, SiteReport, SiteKeyHash> retired;
+
+    static Registry& instance() {
+        static Registry* registry = new Registry();
+        return *registry;
+    }
+};
+
+// Owns the calling thread's table; folds it into the retired totals at thread exit
+struct ThreadSlot {
+    ThreadTable table;
+
+    ThreadSlot() {
+        Registry& registry = Registry::instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.live.push_back(&table);
+    }
+
+    ~ThreadSlot() {
+        Registry& registry = Registry::instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        for (auto& [key, site] : table.sites) {
+            SiteReport& total = registry.retired[key];
+            total.lockName = site.lockName;
+            total.file = key.file;
+            total.line = key.line;
+            total.add(site);
+        }
+        registry.live.erase(std::find(registry.live.begin(), registry.live.end(), &table));
+    }
+};
+
+inline ThreadTable& localTable() {
+    thread_local ThreadSlot slot;
+    return slot.table;
+}
+
+/**
+ * @brief Profiling state of one lock.
+ *
+ * The thread that just acquired the lock calls acquired() and calls
+ * releasing() right before unlocking. holder and acquiredAt are only touched
+ * while the lock is held, so the lock itself protects them.
+ */
+class Tracker {
+public:
+    explicit Tracker(const char* name) : name(name) {}
+
+    // requestedAt is when the caller started waiting, or 0 if it got the lock at once
+    void acquired(const char* file, int line, uint64_t requestedAt) {
+        if constexpr (enabled) {
+            uint64_t now = stats::nowNanos();
+            uint64_t waited = requestedAt ? now - requestedAt : 0;
+            SiteStats& site = localTable().site(this, name, file, line);
+            site.acquisitions.add(1);
+            if (requestedAt) site.contended.add(1);
+            site.waitNanos.add(waited);
+            site.wait.record(waited);
+            holder = &site;
+            acquiredAt = now;
+        }
+    }
+
+    void releasing() {
+        if constexpr (enabled) {
+            uint64_t held = stats::nowNanos() - acquiredAt;
+            holder->holdNanos.add(held);
+            holder->hold.record(held);
+        }
+    }
+
+private:
+    const char* name;
+    SiteStats* holder = nullptr;
+    uint64_t acquiredAt = 0;
+};
+
+/**
+ * @brief std::mutex that profiles each lock() by call site.
+ * lock() and try_lock() take the caller's location as defaulted arguments.
+ */
+class Mutex {
+public:
+    explicit Mutex(const char* name) : tracker(name) {}
+
+    void lock(const char* file = __builtin_FILE(), int line = __builtin_LINE()) {
+        if constexpr (enabled) {
+            if (mutex.try_lock()) {
+                tracker.acquired(file, line, 0);
+                return;
+            }
+            uint64_t requestedAt = stats::nowNanos();
+            mutex.lock();
+            tracker.acquired(file, line, requestedAt);
+        } else {
+            mutex.lock();
+        }
+    }
+
+    bool try_lock(const char* file = __builtin_FILE(), int line = __builtin_LINE()) {
+        if (!mutex.try_lock()) return false;
+        tracker.acquired(file, line, 0);
+        return true;
+    }
+
+    void unlock() {
+        tracker.releasing();
+        mutex.unlock();
+    }
+
+    Mutex(const Mutex&) = delete;
+    Mutex& operator=(const Mutex&) = delete;
+
+private:
+    std::mutex mutex;
+    Tracker tracker;
+};
+
+/**
+ * @brief lock_guard for lockprof::Mutex that reports the statement it is declared in.
+ */
+class Guard {
+public:
+    explicit Guard(Mutex& mutex, const char* file = __builtin_FILE(), int line = __builtin_LINE())
+        : mutex(mutex) {
+        mutex.lock(file, line);
+    }
+    ~Guard() { mutex.unlock(); }
+    Guard(const Guard&) = delete;
+    Guard& operator=(const Guard&) = delete;
+private:
+    Mutex& mutex;
+};
+
+// Every call site seen so far, longest total wait first
+inline std::vector<SiteReport> report() {
+    std::unordered_map<SiteKey, SiteReport, SiteKeyHash> merged;
+    {
+        Registry& registry = Registry::instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        merged = registry.retired;
+        for (ThreadTable* table : registry.live) {
+            std::lock_guard<std::mutex> tableLock(table->mutex);
+            for (auto& [key, site] : table->sites) {
+                SiteReport& total = merged[key];
+                total.lockName = site.lockName;
+                total.file = key.file;
+                total.line = key.line;
+                total.add(site);
+            }
+        }
+    }
+
+    std::vector<SiteReport> sites;
+    for (auto& [key, site] : merged) sites.push_back(std::move(site));
+    std::sort(sites.begin(), sites.end(), [](const SiteReport& a, const SiteReport& b) {
+        return a.waitNanos != b.waitNanos ? a.waitNanos > b.waitNanos : a.acquisitions > b.acquisitions;
+    });
+    return sites;
+}
+
+// "file.cpp:123" without the directory part
+inline std::string siteName(const SiteReport& site) {
+    size_t slash = site.file.rfind('/');
+    return (slash == std::string::npos ? site.file : site.file.substr(slash + 1)) + ":" + std::to_string(site.line);
+}
+
+/**
+ * @brief LOCKS reply: one "LOCK name site ..." line per call site, then "END".
+ */
+inline std::vector<std::string> formatReport() {
+    std::vector<std::string> lines;
+    if constexpr (!enabled) {
+        lines.push_back("LOCKS disabled: rebuild with make LOCK_PROFILING=1");
+    }
+    auto micros = [](uint64_t nanos) {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1) << nanos / 1000.0;
+        return out.str();
+    };
+
+    for (const SiteReport& site : report()) {
+        lines.push_back("LOCK " + std::string(site.lockName) + " " + siteName(site) +
+                        " acquisitions=" + std::to_string(site.acquisitions) +
+                        " contended=" + std::to_string(site.contended) +
+                        " wait_total_us=" + micros(site.waitNanos) +
+                        " wait_p50_us=" + micros(site.wait.percentile(0.50)) +
+                        " wait_p99_us=" + micros(site.wait.percentile(0.99)) +
+                        " hold_total_us=" + micros(site.holdNanos) +
+                        " hold_p50_us=" + micros(site.hold.percentile(0.50)) +
+                        " hold_p99_us=" + micros(site.hold.percentile(0.99)));
+    }
+    lines.push_back("END");
+    return lines;
+}
+
+} // namespace lockprof
@@ -0,0 +1,307 @@
+#pragma once
+
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <unistd.h>
+
+/**
+ * @brief Asynchronous logging for the servers.
+ *
+ * LOG_ERROR / LOG_WARN / LOG_INFO / LOG_DEBUG take a stream-style expression:
+ *
+ *     LOG_DEBUG("[Client " << fd << "] Command: " << command);
+ *
+ * Levels above LOG_COMPILE_LEVEL compile to nothing. Levels above the runtime
+ * level (CH_LOG_LEVEL=error|warn|info|debug, default info) cost one relaxed
+ * load and never evaluate their arguments. An enabled message is formatted
+ * into a fixed-size record on the caller's stack and then copied into the
+ * calling thread's own ring, so the caller takes no lock and never touches
+ * stdout. A background writer drains
+ * every ring and emits each pass with a single write(). When a ring is full
+ * the message is dropped and counted instead of blocking the caller.
+ */
+
+#define LOG_LEVEL_ERROR 0
+#define LOG_LEVEL_WARN  1
+#define LOG_LEVEL_INFO  2
+#define LOG_LEVEL_DEBUG 3
+
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+// Variadic so that braced arguments such as chlog::Fixed{area, 1} pass through
+#define LOG_AT(level, ...)                                              \
+    do {                                                                \
+        if ((level) <= LOG_COMPILE_LEVEL && chlog::enabled(level)) {    \
+            chlog::LogLine logLine_(level);                             \
+            logLine_ << __VA_ARGS__;                                    \
+        }                                                               \
+    } while (0)
+
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_WARN(...)  LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_INFO(...)  LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+namespace chlog {
+
+constexpr size_t RECORD_SIZE = 256;    ///< Longer messages are truncated
+constexpr size_t RING_RECORDS = 1024;  ///< Per thread; must be a power of two
+constexpr std::chrono::milliseconds DRAIN_INTERVAL(10);
+
+inline int levelFromEnv() {
+    const char* value = std::getenv("CH_LOG_LEVEL");
+    if (!value) return LOG_LEVEL_INFO;
+    std::string_view name(value);
+    if (name == "error") return LOG_LEVEL_ERROR;
+    if (name == "warn")  return LOG_LEVEL_WARN;
+    if (name == "debug") return LOG_LEVEL_DEBUG;
+    return LOG_LEVEL_INFO;
+}
+
+inline std::atomic<int> runtimeLevel(levelFromEnv());
+
+inline bool enabled(int level) {
+    return level <= runtimeLevel.load(std::memory_order_relaxed);
+}
+
+inline void setLevel(int level) {
+    runtimeLevel.store(level, std::memory_order_relaxed);
+}
+
+struct Record {
+    int level;
+    uint32_t length;
+    char text[RECORD_SIZE - 2 * sizeof(uint32_t)];
+};
+
+/**
+ * @brief Single-producer single-consumer ring of records.
+ * The owning thread claims and publishes; only the writer drains.
+ */
+class Ring {
+public:
+    Ring() : records(new Record[RING_RECORDS]) {}
+
+    // Producer side: next free slot, or nullptr if the writer is behind
+    Record* claim() {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == RING_RECORDS) return nullptr;
+        return &records[h & (RING_RECORDS - 1)];
+    }
+
+    void publish() {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Consumer side: hands every published record to sink, oldest first
+    template <typename Sink>
+    void drain(Sink&& sink) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t h = head.load(std::memory_order_acquire);
+        for (; t != h; ++t) sink(records[t & (RING_RECORDS - 1)]);
+        tail.store(t, std::memory_order_release);
+    }
+
+    bool empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_relaxed);
+    }
+
+    std::atomic<bool> retired{false};   ///< Owning thread has exited
+    std::atomic<uint64_t> dropped{0};   ///< Messages lost to a full ring
+
+private:
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+    std::unique_ptr<Record[]> records;
+};
+
+/**
+ * @brief Owns the rings of all threads and the background writer.
+ *
+ * Never destroyed: threads that outlive main() may still log while the
+ * process exits. Pending records are flushed by an atexit() hook instead.
+ */
+class Logger {
+public:
+    static Logger& instance() {
+        static Logger* logger = create();
+        return *logger;
+    }
+
+    void attach(const std::shared_ptr<Ring>& ring) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        rings.push_back(ring);
+    }
+
+    // Writes everything logged so far; safe to call from any thread
+    void flush() {
+        std::lock_guard<std::mutex> lock(drainMutex);
+        drainAll();
+    }
+
+private:
+    Logger() = default;
+
+    static Logger* create() {
+        Logger* logger = new Logger();
+        std::thread([logger] { logger->run(); }).detach();
+        std::atexit([] { instance().flush(); });
+        return logger;
+    }
+
+    void run() {
+        while (true) {
+            std::this_thread::sleep_for(DRAIN_INTERVAL);
+            flush();
+        }
+    }
+
+    void drainAll() {
+        std::vector<std::shared_ptr<Ring>> snapshot;
+        {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            snapshot = rings;
+        }
+
+        uint64_t droppedNow = 0;
+        for (const std::shared_ptr<Ring>& ring : snapshot) {
+            ring->drain([this](const Record& record) {
+                std::string& out = record.level <= LOG_LEVEL_WARN ? errBuffer : outBuffer;
+                out.append(record.text, record.length);
+                out.push_back('\n');
+            });
+            droppedNow += ring->dropped.exchange(0, std::memory_order_relaxed);
+        }
+        if (droppedNow > 0) {
+            errBuffer += "[log] " + std::to_string(droppedNow) + " messages dropped\n";
+        }
+
+        writeAll(STDOUT_FILENO, outBuffer);
+        writeAll(STDERR_FILENO, errBuffer);
+
+        // Forget rings of exited threads once they are empty
+        std::lock_guard<std::mutex> lock(registryMutex);
+        for (size_t i = 0; i < rings.size();) {
+            if (rings[i]->retired.load(std::memory_order_acquire) && rings[i]->empty()) {
+                rings[i] = rings.back();
+                rings.pop_back();
+            } else {
+                i++;
+            }
+        }
+    }
+
+    static void writeAll(int fd, std::string& buffer) {
+        size_t written = 0;
+        while (written < buffer.size()) {
+            ssize_t n = ::write(fd, buffer.data() + written, buffer.size() - written);
+            if (n <= 0) break;
+            written += n;
+        }
+        buffer.clear();
+    }
+
+    std::mutex registryMutex;   ///< Protects rings
+    std::vector<std::shared_ptr<Ring>> rings;
+    std::mutex drainMutex;      ///< Serializes drains and the output buffers
+    std::string outBuffer;
+    std::string errBuffer;
+};
+
+// Registers the calling thread's ring on first use and retires it at thread exit
+struct ThreadRing {
+    std::shared_ptr<Ring> ring;
+    ThreadRing() : ring(std::make_shared<Ring>()) { Logger::instance().attach(ring); }
+    ~ThreadRing() { ring->retired.store(true, std::memory_order_release); }
+};
+
+inline Ring& threadRing() {
+    thread_local ThreadRing holder;
+    return *holder.ring;
+}
+
+inline void flush() {
+    Logger::instance().flush();
+}
+
+/**
+ * @brief Fixed-point manipulator, e.g. chlog::Fixed{area, 1} for "12.5".
+ */
+struct Fixed {
+    double value;
+    int precision;
+};
+
+/**
+ * @brief One message being formatted; it takes its slot in the thread's ring
+ * only when complete, so a LOG reached while formatting another one (from a
+ * stats or trace hook) gets a slot of its own, ahead of the outer message.
+ */
+class LogLine {
+public:
+    explicit LogLine(int level) {
+        record.level = level;
+        record.length = 0;
+    }
+
+    ~LogLine() {
+        Ring& ring = threadRing();
+        Record* slot = ring.claim();
+        if (!slot) {
+            ring.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        slot->level = record.level;
+        slot->length = record.length;
+        memcpy(slot->text, record.text, record.length);
+        ring.publish();
+    }
+
+    LogLine(const LogLine&) = delete;
+    LogLine& operator=(const LogLine&) = delete;
+
+    LogLine& operator<<(std::string_view text) {
+        size_t room = sizeof(record.text) - record.length;
+        size_t n = text.size() < room ? text.size() : room;
+        memcpy(record.text + record.length, text.data(), n);
+        record.length += n;
+        return *this;
+    }
+
+    LogLine& operator<<(const char* text) { return *this << std::string_view(text ? text : "(null)"); }
+    LogLine& operator<<(const std::string& text) { return *this << std::string_view(text); }
+    LogLine& operator<<(char c) { return *this << std::string_view(&c, 1); }
+    LogLine& operator<<(bool value) { return *this << (value ? "true" : "false"); }
+
+    template <typename T, typename = std::enable_if_t<std::is_arithmetic_v<T>>>
+    LogLine& operator<<(T value) {
+        char digits[64];
+        std::to_chars_result result = std::to_chars(digits, digits + sizeof(digits), value);
+        return *this << std::string_view(digits, result.ptr - digits);
+    }
+
+    LogLine& operator<<(Fixed number) {
+        char digits[64];
+        std::to_chars_result result = std::to_chars(digits, digits + sizeof(digits), number.value,
+                                                    std::chars_format::fixed, number.precision);
+        return *this << std::string_view(digits, result.ptr - digits);
+    }
+
+private:
+    Record record;
+};
+
+} // namespace chlog
@@ -0,0 +1,283 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "stats.hpp"
+#include "lock_profiler.hpp"
+
+/**
+ * @brief Prometheus scrape endpoint for the servers.
+ *
+ * When CH_METRICS_PORT is set, a server opens a second listener on
+ * 127.0.0.1:<port> and answers "GET /metrics" over HTTP/1.0 with the counters,
+ * gauges and latency histograms of stats::collect() in Prometheus text
+ * exposition format. A scrape only reads the per-thread statistics and never
+ * touches the graph or its lock. Each server drives the listener from the loop
+ * it already has: the select()/Reactor loops feed ScrapeConnection, the
+ * threaded servers hand the accepted socket to serveScrape() on a thread of
+ * its own. Every wait on a scraper counts against one deadline per connection,
+ * so a scraper that trickles its request a byte at a time gets no longer.
+ */
+namespace metrics {
+
+constexpr size_t MAX_REQUEST_BYTES = 8192;
+constexpr int IO_TIMEOUT_MS = 200;        ///< Longest an event loop spends writing one reply
+constexpr int SCRAPE_TIMEOUT_MS = 1000;   ///< Longest serveScrape() spends on a connection, reading and writing
+
+using Clock = std::chrono::steady_clock;
+
+// Milliseconds left until deadline, for poll(); 0 once it has passed
+inline int remainingMs(Clock::time_point deadline) {
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+    return (int)std::max<decltype(left)>(left, 0);
+}
+
+// Port from CH_METRICS_PORT, or 0 when the endpoint is disabled
+inline int portFromEnv() {
+    const char* value = std::getenv("CH_METRICS_PORT");
+    if (!value) return 0;
+    int port = std::atoi(value);
+    return (port > 0 && port < 65536) ? port : 0;
+}
+
+// Loopback-only listening socket, or -1 on failure
+inline int openListener(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    int option = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &option, sizeof(option));
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(fd, (sockaddr*)&address, sizeof(address)) < 0 || listen(fd, 16) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Renders a snapshot in Prometheus text exposition format (version 0.0.4).
+ *
+ * The latency histograms are re-bucketed onto fixed "le" bounds. An internal
+ * bucket that straddles a bound is counted in the next one up, so a cumulative
+ * count is exact to within the ~6% resolution of stats::Buckets.
+ */
+inline std::string renderPrometheus(const stats::Snapshot& snapshot) {
+    struct Bound {
+        uint64_t nanos;
+        const char* label;
+    };
+    static const Bound bounds[] = {
+        {1000, "1e-06"}, {2500, "2.5e-06"}, {5000, "5e-06"},
+        {10000, "1e-05"}, {25000, "2.5e-05"}, {50000, "5e-05"},
+        {100000, "0.0001"}, {250000, "0.00025"}, {500000, "0.0005"},
+        {1000000, "0.001"}, {2500000, "0.0025"}, {5000000, "0.005"},
+        {10000000, "0.01"}, {25000000, "0.025"}, {50000000, "0.05"},
+        {100000000, "0.1"}, {250000000, "0.25"}, {500000000, "0.5"},
+        {1000000000, "1"}, {2500000000, "2.5"}, {5000000000, "5"}, {10000000000, "10"},
+    };
+
+    std::string out;
+    out.reserve(16 * 1024);
+
+    auto header = [&out](const char* name, const char* type, const char* help) {
+        out += "# HELP "; out += name; out += ' '; out += help; out += '\n';
+        out += "# TYPE "; out += name; out += ' '; out += type; out += '\n';
+    };
+    auto sample = [&out](const char* name, const std::string& labels, const std::string& value) {
+        out += name;
+        if (!labels.empty()) { out += '{'; out += labels; out += '}'; }
+        out += ' '; out += value; out += '\n';
+    };
+    auto seconds = [](uint64_t nanos) {
+        char text[32];
+        snprintf(text, sizeof(text), "%.9g", nanos / 1e9);
+        return std::string(text);
+    };
+
+    header("convex_hull_connections_active", "gauge", "Client connections currently open.");
+    sample("convex_hull_connections_active", "", std::to_string(snapshot.activeConnections));
+    header("convex_hull_graph_points", "gauge", "Points in the shared graph.");
+    sample("convex_hull_graph_points", "", std::to_string(snapshot.graphPoints));
+
+    header("convex_hull_received_bytes_total", "counter", "Bytes read from clients.");
+    sample("convex_hull_received_bytes_total", "", std::to_string(snapshot.bytesIn));
+    header("convex_hull_sent_bytes_total", "counter", "Reply bytes queued to clients.");
+    sample("convex_hull_sent_bytes_total", "", std::to_string(snapshot.bytesOut));
+
+    header("convex_hull_cache_hits_total", "counter", "CH requests answered from the cached area.");
+    sample("convex_hull_cache_hits_total", "", std::to_string(snapshot.hullCacheHits));
+    header("convex_hull_cache_misses_total", "counter", "CH requests that computed the hull.");
+    sample("convex_hull_cache_misses_total", "", std::to_string(snapshot.hullCacheMisses));
+
+    header("convex_hull_lock_acquisitions_total", "counter", "Acquisitions of the graph lock.");
+    sample("convex_hull_lock_acquisitions_total", "", std::to_string(snapshot.lockAcquisitions));
+    header("convex_hull_lock_wait_seconds_total", "counter", "Time spent waiting for the graph lock.");
+    sample("convex_hull_lock_wait_seconds_total", "", seconds(snapshot.lockWaitNanos));
+
+    header("convex_hull_commands_total", "counter", "Commands handled, including bulk point lines.");
+    for (int i = 0; i < stats::CMD_COUNT; i++) {
+        sample("convex_hull_commands_total",
+               std::string("command=\"") + stats::commandName(i) + "\"",
+               std::to_string(snapshot.commands[i]));
+    }
+
+    header("convex_hull_command_duration_seconds", "histogram", "Time to handle one command.");
+    for (int i = 0; i < stats::CMD_COUNT; i++) {
+        const stats::HistogramCounts& latency = snapshot.latency[i];
+        std::string command = std::string("command=\"") + stats::commandName(i) + "\"";
+
+        uint64_t cumulative = 0;
+        size_t bucket = 0;
+        for (const Bound& bound : bounds) {
+            while (bucket < stats::Buckets::COUNT &&
+                   stats::Buckets::highestValueOf(bucket) <= bound.nanos) {
+                cumulative += latency.buckets[bucket++];
+            }
+            sample("convex_hull_command_duration_seconds_bucket",
+                   command + ",le=\"" + bound.label + "\"", std::to_string(cumulative));
+        }
+        uint64_t count = latency.total();
+        sample("convex_hull_command_duration_seconds_bucket", command + ",le=\"+Inf\"", std::to_string(count));
+        sample("convex_hull_command_duration_seconds_sum", command, seconds(snapshot.latencyNanos[i]));
+        sample("convex_hull_command_duration_seconds_count", command, std::to_string(count));
+    }
+
+    if constexpr (lockprof::enabled) {
+        std::vector<lockprof::SiteReport> sites = lockprof::report();
+        auto labels = [](const lockprof::SiteReport& site) {
+            return std::string("lock=\"") + site.lockName + "\",site=\"" + lockprof::siteName(site) + "\"";
+        };
+        header("convex_hull_lock_site_acquisitions_total", "counter", "Lock acquisitions per call site.");
+        for (const auto& site : sites) sample("convex_hull_lock_site_acquisitions_total", labels(site), std::to_string(site.acquisitions));
+        header("convex_hull_lock_site_contended_total", "counter", "Acquisitions per call site that had to wait.");
+        for (const auto& site : sites) sample("convex_hull_lock_site_contended_total", labels(site), std::to_string(site.contended));
+        header("convex_hull_lock_site_wait_seconds_total", "counter", "Time spent waiting per call site.");
+        for (const auto& site : sites) sample("convex_hull_lock_site_wait_seconds_total", labels(site), seconds(site.waitNanos));
+        header("convex_hull_lock_site_hold_seconds_total", "counter", "Time the lock was held per call site.");
+        for (const auto& site : sites) sample("convex_hull_lock_site_hold_seconds_total", labels(site), seconds(site.holdNanos));
+    }
+    return out;
+}
+
+// Full HTTP/1.0 reply to a complete request head
+inline std::string buildResponse(std::string_view request) {
+    std::string_view line = request.substr(0, request.find_first_of("\r\n"));
+    std::string_view method = line.substr(0, line.find(' '));
+    std::string_view target;
+    if (method.size() < line.size()) {
+        target = line.substr(method.size() + 1);
+        target = target.substr(0, target.find(' '));
+    }
+
+    std::string status = "200 OK";
+    std::string contentType = "text/plain; version=0.0.4; charset=utf-8";
+    std::string body;
+    if (method != "GET") {
+        status = "405 Method Not Allowed";
+        contentType = "text/plain; charset=utf-8";
+        body = "Only GET is supported\n";
+    } else if (target != "/metrics" && target != "/") {
+        status = "404 Not Found";
+        contentType = "text/plain; charset=utf-8";
+        body = "Try /metrics\n";
+    } else {
+        body = renderPrometheus(stats::collect());
+    }
+
+    return "HTTP/1.0 " + status + "\r\n"
+           "Content-Type: " + contentType + "\r\n"
+           "Content-Length: " + std::to_string(body.size()) + "\r\n"
+           "Connection: close\r\n"
+           "\r\n" + body;
+}
+
+// True once the blank line ending the request head has arrived
+inline bool requestComplete(std::string_view request) {
+    return request.find("\r\n\r\n") != std::string_view::npos ||
+           request.find("\n\n") != std::string_view::npos;
+}
+
+// Writes all of data, waiting for room while the socket is full until deadline
+inline bool sendAll(int fd, std::string_view data, Clock::time_point deadline) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t written = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (written >= 0) {
+            sent += written;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            pollfd waitFd = {fd, POLLOUT, 0};
+            int timeout = remainingMs(deadline);
+            if (timeout == 0 || poll(&waitFd, 1, timeout) <= 0) return false;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief One scrape driven by an event loop.
+ *
+ * Call onReadable() each time the socket is readable. Once it returns true the
+ * reply has been written (or the peer went away, sent garbage or ran out of
+ * time) and the caller removes and closes the socket. Writing the reply may
+ * wait until writeDeadline, IO_TIMEOUT_MS from the call by default.
+ */
+class ScrapeConnection {
+public:
+    bool onReadable(int fd, Clock::time_point writeDeadline = Clock::now() + std::chrono::milliseconds(IO_TIMEOUT_MS)) {
+        char chunk[1024];
+        ssize_t received = recv(fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+        if (received < 0) return errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR;
+        if (received == 0) return true;
+
+        request.append(chunk, received);
+        if (request.size() > MAX_REQUEST_BYTES) return true;
+        if (!requestComplete(request)) return false;
+
+        sendAll(fd, buildResponse(request), writeDeadline);
+        return true;
+    }
+
+private:
+    std::string request;
+};
+
+/**
+ * @brief Serves one scrape on a connection owned by the calling thread, giving
+ * up SCRAPE_TIMEOUT_MS after the call however the scraper paces itself.
+ * Does not close the socket.
+ */
+inline void serveScrape(int fd) {
+    Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(SCRAPE_TIMEOUT_MS);
+    ScrapeConnection connection;
+    while (true) {
+        pollfd waitFd = {fd, POLLIN, 0};
+        int timeout = remainingMs(deadline);
+        if (timeout == 0 || poll(&waitFd, 1, timeout) <= 0) return;
+        if (connection.onReadable(fd, deadline)) return;
+    }
+}
+
+} // namespace metrics
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+#include "convex_hull.hpp"
+
+/**
+ * @brief Seeded synthetic point sets for the benchmarks and tools/gen_points.
+ *
+ * A Generator produces one point per next() call from a fixed amount of
+ * state, so a caller can stream any number of points without holding them.
+ * The same name, count and seed always give the same points.
+ *
+ *     uniform-square   uniform in [-range, range]^2
+ *     uniform-disk     uniform in the disk of radius range
+ *     on-circle        on the circle of radius range: every point is a hull vertex
+ *     gaussian         normal around the origin, sigma range/10
+ *     clustered        16 tight clusters at random centers
+ *     collinear-heavy  90% on the edges and diagonal of an integer square, many duplicates
+ *     hull-fraction    exactly round(n * hullFraction) hull vertices evenly spaced on
+ *                      a circle, the rest strictly inside their polygon
+ */
+namespace pointgen {
+
+using hull::Point;
+
+inline const std::vector<std::string>& names() {
+    static const std::vector<std::string> all = {
+        "uniform-square", "uniform-disk", "on-circle", "gaussian", "clustered", "collinear-heavy", "hull-fraction"
+    };
+    return all;
+}
+
+inline bool known(const std::string& name) {
+    return std::find(names().begin(), names().end(), name) != names().end();
+}
+
+struct Params {
+    double range = 10000.0;
+    double hullFraction = 0.01;   ///< hull-fraction only
+};
+
+class Generator {
+public:
+    Generator(const std::string& name, uint64_t count, uint64_t seed, const Params& params = Params())
+        : kind((Kind)(std::find(names().begin(), names().end(), name) - names().begin())),
+          count(count), params(params), rng(seed) {
+        if (kind == CLUSTERED) {
+            std::uniform_real_distribution<double> center(-params.range, params.range);
+            for (Point& c : centers) c = Point(center(rng), center(rng));
+        } else if (kind == HULL_FRACTION) {
+            double fraction = std::min(1.0, std::max(0.0, params.hullFraction));
+            hullCount = std::max<uint64_t>(3, (uint64_t)std::llround(count * fraction));
+            hullCount = std::min(hullCount, count);
+            // Interior points stay inside the circle inscribed in the hull polygon
+            innerRadius = params.range * std::cos(M_PI / hullCount) * (1 - 1e-9);
+        }
+    }
+
+    Point next() {
+        uint64_t i = index++;
+        const double range = params.range;
+
+        switch (kind) {
+            case UNIFORM_SQUARE: {
+                std::uniform_real_distribution<double> coord(-range, range);
+                double x = coord(rng);
+                return Point(x, coord(rng));
+            }
+            case UNIFORM_DISK:
+                return inDisk(range);
+            case ON_CIRCLE: {
+                double angle = 2 * M_PI * unit(rng);
+                return Point(range * std::cos(angle), range * std::sin(angle));
+            }
+            case GAUSSIAN: {
+                std::normal_distribution<double> coord(0.0, range / 10);
+                double x = coord(rng);
+                return Point(x, coord(rng));
+            }
+            case CLUSTERED: {
+                std::normal_distribution<double> offset(0.0, range / 50);
+                const Point& c = centers[i % 16];
+                double x = c.x + offset(rng);
+                return Point(x, c.y + offset(rng));
+            }
+            case COLLINEAR_HEAVY:
+                return collinear();
+            default:
+                break;
+        }
+
+        // hull-fraction: vertex j goes at index floor(j * count / hullCount), spreading them through the stream
+        if (nextVertex < hullCount && i >= nextVertex * count / hullCount) {
+            double angle = 2 * M_PI * nextVertex++ / hullCount;
+            return Point(range * std::cos(angle), range * std::sin(angle));
+        }
+        return inDisk(innerRadius);
+    }
+
+    uint64_t size() const { return count; }
+
+private:
+    // Same order as names()
+    enum Kind { UNIFORM_SQUARE, UNIFORM_DISK, ON_CIRCLE, GAUSSIAN, CLUSTERED, COLLINEAR_HEAVY, HULL_FRACTION };
+
+    Point inDisk(double radius) {
+        double r = radius * std::sqrt(unit(rng));
+        double angle = 2 * M_PI * unit(rng);
+        return Point(r * std::cos(angle), r * std::sin(angle));
+    }
+
+    // Edges of the square [-1000, 1000]^2 and its diagonal, integer coordinates, 10% inside
+    Point collinear() {
+        std::uniform_int_distribution<int> along(-1000, 1000);
+        std::uniform_int_distribution<int> line(0, 4);
+        std::uniform_int_distribution<int> percent(0, 99);
+        if (percent(rng) >= 90) {
+            std::uniform_real_distribution<double> inside(-999.0, 999.0);
+            double x = inside(rng);
+            return Point(x, inside(rng));
+        }
+        double t = along(rng);
+        switch (line(rng)) {
+            case 0: return Point(t, -1000);
+            case 1: return Point(t, 1000);
+            case 2: return Point(-1000, t);
+            case 3: return Point(1000, t);
+            default: return Point(t, t);
+        }
+    }
+
+    Kind kind;
+    uint64_t count;
+    Params params;
+    std::mt19937_64 rng;
+    std::uniform_real_distribution<double> unit{0.0, 1.0};
+    uint64_t index = 0;
+    Point centers[16];
+    uint64_t hullCount = 0;
+    uint64_t nextVertex = 0;
+    double innerRadius = 0;
+};
+
+inline std::vector<Point> generate(const std::string& name, uint64_t count, uint64_t seed,
+                                   const Params& params = Params()) {
+    Generator generator(name, count, seed, params);
+    std::vector<Point> points;
+    points.reserve(count);
+    for (uint64_t i = 0; i < count; i++) points.push_back(generator.next());
+    return points;
+}
+
+} // namespace pointgen
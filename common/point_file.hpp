@@ -0,0 +1,248 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief Binary point files.
+ *
+ * A 64-byte header followed by count (x, y) pairs, little-endian, packed:
+ *
+ *     offset  size  field
+ *          0     8  magic "CHPOINTS"
+ *          8     4  version (1)
+ *         12     4  coordinate type: 1 = float64, 2 = float32
+ *         16     8  count
+ *         24    32  bounds: minX, minY, maxX, maxY as float64
+ *         56     8  log sequence number a server snapshot covers (common/wal.hpp), else 0
+ *
+ * The header size keeps the coordinates 8-byte aligned, so a mapped file can
+ * be read in place as an array of pairs. tools/gen_points writes these files
+ * and tools/points_to_binary converts the text input format.
+ */
+namespace pointfile {
+
+constexpr char MAGIC[8] = {'C', 'H', 'P', 'O', 'I', 'N', 'T', 'S'};
+constexpr uint32_t VERSION = 1;
+
+enum CoordType : uint32_t {
+    COORD_FLOAT64 = 1,
+    COORD_FLOAT32 = 2
+};
+
+inline size_t coordSize(uint32_t type) {
+    return type == COORD_FLOAT64 ? 8 : type == COORD_FLOAT32 ? 4 : 0;
+}
+
+inline const char* coordTypeName(uint32_t type) {
+    return type == COORD_FLOAT64 ? "float64" : type == COORD_FLOAT32 ? "float32" : "unknown";
+}
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t coordType;
+    uint64_t count;
+    double minX, minY, maxX, maxY;
+    uint64_t lsn;
+};
+static_assert(sizeof(Header) == 64, "point file header must stay 64 bytes");
+
+// Empty string if the header is valid for a file of fileSize bytes, else what is wrong
+inline std::string checkHeader(const Header& header, uint64_t fileSize) {
+    if (fileSize < sizeof(Header) || memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+        return "not a binary point file";
+    }
+    if (header.version != VERSION) return "unsupported point file version " + std::to_string(header.version);
+    size_t size = coordSize(header.coordType);
+    if (size == 0) return "unknown coordinate type " + std::to_string(header.coordType);
+    if (header.count > (fileSize - sizeof(Header)) / (2 * size)) {
+        return "truncated: header says " + std::to_string(header.count) + " points";
+    }
+    return "";
+}
+
+/**
+ * @brief Streams points into a binary point file.
+ *
+ * Points are buffered and written sequentially; close() rewrites the header
+ * with the final count and bounds, so the output must be a regular file.
+ */
+class Writer {
+public:
+    Writer(const std::string& path, uint32_t coordType)
+        : file(fopen(path.c_str(), "wb")), coordType(coordType) {
+        header = Header();
+        memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.coordType = coordType;
+        header.minX = header.minY = std::numeric_limits<double>::infinity();
+        header.maxX = header.maxY = -std::numeric_limits<double>::infinity();
+        buffer.reserve(BUFFER_BYTES);
+        if (file) fwrite(&header, sizeof(header), 1, file);
+    }
+
+    ~Writer() { close(); }
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    bool ok() const { return file != nullptr && !failed; }
+
+    void add(double x, double y) {
+        if (!file) return;
+        if (coordType == COORD_FLOAT32) {
+            // Bounds describe the stored values
+            x = (float)x;
+            y = (float)y;
+            float pair[2] = {(float)x, (float)y};
+            append(pair, sizeof(pair));
+        } else {
+            double pair[2] = {x, y};
+            append(pair, sizeof(pair));
+        }
+        header.minX = std::min(header.minX, x);
+        header.minY = std::min(header.minY, y);
+        header.maxX = std::max(header.maxX, x);
+        header.maxY = std::max(header.maxY, y);
+        header.count++;
+    }
+
+    // Writes out the buffer and the final header; false on any write error
+    bool close() {
+        if (!file) return false;
+        flushBuffer();
+        if (header.count == 0) header.minX = header.minY = header.maxX = header.maxY = 0;
+        if (fseek(file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, file) != 1) failed = true;
+        if (fclose(file) != 0) failed = true;
+        file = nullptr;
+        return !failed;
+    }
+
+private:
+    static constexpr size_t BUFFER_BYTES = 1 << 20;
+
+    void append(const void* data, size_t size) {
+        if (buffer.size() + size > BUFFER_BYTES) flushBuffer();
+        buffer.insert(buffer.end(), (const char*)data, (const char*)data + size);
+    }
+
+    void flushBuffer() {
+        if (!buffer.empty() && fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size()) failed = true;
+        buffer.clear();
+    }
+
+    FILE* file;
+    uint32_t coordType;
+    Header header;
+    std::vector<char> buffer;
+    bool failed = false;
+};
+
+// True if path starts with the point file magic
+inline bool isPointFile(const std::string& path) {
+    char magic[sizeof(MAGIC)];
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+    bool matches = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+    fclose(file);
+    return matches;
+}
+
+/**
+ * @brief A binary point file mapped into memory.
+ *
+ * The mapping is private and writable: the calculators sort the coordinates
+ * in place, and the kernel copies only the pages that are actually written,
+ * without ever touching the file. Nothing is read or parsed up front.
+ */
+class Mapping {
+public:
+    Mapping() = default;
+    ~Mapping() {
+        if (base) munmap(base, length);
+    }
+
+    Mapping(const Mapping&) = delete;
+    Mapping& operator=(const Mapping&) = delete;
+
+    // Maps path and validates its header; on failure returns false and sets error
+    bool open(const std::string& path, std::string& error) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            error = path + ": " + strerror(errno);
+            return false;
+        }
+        bool opened = open(fd, path, error);
+        ::close(fd);
+        return opened;
+    }
+
+    // Same for an open descriptor, which stays open; path only names it in error
+    bool open(int fd, const std::string& path, std::string& error) {
+        struct stat info;
+        if (fstat(fd, &info) < 0 || info.st_size < (off_t)sizeof(Header)) {
+            error = path + ": not a binary point file";
+            return false;
+        }
+        length = info.st_size;
+        void* mapped = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            error = path + ": mmap failed: " + strerror(errno);
+            return false;
+        }
+        base = mapped;
+
+        error = checkHeader(header(), length);
+        if (!error.empty()) {
+            error = path + ": " + error;
+            return false;
+        }
+        return true;
+    }
+
+    const Header& header() const { return *static_cast<const Header*>(base); }
+    uint64_t size() const { return header().count; }
+    uint32_t coordType() const { return header().coordType; }
+
+    // Interleaved x, y coordinates; only valid for the file's coordinate type
+    double* float64Coords() { return reinterpret_cast<double*>(static_cast<char*>(base) + sizeof(Header)); }
+    float* float32Coords() { return reinterpret_cast<float*>(static_cast<char*>(base) + sizeof(Header)); }
+
+    // Tells the kernel the points are about to be read front to back
+    void adviseSequential() {
+        if (base) madvise(base, length, MADV_SEQUENTIAL);
+    }
+
+    /**
+     * @brief Appends every point to a container with push_back(PointT(x, y)),
+     * converting float32 files; for containers that cannot use the mapping in place.
+     */
+    template <typename PointT, typename Container>
+    void appendTo(Container& points) {
+        uint64_t count = size();
+        if (coordType() == COORD_FLOAT64) {
+            const double* coords = float64Coords();
+            for (uint64_t i = 0; i < count; i++) points.push_back(PointT(coords[2 * i], coords[2 * i + 1]));
+        } else {
+            const float* coords = float32Coords();
+            for (uint64_t i = 0; i < count; i++) points.push_back(PointT(coords[2 * i], coords[2 * i + 1]));
+        }
+    }
+
+private:
+    void* base = nullptr;
+    size_t length = 0;
+};
+
+} // namespace pointfile
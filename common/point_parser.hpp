@@ -0,0 +1,122 @@
+#pragma once
+
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+/**
+ * @brief Allocation-free parsing of "x,y" coordinate pairs.
+ *
+ * Works directly on string_views into the receive buffer: whitespace is
+ * skipped in place, numbers go through std::from_chars, and malformed input
+ * is reported through ParseStatus instead of an exception, so a bad line
+ * costs no more than a good one.
+ */
+enum class ParseStatus {
+    Ok,
+    MissingComma,
+    EmptyCoordinate,
+    InvalidNumber
+};
+
+inline const char* parseStatusMessage(ParseStatus status) {
+    switch (status) {
+        case ParseStatus::Ok:              return "ok";
+        case ParseStatus::MissingComma:    return "missing comma";
+        case ParseStatus::EmptyCoordinate: return "empty coordinate";
+        case ParseStatus::InvalidNumber:   return "invalid number";
+    }
+    return "unknown error";
+}
+
+// Error text as sent to clients, e.g. "Invalid point format: missing comma"
+inline std::string parseErrorMessage(ParseStatus status) {
+    return std::string("Invalid point format: ") + parseStatusMessage(status);
+}
+
+inline const char* skipBlanks(const char* p, const char* end) {
+    while (p != end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+    return p;
+}
+
+/**
+ * @brief Parses one coordinate occupying all of [begin, end), blanks allowed around it.
+ */
+inline ParseStatus parseCoordinate(const char* begin, const char* end, double& value) {
+    const char* p = skipBlanks(begin, end);
+    if (p == end) return ParseStatus::EmptyCoordinate;
+    // from_chars rejects an explicit plus sign; skip it only before a digit or '.' so "+-5" stays invalid
+    if (*p == '+' && p + 1 != end && ((p[1] >= '0' && p[1] <= '9') || p[1] == '.')) ++p;
+
+    std::from_chars_result result = std::from_chars(p, end, value);
+    // from_chars also accepts "nan" and "inf", which no hull can use
+    if (result.ec != std::errc() || !std::isfinite(value)) return ParseStatus::InvalidNumber;
+    return skipBlanks(result.ptr, end) == end ? ParseStatus::Ok : ParseStatus::InvalidNumber;
+}
+
+/**
+ * @brief Parses "x,y" into x and y.
+ * @return ParseStatus::Ok on success; x and y are unspecified otherwise.
+ */
+inline ParseStatus parsePoint(std::string_view text, double& x, double& y) {
+    const char* begin = text.data();
+    const char* end = begin + text.size();
+    const char* comma = static_cast<const char*>(memchr(begin, ',', text.size()));
+    if (!comma) return ParseStatus::MissingComma;
+
+    ParseStatus status = parseCoordinate(begin, comma, x);
+    if (status != ParseStatus::Ok) return status;
+    return parseCoordinate(comma + 1, end, y);
+}
+
+/**
+ * @brief A rejected line from parsePointLines, numbered from 1 within the batch.
+ */
+struct LineError {
+    size_t line;
+    ParseStatus status;
+};
+
+/**
+ * @brief Parses a whole buffer of newline-terminated "x,y" lines in one pass.
+ *
+ * Stops after maxLines non-blank lines or at the last complete line; blank
+ * lines are skipped. Malformed lines count towards maxLines and are reported
+ * in errors. Valid points are appended with points.emplace_back(x, y).
+ *
+ * @param linesParsed  Receives the number of non-blank lines taken.
+ * @return Number of bytes consumed from buffer.
+ */
+template <typename PointT>
+size_t parsePointLines(std::string_view buffer, size_t maxLines, std::vector<PointT>& points,
+                       std::vector<LineError>& errors, size_t& linesParsed) {
+    const char* begin = buffer.data();
+    const char* end = begin + buffer.size();
+    const char* p = begin;
+    linesParsed = 0;
+
+    while (linesParsed < maxLines && p != end) {
+        const char* newline = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!newline) break;
+
+        const char* lineEnd = newline;
+        const char* lineBegin = skipBlanks(p, lineEnd);
+        p = newline + 1;
+        if (lineBegin == lineEnd) continue;
+
+        linesParsed++;
+        double x, y;
+        ParseStatus status = parsePoint(std::string_view(lineBegin, lineEnd - lineBegin), x, y);
+        if (status == ParseStatus::Ok) {
+            points.emplace_back(x, y);
+        } else {
+            errors.push_back(LineError{linesParsed, status});
+        }
+    }
+    return p - begin;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+/**
+ * @brief Per-connection output buffer that coalesces replies.
+ *
+ * Replies produced while handling one read batch are appended here and leave
+ * in a single sendmsg() when the batch is flushed, instead of one send() and
+ * one small TCP segment per reply. A batch that grows past FLUSH_THRESHOLD is
+ * flushed early with MSG_MORE, so the kernel keeps packing full segments
+ * until the final flush of the batch. If that early flush took everything,
+ * the final flush has nothing left to send and pushes the held tail out by
+ * toggling TCP_CORK instead; otherwise it would wait for the kernel's ~200 ms
+ * cork timer.
+ *
+ * flush() never waits for a full socket. On a non-blocking socket whatever
+ * the kernel does not take stays queued, and pending() stays non-zero: the
+ * event loop then watches the socket for writability and calls flush() again.
+ * A client that lets more than MAX_BACKLOG pile up is not reading, and
+ * append() and flush() report it like a failed send so the server drops it.
+ */
+class ResponseBuffer {
+public:
+    static constexpr size_t FLUSH_THRESHOLD = 64 * 1024;
+    static constexpr size_t MAX_BACKLOG = 16 * 1024 * 1024;
+
+    explicit ResponseBuffer(int fd = -1) : fd(fd) {}
+
+    int socket() const { return fd; }
+    size_t pending() const { return data.size() - head; }
+
+    /**
+     * @brief Queues msg followed by a newline.
+     * @return false if an early flush was needed and failed, or the client is not reading.
+     */
+    bool append(std::string_view msg) {
+        data.append(msg.data(), msg.size());
+        data.push_back('\n');
+        if (pending() < FLUSH_THRESHOLD) return true;
+        if (full) return pending() < MAX_BACKLOG;   // The socket is still full; wait for writability
+        return flush(true);
+    }
+
+    /**
+     * @brief Writes as much of the queue as the socket takes without blocking.
+     * @param more  true while the batch is still being produced (sets MSG_MORE).
+     * @return false if the peer is gone or more than MAX_BACKLOG is left unsent;
+     * otherwise true, with pending() > 0 if the socket filled up.
+     */
+    bool flush(bool more = false) {
+        full = false;
+        if (pending() == 0) {
+            if (!more && corked) uncork();
+            return true;
+        }
+
+        size_t start = head;
+        int flags = MSG_NOSIGNAL | (more ? MSG_MORE : 0);
+        while (head < data.size()) {
+            iovec iov;
+            iov.iov_base = &data[head];
+            iov.iov_len = data.size() - head;
+
+            msghdr message = {};
+            message.msg_iov = &iov;
+            message.msg_iovlen = 1;
+
+            ssize_t written = sendmsg(fd, &message, flags);
+            if (written >= 0) {
+                head += written;
+            } else if (errno == EINTR) {
+                continue;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                full = true;
+                break;
+            } else {
+                data.clear();
+                head = 0;
+                return false;
+            }
+        }
+        corked = more && head > start;
+
+        if (head == data.size()) {
+            data.clear();
+            head = 0;
+        } else if (head >= FLUSH_THRESHOLD && head * 2 >= data.size()) {
+            data.erase(0, head);   // Keep the unsent tail from drifting to the end of a growing string
+            head = 0;
+        }
+        return pending() < MAX_BACKLOG;
+    }
+
+private:
+    // A zero-length send does not push on Linux; switching TCP_CORK off does
+    void uncork() {
+        int on = 1, off = 0;
+        setsockopt(fd, IPPROTO_TCP, TCP_CORK, &on, sizeof(on));
+        setsockopt(fd, IPPROTO_TCP, TCP_CORK, &off, sizeof(off));
+        corked = false;
+    }
+
+    int fd;
+    std::string data;
+    size_t head = 0;       ///< data[0, head) is already sent
+    bool full = false;     ///< The last flush stopped at a full socket
+    bool corked = false;   ///< The last send was MSG_MORE, so the kernel may still hold its tail
+};
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include "convex_hull.hpp"
+
+namespace hull {
+
+namespace detail {
+
+// Vertices of a hull from monotoneChain in sortPoints() order: the lower chain merged with the upper one read backwards
+template <typename P>
+inline void appendSortedVertices(const std::vector<P>& hull, std::vector<P>& out) {
+    if (hull.empty()) return;
+    size_t last = 0;
+    for (size_t i = 1; i < hull.size(); i++) {
+        if (lexicographicLess(hull[last], hull[i])) last = i;
+    }
+    size_t begin = out.size();
+    out.insert(out.end(), hull.begin(), hull.begin() + last + 1);
+    size_t middle = out.size();
+    out.insert(out.end(), hull.rbegin(), hull.rend() - last - 1);
+    std::inplace_merge(out.begin() + begin, out.begin() + middle, out.end(), lexicographicLess<P>);
+}
+
+} // namespace detail
+
+/**
+ * @brief Replaces merged with the hull of two hulls, in time linear in their sizes:
+ * each is read back in sorted order, the two merged, and one chain built over them.
+ * scratch only saves the allocation between calls.
+ */
+template <typename P>
+inline void mergeHulls(const std::vector<P>& a, const std::vector<P>& b, std::vector<P>& merged, std::vector<P>& scratch) {
+    scratch.clear();
+    detail::appendSortedVertices(a, scratch);
+    size_t middle = scratch.size();
+    detail::appendSortedVertices(b, scratch);
+    std::inplace_merge(scratch.begin(), scratch.begin() + middle, scratch.end(), lexicographicLess<P>);
+    monotoneChainSorted(scratch.begin(), scratch.end(), merged);
+}
+
+/**
+ * @brief Hull of the newest points of a stream: at most maxPoints of them, none
+ * older than maxAge (0 turns a limit off). Points arrive newest last and leave
+ * oldest first, so the window is a queue, kept as two stacks:
+ *
+ *   back   arrivals since the last flip, with the hull of all of them
+ *   front  older points, oldest on top, cut into blocks of about sqrt(n)
+ *
+ * Dropping the oldest point pops the front. When the front is empty the back is
+ * moved over in one pass and the hull of each of its blocks is built. Only the
+ * top block, the one being popped, keeps a hull per entry: of that entry and
+ * the block's points after it. When a block empties, the next one down gets
+ * its entry hulls, and the hull of the blocks below it is rebuilt from their
+ * block hulls. An update merges three hulls, so it costs amortized
+ * O(h + sqrt(n)) for a window of n points and hulls of h vertices; area() and
+ * hull() just return the result.
+ *
+ * No hull holds more points than its block or the blocks below the top, so
+ * memory stays O(n) even when every point is a vertex (points on a circle).
+ * A flip sorts the front block by block, O(n log n) at worst once per n pops.
+ * Not synchronized.
+ */
+template <typename P>
+class SlidingHull {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    SlidingHull(size_t maxPoints, Clock::duration maxAge) : pointLimit(maxPoints), ageLimit(maxAge) {}
+
+    // Add the newest point; the oldest ones drop out if the window is full
+    void push(const P& p, Clock::time_point arrival) {
+        back.push_back({p, arrival});
+        scratchHull.assign(1, p);
+        mergeHulls(backHull, scratchHull, mergedHull, scratch);
+        backHull.swap(mergedHull);
+        while (pointLimit > 0 && size() > pointLimit) popOldest();
+        dropExpired(arrival);
+        update();
+    }
+
+    // Drop the points older than maxAge at now; false if there were none
+    bool expire(Clock::time_point now) {
+        if (!dropExpired(now)) return false;
+        update();
+        return true;
+    }
+
+    void clear() {
+        back.clear();
+        backHull.clear();
+        front.clear();
+        blockHulls.clear();
+        topHulls.clear();
+        restHull.clear();
+        frontHull.clear();
+        current.clear();
+        currentArea = 0;
+    }
+
+    size_t size() const { return back.size() + front.size(); }
+    size_t maxPoints() const { return pointLimit; }
+    Clock::duration maxAge() const { return ageLimit; }
+
+    const std::vector<P>& hull() const { return current; }
+
+    // When the oldest point ages out; never without an age limit
+    Clock::time_point nextExpiry() {
+        if (ageLimit == Clock::duration::zero() || size() == 0) return Clock::time_point::max();
+        return oldest().arrival + ageLimit;
+    }
+    double area() const { return currentArea; }
+
+    // The points in the window, oldest first
+    std::vector<P> points() const {
+        std::vector<P> all;
+        all.reserve(size());
+        for (auto it = front.rbegin(); it != front.rend(); ++it) all.push_back(it->point);
+        for (const Entry& entry : back) all.push_back(entry.point);
+        return all;
+    }
+
+private:
+    struct Entry {
+        P point;
+        Clock::time_point arrival;
+    };
+
+    bool dropExpired(Clock::time_point now) {
+        if (ageLimit == Clock::duration::zero()) return false;
+        bool dropped = false;
+        while (size() > 0 && now - oldest().arrival > ageLimit) {
+            popOldest();
+            dropped = true;
+        }
+        return dropped;
+    }
+
+    const Entry& oldest() {
+        if (front.empty()) flip();
+        return front.back();
+    }
+
+    void popOldest() {
+        if (front.empty()) flip();
+        front.pop_back();
+        topHulls.pop_back();
+        if (topHulls.empty() && !front.empty()) enterTopBlock();
+        refreshFront();
+    }
+
+    // Move the back onto the front, newest first, so the oldest ends on top
+    void flip() {
+        front.assign(back.rbegin(), back.rend());
+        back.clear();
+        backHull.clear();
+        blockSize = std::max<size_t>(MIN_BLOCK, size_t(std::sqrt(double(front.size()))));
+
+        // The top block gets its entry hulls instead
+        size_t blocks = front.empty() ? 0 : (front.size() - 1) / blockSize;
+        blockHulls.resize(blocks);
+        for (size_t block = 0; block < blocks; block++) {
+            scratch.clear();
+            for (size_t i = block * blockSize; i < (block + 1) * blockSize; i++) scratch.push_back(front[i].point);
+            sortPoints(scratch.begin(), scratch.end());
+            monotoneChainSorted(scratch.begin(), scratch.end(), blockHulls[block]);
+        }
+        if (!front.empty()) enterTopBlock();
+        refreshFront();
+    }
+
+    // The block holding the oldest point is on top: build its entry hulls and the hull of the blocks below it
+    void enterTopBlock() {
+        size_t block = (front.size() - 1) / blockSize;
+        blockHulls.resize(block);
+        restHull.clear();
+        for (const std::vector<P>& blockHull : blockHulls) {
+            mergeHulls(restHull, blockHull, mergedHull, scratch);
+            restHull.swap(mergedHull);
+        }
+        topHulls.resize(front.size() - block * blockSize);
+        for (size_t i = 0; i < topHulls.size(); i++) {
+            scratchHull.assign(1, front[block * blockSize + i].point);
+            if (i == 0) topHulls[i] = scratchHull;
+            else mergeHulls(topHulls[i - 1], scratchHull, topHulls[i], scratch);
+        }
+    }
+
+    void refreshFront() {
+        if (front.empty()) frontHull.clear();
+        else mergeHulls(topHulls.back(), restHull, frontHull, scratch);
+    }
+
+    void update() {
+        if (front.empty()) current = backHull;
+        else mergeHulls(frontHull, backHull, current, scratch);
+        currentArea = polygonArea(current);
+    }
+
+    static constexpr size_t MIN_BLOCK = 64;
+
+    const size_t pointLimit;
+    const Clock::duration ageLimit;
+    std::vector<Entry> back;
+    std::vector<P> backHull;
+    std::vector<Entry> front;
+    size_t blockSize = MIN_BLOCK;
+    std::vector<std::vector<P>> blockHulls;   ///< Hull of each front block below the top one
+    std::vector<P> restHull;                  ///< Hull of all of them
+    std::vector<std::vector<P>> topHulls;     ///< Entry i of the top block: hull of it and the block's later points
+    std::vector<P> frontHull;
+    std::vector<P> current;            ///< Hull of the whole window
+    double currentArea = 0;
+    std::vector<P> scratch, scratchHull, mergedHull;
+};
+
+} // namespace hull
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "point_file.hpp"
+
+/**
+ * @brief Graph snapshots for the servers.
+ *
+ * A snapshot is an ordinary float64 binary point file (common/point_file.hpp),
+ * so q1 and the tools read it as they read any other dataset.
+ *
+ * Saving follows the fork-and-write model: start() is called with the graph
+ * lock held and forks. The child inherits a copy-on-write image of the graph
+ * as it was at that instant, writes it to "<path>.tmp", fsyncs it and renames
+ * it over the previous snapshot, so a crash mid-save never leaves a torn file.
+ * The parent releases the lock as soon as fork() returns; writers carry on and
+ * the kernel copies only the pages they touch. Between fork() and _exit() the
+ * child makes async-signal-safe system calls only, since the other threads of
+ * a multi-threaded server (and any locks they held) do not exist in it. It
+ * first closes every descriptor it inherited but stdio: a copy of a client or
+ * listening socket held by the child would keep a closed connection open, or
+ * the port bound, until the save finished.
+ *
+ * Loading maps the file and copies the coordinates straight into the graph:
+ * there is nothing to parse, so a restarted server is answering CH in
+ * milliseconds. The header's lsn field is the last write-ahead log record the
+ * snapshot includes, where replay of the log (common/wal.hpp) picks up.
+ */
+namespace snapshot {
+
+constexpr const char* DEFAULT_PATH = "convex_hull.snapshot";
+
+// Path from CH_SNAPSHOT_PATH, or DEFAULT_PATH; a relative path is made absolute against the startup directory
+inline std::string pathFromEnv() {
+    const char* value = std::getenv("CH_SNAPSHOT_PATH");
+    std::string path = (value && *value) ? value : DEFAULT_PATH;
+    char directory[PATH_MAX];
+    if (path[0] == '/' || !getcwd(directory, sizeof(directory))) return path;
+    return std::string(directory) + "/" + path;
+}
+
+// Seconds between periodic snapshots from CH_SNAPSHOT_INTERVAL, or 0 for SAVE only
+inline int intervalFromEnv() {
+    const char* value = std::getenv("CH_SNAPSHOT_INTERVAL");
+    if (!value) return 0;
+    int seconds = std::atoi(value);
+    return seconds > 0 ? seconds : 0;
+}
+
+/**
+ * @brief Appends the points of a snapshot to points and sets lsn from its header.
+ * A missing file is not an error: loaded and lsn are 0 and the result true.
+ */
+template <typename PointT>
+bool load(const std::string& path, std::vector<PointT>& points, uint64_t& loaded, uint64_t& lsn, std::string& error) {
+    loaded = 0;
+    lsn = 0;
+    if (access(path.c_str(), F_OK) != 0) return true;
+
+    pointfile::Mapping mapping;
+    if (!mapping.open(path, error)) return false;
+    mapping.adviseSequential();
+    points.reserve(points.size() + mapping.size());
+    mapping.appendTo<PointT>(points);
+    loaded = mapping.size();
+    lsn = mapping.header().lsn;
+    return true;
+}
+
+/**
+ * @brief Runs at most one background save at a time.
+ *
+ * start() must be called with the graph lock held and poll() from the
+ * server's own loop. Both are safe to call from different threads.
+ */
+class BackgroundSaver {
+public:
+    BackgroundSaver(const std::string& path, int intervalSeconds)
+        : path(path), tempPath(path + ".tmp"), directory(directoryOf(path)),
+          interval(intervalSeconds), lastStarted(nowSeconds()) {}
+
+    BackgroundSaver(const BackgroundSaver&) = delete;
+    BackgroundSaver& operator=(const BackgroundSaver&) = delete;
+
+    const std::string& file() const { return path; }
+    bool inProgress() const { return child.load(std::memory_order_acquire) > 0; }
+
+    // Call from graphChanged(); the periodic save skips an unchanged graph
+    void graphChanged() { dirty.store(true, std::memory_order_relaxed); }
+
+    // True when the interval has passed and the graph changed since the last save
+    bool due() const {
+        return interval > 0 && !inProgress() && dirty.load(std::memory_order_relaxed) &&
+               nowSeconds() - lastStarted.load(std::memory_order_relaxed) >= interval;
+    }
+
+    /**
+     * @brief Forks the writer for points, which include the log up to lsn.
+     * Call with the graph lock held.
+     * @return false if a save is already running or fork() failed (errno set).
+     */
+    template <typename PointT>
+    bool start(const std::vector<PointT>& points, uint64_t lsn = 0) {
+        static_assert(std::is_same<typename PointT::Coord, double>::value && sizeof(PointT) == 2 * sizeof(double),
+                      "snapshots store points as packed float64 pairs");
+        if (inProgress()) {
+            errno = EBUSY;
+            return false;
+        }
+
+        // Everything the child needs is prepared here; it must not allocate
+        const char* data = reinterpret_cast<const char*>(points.data());
+        uint64_t count = points.size();
+        long maxFd = sysconf(_SC_OPEN_MAX);
+        pid_t pid = fork();
+        if (pid < 0) return false;
+        if (pid == 0) {
+            closeInherited(maxFd);
+            _exit(writeSnapshot(data, count, lsn) ? 0 : 1);
+        }
+
+        startedPoints = count;
+        startedLsn = lsn;
+        startedNanos = nowNanos();
+        child.store(pid, std::memory_order_release);
+        lastStarted.store(nowSeconds(), std::memory_order_relaxed);
+        dirty.store(false, std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * @brief Reaps a finished save without blocking.
+     * @return 1 if a save just succeeded, -1 if it just failed, 0 otherwise.
+     */
+    int poll() {
+        pid_t pid = child.load(std::memory_order_acquire);
+        if (pid <= 0) return 0;
+        int status = 0;
+        pid_t reaped = waitpid(pid, &status, WNOHANG);
+        if (reaped == 0 || (reaped < 0 && errno == EINTR)) return 0;
+        if (!child.compare_exchange_strong(pid, 0, std::memory_order_acq_rel)) return 0;
+
+        bool ok = reaped == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        if (ok) {
+            lastPoints = startedPoints;
+            lastLsn = startedLsn;
+            lastMillis = (nowNanos() - startedNanos) / 1000000;
+        } else {
+            dirty.store(true, std::memory_order_relaxed);   // Retry on the next interval
+        }
+        return ok ? 1 : -1;
+    }
+
+    // Size, log position and duration of the last successful save
+    uint64_t lastSavedPoints() const { return lastPoints; }
+    uint64_t lastSavedLsn() const { return lastLsn; }
+    uint64_t lastSaveMillis() const { return lastMillis; }
+
+private:
+    static int64_t nowSeconds() {
+        return std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static uint64_t nowNanos() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static std::string directoryOf(const std::string& path) {
+        size_t slash = path.rfind('/');
+        if (slash == std::string::npos) return ".";
+        return slash == 0 ? "/" : path.substr(0, slash);
+    }
+
+    static bool writeAll(int fd, const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t written = write(fd, data, size);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            data += written;
+            size -= written;
+        }
+        return true;
+    }
+
+    // Runs in the child: everything above stderr, in one call where the kernel has close_range
+    static void closeInherited(long maxFd) {
+#ifdef SYS_close_range
+        if (syscall(SYS_close_range, 3u, ~0u, 0u) == 0) return;
+#endif
+        for (long fd = 3; fd < maxFd; fd++) close(fd);
+    }
+
+    // Runs in the child: async-signal-safe calls and plain arithmetic only
+    bool writeSnapshot(const char* data, uint64_t count, uint64_t lsn) const {
+        pointfile::Header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, pointfile::MAGIC, sizeof(pointfile::MAGIC));
+        header.version = pointfile::VERSION;
+        header.coordType = pointfile::COORD_FLOAT64;
+        header.count = count;
+        header.lsn = lsn;
+        if (count > 0) {
+            header.minX = header.minY = std::numeric_limits<double>::infinity();
+            header.maxX = header.maxY = -std::numeric_limits<double>::infinity();
+            const double* coords = reinterpret_cast<const double*>(data);
+            for (uint64_t i = 0; i < count; i++) {
+                double x = coords[2 * i], y = coords[2 * i + 1];
+                if (x < header.minX) header.minX = x;
+                if (x > header.maxX) header.maxX = x;
+                if (y < header.minY) header.minY = y;
+                if (y > header.maxY) header.maxY = y;
+            }
+        }
+
+        int fd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) return false;
+        bool ok = writeAll(fd, reinterpret_cast<const char*>(&header), sizeof(header)) &&
+                  writeAll(fd, data, count * 2 * sizeof(double)) &&
+                  fsync(fd) == 0;
+        if (close(fd) != 0) ok = false;
+        if (!ok || rename(tempPath.c_str(), path.c_str()) != 0) {
+            unlink(tempPath.c_str());
+            return false;
+        }
+
+        // Make the rename itself durable
+        int dirFd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirFd >= 0) {
+            fsync(dirFd);
+            close(dirFd);
+        }
+        return true;
+    }
+
+    const std::string path;
+    const std::string tempPath;
+    const std::string directory;
+    const int interval;
+
+    std::atomic<pid_t> child{0};
+    std::atomic<bool> dirty{false};
+    std::atomic<int64_t> lastStarted;
+    uint64_t startedPoints = 0;
+    uint64_t startedLsn = 0;
+    uint64_t startedNanos = 0;
+    uint64_t lastPoints = 0;
+    uint64_t lastLsn = 0;
+    uint64_t lastMillis = 0;
+};
+
+} // namespace snapshot
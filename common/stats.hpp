@@ -0,0 +1,403 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "trace.hpp"
+
+/**
+ * @brief Server statistics behind the STATS command.
+ *
+ * Each thread records into its own ThreadStats. The owning thread is the only
+ * writer, so an update is a relaxed load and store on a thread-private cache
+ * line: no locked instruction and no sharing on the hot path. collect() sums
+ * the live threads plus the totals folded in from threads that have exited.
+ * Gauges (active connections, graph size) are absolute values rather than
+ * sums and live in single shared atomics.
+ */
+namespace stats {
+
+enum Command {
+    CMD_NEWGRAPH,
+    CMD_POINT,        ///< A point line following Newgraph
+    CMD_CH,
+    CMD_CH_RECT,      ///< CH restricted to a rectangle
+    CMD_NEWPOINT,
+    CMD_REMOVEPOINT,
+    CMD_STATS,
+    CMD_SAVE,
+    CMD_CHBATCH,      ///< The CHBATCH line; its items are counted as ch
+    CMD_INSIDE,
+    CMD_TANGENT,
+    CMD_COUNT_POINTS, ///< Count of the points in a rectangle
+    CMD_OTHER,
+    CMD_COUNT
+};
+
+inline const char* commandName(int command) {
+    static const char* const names[CMD_COUNT] = {
+        "newgraph", "point", "ch", "ch_rect", "newpoint", "removepoint", "stats", "save", "chbatch", "inside", "tangent", "count", "other"
+    };
+    return names[command];
+}
+
+// Classifies an input line for accounting; readingPoints is true inside a Newgraph block
+inline Command classifyCommand(std::string_view command, bool readingPoints) {
+    if (readingPoints) return CMD_POINT;
+    if (command.substr(0, 9) == "Newgraph ") return CMD_NEWGRAPH;
+    if (command == "CH") return CMD_CH;
+    if (command.substr(0, 3) == "CH ") return CMD_CH_RECT;
+    if (command.substr(0, 9) == "Newpoint ") return CMD_NEWPOINT;
+    if (command.substr(0, 12) == "Removepoint ") return CMD_REMOVEPOINT;
+    if (command == "STATS") return CMD_STATS;
+    if (command == "SAVE") return CMD_SAVE;
+    if (command.substr(0, 8) == "CHBATCH ") return CMD_CHBATCH;
+    if (command.substr(0, 7) == "Inside ") return CMD_INSIDE;
+    if (command.substr(0, 8) == "Tangent ") return CMD_TANGENT;
+    if (command.substr(0, 6) == "Count ") return CMD_COUNT_POINTS;
+    return CMD_OTHER;
+}
+
+inline uint64_t nowNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Counter with a single writer: relaxed load + store, readable from any thread.
+ */
+class Counter {
+public:
+    void add(uint64_t n) { value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+    uint64_t load() const { return value.load(std::memory_order_relaxed); }
+private:
+    std::atomic<uint64_t> value{0};
+};
+
+/**
+ * @brief Log-linear bucketing in the style of HdrHistogram.
+ *
+ * Values below SUB_BUCKETS get exact buckets. Above that every power of two
+ * is split into SUB_BUCKETS linear buckets, so a reported value is within
+ * 1/SUB_BUCKETS (~6%) of the recorded one. Values are nanoseconds; anything
+ * beyond 2^MAX_EXPONENT (~36 minutes) lands in the last bucket.
+ */
+struct Buckets {
+    static constexpr int SUB_BUCKET_BITS = 4;
+    static constexpr uint64_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static constexpr int MAX_EXPONENT = 41;
+    static constexpr size_t COUNT = SUB_BUCKETS + (MAX_EXPONENT - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    static size_t indexOf(uint64_t value) {
+        if (value < SUB_BUCKETS) return value;
+        int exponent = 63 - __builtin_clzll(value);
+        if (exponent > MAX_EXPONENT) return COUNT - 1;
+        int shift = exponent - SUB_BUCKET_BITS;
+        return SUB_BUCKETS + shift * SUB_BUCKETS + ((value >> shift) - SUB_BUCKETS);
+    }
+
+    // Largest value that maps to the bucket
+    static uint64_t highestValueOf(size_t index) {
+        if (index < SUB_BUCKETS) return index;
+        size_t shift = (index - SUB_BUCKETS) / SUB_BUCKETS;
+        uint64_t sub = (index - SUB_BUCKETS) % SUB_BUCKETS;
+        return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+    }
+};
+
+class Histogram {
+public:
+    void record(uint64_t nanos) { buckets[Buckets::indexOf(nanos)].add(1); }
+    uint64_t bucket(size_t index) const { return buckets[index].load(); }
+private:
+    Counter buckets[Buckets::COUNT];
+};
+
+// Plain-integer copy of a histogram, summed across threads
+struct HistogramCounts {
+    uint64_t buckets[Buckets::COUNT] = {};
+
+    void add(const Histogram& histogram) {
+        for (size_t i = 0; i < Buckets::COUNT; i++) buckets[i] += histogram.bucket(i);
+    }
+
+    void add(const HistogramCounts& other) {
+        for (size_t i = 0; i < Buckets::COUNT; i++) buckets[i] += other.buckets[i];
+    }
+
+    uint64_t total() const {
+        uint64_t sum = 0;
+        for (uint64_t count : buckets) sum += count;
+        return sum;
+    }
+
+    // Value at quantile q (0..1), in nanoseconds; 0 if nothing was recorded
+    uint64_t percentile(double q) const {
+        uint64_t count = total();
+        if (count == 0) return 0;
+        uint64_t rank = std::max<uint64_t>(1, (uint64_t)(q * count + 0.5));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < Buckets::COUNT; i++) {
+            seen += buckets[i];
+            if (seen >= rank) return Buckets::highestValueOf(i);
+        }
+        return Buckets::highestValueOf(Buckets::COUNT - 1);
+    }
+};
+
+/**
+ * A histogram is about 5 KB, so each thread allocates one only for the commands
+ * it actually runs; a q7 connection thread that only sends CH carries one.
+ */
+struct ThreadStats {
+    Counter commands[CMD_COUNT];
+    std::atomic<Histogram*> latency[CMD_COUNT] = {};   ///< Null until the command's first sample
+    Counter latencyNanos[CMD_COUNT];   ///< Sum of the recorded latencies
+    Counter bytesIn;
+    Counter bytesOut;
+    Counter hullCacheHits;
+    Counter hullCacheMisses;
+    Counter lockAcquisitions;
+    Counter lockWaitNanos;
+
+    ThreadStats() = default;
+    ThreadStats(const ThreadStats&) = delete;
+    ThreadStats& operator=(const ThreadStats&) = delete;
+    ~ThreadStats() {
+        for (std::atomic<Histogram*>& histogram : latency) delete histogram.load(std::memory_order_relaxed);
+    }
+
+    // Owning thread only; the release store lets collect() read the new histogram
+    Histogram& histogram(Command command) {
+        Histogram* histogram = latency[command].load(std::memory_order_relaxed);
+        if (!histogram) {
+            histogram = new Histogram();
+            latency[command].store(histogram, std::memory_order_release);
+        }
+        return *histogram;
+    }
+};
+
+struct Snapshot {
+    uint64_t commands[CMD_COUNT] = {};
+    HistogramCounts latency[CMD_COUNT];
+    uint64_t latencyNanos[CMD_COUNT] = {};
+    uint64_t bytesIn = 0;
+    uint64_t bytesOut = 0;
+    uint64_t hullCacheHits = 0;
+    uint64_t hullCacheMisses = 0;
+    uint64_t lockAcquisitions = 0;
+    uint64_t lockWaitNanos = 0;
+    int64_t activeConnections = 0;
+    int64_t graphPoints = 0;
+
+    void add(const ThreadStats& thread) {
+        for (int i = 0; i < CMD_COUNT; i++) {
+            commands[i] += thread.commands[i].load();
+            if (const Histogram* histogram = thread.latency[i].load(std::memory_order_acquire)) {
+                latency[i].add(*histogram);
+            }
+            latencyNanos[i] += thread.latencyNanos[i].load();
+        }
+        bytesIn += thread.bytesIn.load();
+        bytesOut += thread.bytesOut.load();
+        hullCacheHits += thread.hullCacheHits.load();
+        hullCacheMisses += thread.hullCacheMisses.load();
+        lockAcquisitions += thread.lockAcquisitions.load();
+        lockWaitNanos += thread.lockWaitNanos.load();
+    }
+};
+
+// Gauges, set by whoever changes the underlying value
+inline std::atomic<int64_t> activeConnections{0};
+inline std::atomic<int64_t> graphPoints{0};
+
+/**
+ * @brief Counts a connection in activeConnections for the lifetime of the scope.
+ */
+struct ConnectionScope {
+    ConnectionScope() { activeConnections.fetch_add(1, std::memory_order_relaxed); }
+    ~ConnectionScope() { activeConnections.fetch_sub(1, std::memory_order_relaxed); }
+    ConnectionScope(const ConnectionScope&) = delete;
+    ConnectionScope& operator=(const ConnectionScope&) = delete;
+};
+
+/**
+ * @brief Live threads plus totals of exited ones.
+ * Never destroyed, so threads that outlive main() can still retire safely.
+ */
+struct Registry {
+    std::mutex mutex;
+    std::vector<const ThreadStats*> live;
+    Snapshot retired;
+
+    static Registry& instance() {
+        static Registry* registry = new Registry();
+        return *registry;
+    }
+};
+
+// Owns the calling thread's ThreadStats; folds it into the retired totals at thread exit
+struct ThreadSlot {
+    ThreadStats stats;
+
+    ThreadSlot() {
+        Registry& registry = Registry::instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.live.push_back(&stats);
+    }
+
+    ~ThreadSlot() {
+        Registry& registry = Registry::instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.retired.add(stats);
+        registry.live.erase(std::find(registry.live.begin(), registry.live.end(), &stats));
+    }
+};
+
+inline ThreadStats& local() {
+    thread_local ThreadSlot slot;
+    return slot.stats;
+}
+
+inline void recordCommand(Command command, uint64_t nanos) {
+    ThreadStats& stats = local();
+    stats.commands[command].add(1);
+    stats.histogram(command).record(nanos);
+    stats.latencyNanos[command].add(nanos);
+}
+
+// Commands handled as one batch (bulk point lines): counted, no latency sample each
+inline void countCommands(Command command, uint64_t count) { local().commands[command].add(count); }
+inline void addBytesIn(uint64_t bytes) { local().bytesIn.add(bytes); }
+inline void addBytesOut(uint64_t bytes) { local().bytesOut.add(bytes); }
+inline void recordHullCache(bool hit) { (hit ? local().hullCacheHits : local().hullCacheMisses).add(1); }
+
+inline void recordLockWait(uint64_t nanos) {
+    ThreadStats& stats = local();
+    stats.lockAcquisitions.add(1);
+    stats.lockWaitNanos.add(nanos);
+}
+
+/**
+ * @brief Times one command from construction to end of scope.
+ */
+class CommandTimer {
+public:
+    explicit CommandTimer(Command command) : command(command), started(nowNanos()) {}
+    ~CommandTimer() { recordCommand(command, nowNanos() - started); }
+    CommandTimer(const CommandTimer&) = delete;
+    CommandTimer& operator=(const CommandTimer&) = delete;
+private:
+    Command command;
+    uint64_t started;
+};
+
+// True for mutexes whose lock() takes the caller's file and line (lockprof::Mutex)
+template <typename Mutex, typename = void>
+struct TakesCallSite : std::false_type {};
+template <typename Mutex>
+struct TakesCallSite<Mutex, std::void_t<decltype(std::declval<Mutex&>().lock("", 0))>> : std::true_type {};
+
+/**
+ * @brief lock_guard that records how long the acquisition waited.
+ * An uncontended acquisition costs a try_lock and no clock reads.
+ * A mutex that profiles call sites is handed the guard's own location.
+ */
+template <typename Mutex>
+class TimedLockGuard {
+public:
+    explicit TimedLockGuard(Mutex& mutex, const char* file = __builtin_FILE(), int line = __builtin_LINE())
+        : mutex(mutex) {
+        if (tryLock(file, line)) {
+            recordLockWait(0);
+            return;
+        }
+        uint64_t started = nowNanos();
+        lock(file, line);
+        uint64_t acquired = nowNanos();
+        recordLockWait(acquired - started);
+        trace::phase("lock_wait", started, acquired);
+    }
+    ~TimedLockGuard() { mutex.unlock(); }
+    TimedLockGuard(const TimedLockGuard&) = delete;
+    TimedLockGuard& operator=(const TimedLockGuard&) = delete;
+private:
+    bool tryLock([[maybe_unused]] const char* file, [[maybe_unused]] int line) {
+        if constexpr (TakesCallSite<Mutex>::value) return mutex.try_lock(file, line);
+        else return mutex.try_lock();
+    }
+
+    void lock([[maybe_unused]] const char* file, [[maybe_unused]] int line) {
+        if constexpr (TakesCallSite<Mutex>::value) mutex.lock(file, line);
+        else mutex.lock();
+    }
+
+    Mutex& mutex;
+};
+
+inline Snapshot collect() {
+    Snapshot snapshot;
+    {
+        Registry& registry = Registry::instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        snapshot = registry.retired;
+        for (const ThreadStats* thread : registry.live) snapshot.add(*thread);
+    }
+    snapshot.activeConnections = activeConnections.load(std::memory_order_relaxed);
+    snapshot.graphPoints = graphPoints.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+/**
+ * @brief STATS reply: one "STAT name value" line per statistic, then "END".
+ */
+inline std::vector<std::string> formatReport(const Snapshot& snapshot) {
+    std::vector<std::string> lines;
+    auto stat = [&lines](const std::string& name, const std::string& value) {
+        lines.push_back("STAT " + name + " " + value);
+    };
+    auto micros = [](uint64_t nanos) {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1) << nanos / 1000.0;
+        return out.str();
+    };
+
+    uint64_t lookups = snapshot.hullCacheHits + snapshot.hullCacheMisses;
+    std::ostringstream hitRate;
+    hitRate << std::fixed << std::setprecision(3)
+            << (lookups ? (double)snapshot.hullCacheHits / lookups : 0.0);
+
+    stat("connections_active", std::to_string(snapshot.activeConnections));
+    stat("graph_points", std::to_string(snapshot.graphPoints));
+    stat("bytes_in", std::to_string(snapshot.bytesIn));
+    stat("bytes_out", std::to_string(snapshot.bytesOut));
+    stat("hull_cache_hits", std::to_string(snapshot.hullCacheHits));
+    stat("hull_cache_misses", std::to_string(snapshot.hullCacheMisses));
+    stat("hull_cache_hit_rate", hitRate.str());
+    stat("lock_acquisitions", std::to_string(snapshot.lockAcquisitions));
+    stat("lock_wait_us", micros(snapshot.lockWaitNanos));
+
+    for (int i = 0; i < CMD_COUNT; i++) {
+        if (snapshot.commands[i] == 0) continue;
+        const HistogramCounts& latency = snapshot.latency[i];
+        stat(std::string("cmd_") + commandName(i),
+             "count=" + std::to_string(snapshot.commands[i]) +
+             " p50_us=" + micros(latency.percentile(0.50)) +
+             " p99_us=" + micros(latency.percentile(0.99)) +
+             " p999_us=" + micros(latency.percentile(0.999)));
+    }
+    lines.push_back("END");
+    return lines;
+}
+
+} // namespace stats
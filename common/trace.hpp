@@ -0,0 +1,377 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * @brief Sampled per-command tracing in Chrome trace-event format.
+ *
+ * Enabled by CH_TRACE_FILE=<path>. Each command is sampled with probability
+ * CH_TRACE_SAMPLE (default 0.01); a sampled command is written as a complete
+ * ("X") event for the command plus one event per phase it went through:
+ *
+ *     recv          read() of the batch that carried the command
+ *     parse         point/argument parsing
+ *     queue_wait    time in a server's waiting queue (async event, q6)
+ *     lock_wait     contended graph lock acquisition (via stats::TimedLockGuard
+ *                   and the Proactor's lockGraphForWrite)
+ *     hull_compute  convex hull on a CH cache miss
+ *     send          flush of the reply batch the command's reply went out in
+ *
+ * Phases are attached to the command running on the calling thread, so code
+ * below the server loop (lock guards, the hull kernel) records them without
+ * any plumbing. Events are collected per thread, handed to a background
+ * writer once the reply is sent, and appended to the file, which is rotated
+ * to <path>.1 after CH_TRACE_MAX_MB (default 64) megabytes. Each file is a JSON
+ * array without its closing bracket, which chrome://tracing and Perfetto accept.
+ *
+ * When tracing is off every hook is one predictable branch; an unsampled
+ * command additionally costs one random draw.
+ */
+namespace trace {
+
+constexpr std::chrono::milliseconds WRITE_INTERVAL(100);
+
+inline uint64_t nowNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Config {
+    std::string path;
+    uint64_t sampleThreshold = 0;    ///< A draw below this is sampled
+    uint64_t maxBytes = 0;
+    uint64_t origin = 0;             ///< Timestamps are relative to startup
+
+    static Config fromEnv() {
+        Config config;
+        const char* path = std::getenv("CH_TRACE_FILE");
+        if (path) config.path = path;
+
+        double rate = 0.01;
+        if (const char* sample = std::getenv("CH_TRACE_SAMPLE")) rate = std::atof(sample);
+        rate = rate < 0 ? 0 : rate > 1 ? 1 : rate;
+        config.sampleThreshold = rate >= 1 ? UINT64_MAX : (uint64_t)(rate * 18446744073709551616.0);
+
+        uint64_t megabytes = 64;
+        if (const char* size = std::getenv("CH_TRACE_MAX_MB")) megabytes = std::max(1L, std::atol(size));
+        config.maxBytes = megabytes << 20;
+        config.origin = nowNanos();
+        return config;
+    }
+};
+
+inline const Config& config() {
+    static const Config instance = Config::fromEnv();
+    return instance;
+}
+
+inline const bool enabled = !config().path.empty();
+
+/**
+ * @brief Appends submitted events to the trace file from a background thread.
+ * Never destroyed, like chlog::Logger; an atexit() hook writes what is left.
+ */
+class Writer {
+public:
+    static Writer& instance() {
+        static Writer* writer = create();
+        return *writer;
+    }
+
+    void submit(std::string_view events) {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        pending.append(events.data(), events.size());
+    }
+
+    void flush() {
+        std::string batch;
+        {
+            std::lock_guard<std::mutex> lock(pendingMutex);
+            batch.swap(pending);
+        }
+        std::lock_guard<std::mutex> lock(fileMutex);
+        if (batch.empty()) return;
+        if (!file || written >= config().maxBytes) rotate();
+        if (!file) return;
+        fwrite(batch.data(), 1, batch.size(), file);
+        fflush(file);
+        written += batch.size();
+    }
+
+private:
+    Writer() = default;
+
+    static Writer* create() {
+        Writer* writer = new Writer();
+        std::thread([writer] {
+            while (true) {
+                std::this_thread::sleep_for(WRITE_INTERVAL);
+                writer->flush();
+            }
+        }).detach();
+        std::atexit([] { instance().flush(); });
+        return writer;
+    }
+
+    // Starts a new file; the previous one, if any, becomes <path>.1
+    void rotate() {
+        const std::string& path = config().path;
+        if (file) {
+            fclose(file);
+            std::rename(path.c_str(), (path + ".1").c_str());
+        }
+        file = fopen(path.c_str(), "w");
+        written = 0;
+        if (file) written += fwrite("[\n", 1, 2, file);
+    }
+
+    std::mutex pendingMutex;   ///< Protects pending
+    std::string pending;
+    std::mutex fileMutex;      ///< Serializes flushes and rotation
+    FILE* file = nullptr;
+    uint64_t written = 0;
+};
+
+class Request;
+
+// Per-thread tracing state
+struct ThreadState {
+    uint64_t random;
+    long tid = syscall(SYS_gettid);
+    Request* current = nullptr;                       ///< Sampled command running on this thread
+    uint64_t recvStart = 0;                           ///< Last read of this thread's connection
+    uint64_t recvEnd = 0;
+    std::string finished;                             ///< Events of commands whose reply is not sent yet
+    std::vector<std::pair<uint64_t, int>> awaitingSend;   ///< (trace id, client) of those commands
+
+    ThreadState() : random(nowNanos() ^ ((uint64_t)tid << 32) ^ (uintptr_t)this) {}
+    ~ThreadState() {
+        if (!finished.empty()) Writer::instance().submit(finished);
+    }
+
+    // xorshift64*: one draw per command is all sampling costs
+    uint64_t draw() {
+        random ^= random >> 12;
+        random ^= random << 25;
+        random ^= random >> 27;
+        return random * 2685821657736338717ULL;
+    }
+};
+
+inline ThreadState& threadState() {
+    thread_local ThreadState state;
+    return state;
+}
+
+inline std::atomic<uint64_t> nextTraceId{1};
+
+// Appends "ts":...,"dur":... in microseconds relative to startup
+inline void appendTimes(std::string& out, uint64_t start, uint64_t end) {
+    char text[96];
+    snprintf(text, sizeof(text), "\"ts\":%.3f,\"dur\":%.3f",
+             (start - config().origin) / 1000.0, (end - start) / 1000.0);
+    out += text;
+}
+
+inline void appendEscaped(std::string& out, std::string_view text) {
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char)c < 0x20) {
+            out += ' ';
+        } else {
+            out += c;
+        }
+    }
+}
+
+/**
+ * @brief One command from parsing to reply.
+ *
+ * Construct it where the server starts on a command; it decides whether the
+ * command is sampled and, if so, becomes the thread's current command until
+ * it goes out of scope. A command resumed from a queue passes the trace id it
+ * got when it was queued, which forces sampling and links the two halves.
+ */
+class Request {
+public:
+    Request(std::string_view command, int client, uint64_t resumedId = 0) {
+        if (!enabled) return;
+        ThreadState& state = threadState();
+        if (resumedId == 0 && state.draw() >= config().sampleThreshold) return;
+
+        id = resumedId ? resumedId : nextTraceId.fetch_add(1, std::memory_order_relaxed);
+        this->client = client;
+        this->command = command.substr(0, 64);
+        started = nowNanos();
+        previous = state.current;
+        state.current = this;
+
+        if (!resumedId && state.recvEnd) {
+            if (state.recvStart) {
+                phase("recv", state.recvStart, state.recvEnd);
+            } else {
+                event("recv", "i", state.recvEnd, state.recvEnd);
+            }
+        }
+    }
+
+    ~Request() {
+        if (!id) return;
+        ThreadState& state = threadState();
+        event(verb().c_str(), "X", started, nowNanos(), true);
+        state.current = previous;
+        state.finished += events;
+        state.awaitingSend.emplace_back(id, client);
+    }
+
+    Request(const Request&) = delete;
+    Request& operator=(const Request&) = delete;
+
+    bool sampled() const { return id != 0; }
+    uint64_t traceId() const { return id; }
+
+    void phase(const char* name, uint64_t start, uint64_t end) { event(name, "X", start, end); }
+
+    // Async begin/end pair; for spans that overlap other work on the thread
+    void asyncPhase(const char* name, uint64_t start, uint64_t end) {
+        event(name, "b", start, start);
+        event(name, "e", end, end);
+    }
+
+private:
+    // "CH", "Newpoint", ... or "point" for a coordinate line
+    std::string verb() const {
+        if (command.empty() || command[0] == '-' || command[0] == '+' || command[0] == '.' ||
+            (command[0] >= '0' && command[0] <= '9')) {
+            return "point";
+        }
+        std::string name = command.substr(0, command.find(' '));
+        for (char& c : name) {
+            if (!isalnum((unsigned char)c)) c = '_';
+        }
+        return name;
+    }
+
+    void event(const char* name, const char* type, uint64_t start, uint64_t end, bool withCommand = false) {
+        events += "{\"name\":\"";
+        events += name;
+        events += "\",\"cat\":\"";
+        events += withCommand ? "command" : "phase";
+        events += "\",\"ph\":\"";
+        events += type;
+        events += "\",";
+        if (type[0] == 'X') {
+            appendTimes(events, start, end);
+        } else {
+            char text[48];
+            snprintf(text, sizeof(text), "\"ts\":%.3f", (start - config().origin) / 1000.0);
+            events += text;
+        }
+        if (type[0] == 'b' || type[0] == 'e') {
+            events += ",\"id\":" + std::to_string(id);
+        }
+        if (type[0] == 'i') {
+            events += ",\"s\":\"t\"";
+        }
+        events += ",\"pid\":" + std::to_string(getpid());
+        events += ",\"tid\":" + std::to_string(threadState().tid);
+        events += ",\"args\":{\"trace\":" + std::to_string(id) + ",\"client\":" + std::to_string(client);
+        if (withCommand) {
+            events += ",\"command\":\"";
+            appendEscaped(events, command);
+            events += '"';
+        }
+        events += "}},\n";
+    }
+
+    uint64_t id = 0;
+    int client = -1;
+    std::string command;
+    uint64_t started = 0;
+    Request* previous = nullptr;
+    std::string events;
+};
+
+// Start of a timed hook: a timestamp while tracing, 0 otherwise
+inline uint64_t mark() {
+    return enabled ? nowNanos() : 0;
+}
+
+// Adds a phase to the command running on this thread, if it is sampled
+inline void phase(const char* name, uint64_t start, uint64_t end) {
+    if (!enabled) return;
+    if (Request* request = threadState().current) request->phase(name, start, end);
+}
+
+/**
+ * @brief Times the enclosing scope (or until end()) as a phase of the current command.
+ */
+class Phase {
+public:
+    explicit Phase(const char* name)
+        : name(name), started(enabled && threadState().current ? nowNanos() : 0) {}
+    ~Phase() { end(); }
+
+    void end() {
+        if (started) phase(name, started, nowNanos());
+        started = 0;
+    }
+
+    Phase(const Phase&) = delete;
+    Phase& operator=(const Phase&) = delete;
+
+private:
+    const char* name;
+    uint64_t started;
+};
+
+/**
+ * @brief A read of this thread's connection finished; since is mark() from
+ * before the call, or 0 when the call also waited for an idle client (only
+ * the moment the data arrived is meaningful then).
+ */
+inline void received(uint64_t since = 0) {
+    if (!enabled) return;
+    ThreadState& state = threadState();
+    state.recvStart = since;
+    state.recvEnd = nowNanos();
+}
+
+/**
+ * @brief Replies of this thread's finished commands went out in a send that
+ * began at since; attaches the send phase and submits those commands.
+ */
+inline void sent(uint64_t since) {
+    if (!enabled) return;
+    ThreadState& state = threadState();
+    if (state.awaitingSend.empty()) return;
+
+    uint64_t end = nowNanos();
+    for (auto [id, client] : state.awaitingSend) {
+        state.finished += "{\"name\":\"send\",\"cat\":\"phase\",\"ph\":\"X\",";
+        appendTimes(state.finished, since, end);
+        state.finished += ",\"pid\":" + std::to_string(getpid()) + ",\"tid\":" + std::to_string(state.tid) +
+                          ",\"args\":{\"trace\":" + std::to_string(id) + ",\"client\":" + std::to_string(client) + "}},\n";
+    }
+    state.awaitingSend.clear();
+    Writer::instance().submit(state.finished);
+    state.finished.clear();
+}
+
+} // namespace trace
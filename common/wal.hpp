@@ -0,0 +1,454 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief Write-ahead log of graph mutations.
+ *
+ * Every change to the shared graph is appended as a fixed-size Record with a
+ * log sequence number (LSN), under the graph lock, so LSN order is the order
+ * the changes were applied in. Appending only queues the record: a dedicated
+ * log thread takes everything queued since its last pass and writes it with a
+ * single write(), followed in sync mode by a single fdatasync(). Records from
+ * many clients therefore share one commit (group commit), and the batch grows
+ * by itself while the previous sync is in flight.
+ *
+ * Durability, from CH_WAL:
+ *   none   no log; appending and waiting are a branch on a constant (default)
+ *   async  logged in the background, replies do not wait; a crash may lose
+ *          the last moments, a server restart loses nothing
+ *   sync   a reply leaves only after the records its command appended are on
+ *          disk (waitDurable() in the server's flush)
+ *
+ * The log is a series of segments "<path>.<first LSN>". A new segment starts
+ * when a snapshot starts; the snapshot header records the LSN it covers, and
+ * once it is written the segments it covers are deleted. Startup loads the
+ * snapshot and replays the records after its LSN. A torn record at the end of
+ * the last non-empty segment (a crash mid-write) is cut off, along with the
+ * empty segments after it that a crash can leave behind when their directory
+ * entries reached the disk and the data before them did not; damage anywhere
+ * else stops the replay with an error. A failed write or sync stops the server, since
+ * acknowledged changes could otherwise be lost without anyone knowing.
+ */
+namespace wal {
+
+constexpr const char* DEFAULT_PATH = "convex_hull.wal";
+
+enum Durability {
+    DURABILITY_NONE,
+    DURABILITY_ASYNC,
+    DURABILITY_SYNC
+};
+
+inline const char* durabilityName(Durability durability) {
+    return durability == DURABILITY_SYNC ? "sync" : durability == DURABILITY_ASYNC ? "async" : "none";
+}
+
+// Mode from CH_WAL: none (default), async or sync; anything else is none
+inline Durability durabilityFromEnv() {
+    const char* value = std::getenv("CH_WAL");
+    if (!value) return DURABILITY_NONE;
+    std::string mode = value;
+    if (mode == "sync") return DURABILITY_SYNC;
+    if (mode == "async") return DURABILITY_ASYNC;
+    return DURABILITY_NONE;
+}
+
+// Segment path prefix from CH_WAL_PATH, or DEFAULT_PATH in the working directory
+inline std::string pathFromEnv() {
+    const char* value = std::getenv("CH_WAL_PATH");
+    return (value && *value) ? value : DEFAULT_PATH;
+}
+
+// Extra time the log thread gathers records before each commit, CH_WAL_COMMIT_US (default 0)
+inline int commitWindowFromEnv() {
+    const char* value = std::getenv("CH_WAL_COMMIT_US");
+    if (!value) return 0;
+    int micros = std::atoi(value);
+    return micros > 0 ? micros : 0;
+}
+
+enum RecordType : uint32_t {
+    RECORD_ROTATE = 0,   ///< Never written: the log thread starts segment "<path>.<lsn>"
+    RECORD_CLEAR = 1,    ///< Newgraph
+    RECORD_ADD = 2,      ///< (x, y) appended
+    RECORD_REMOVE = 3    ///< The point at index, which was (x, y), erased
+};
+
+struct Record {
+    uint64_t lsn;
+    uint32_t type;
+    uint32_t checksum;   ///< FNV-1a of the record with this field zero
+    uint64_t index;
+    double x, y;
+};
+static_assert(sizeof(Record) == 40, "log records must stay 40 bytes");
+
+inline uint32_t checksumOf(Record record) {
+    record.checksum = 0;
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&record);
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < sizeof(record); i++) hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+// Segments of the log at path, as (first LSN, file) in LSN order
+inline std::vector<std::pair<uint64_t, std::string>> listSegments(const std::string& path) {
+    size_t slash = path.rfind('/');
+    std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    std::string prefix = (slash == std::string::npos ? path : path.substr(slash + 1)) + ".";
+
+    std::vector<std::pair<uint64_t, std::string>> segments;
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) return segments;
+    while (dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() != prefix.size() + 20 || name.compare(0, prefix.size(), prefix) != 0) continue;
+        std::string digits = name.substr(prefix.size());
+        if (digits.find_first_not_of("0123456789") != std::string::npos) continue;
+        std::string file = slash == std::string::npos ? name : directory + "/" + name;
+        segments.emplace_back(std::stoull(digits), file);
+    }
+    closedir(dir);
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+inline std::string segmentPath(const std::string& path, uint64_t firstLsn) {
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%020llu", (unsigned long long)firstLsn);
+    return path + suffix;
+}
+
+/**
+ * @brief Applies the logged changes after snapshotLsn to points.
+ * lastLsn starts at snapshotLsn and ends at the last record seen, applied counts
+ * the records replayed. False with error set if the log is damaged or has a gap.
+ */
+template <typename PointT>
+bool replay(const std::string& path, uint64_t snapshotLsn, std::vector<PointT>& points,
+            uint64_t& lastLsn, uint64_t& applied, std::string& error) {
+    lastLsn = snapshotLsn;
+    applied = 0;
+    auto segments = listSegments(path);
+
+    // Only the last segment with records may end torn; the ones after it are empty
+    size_t tailSegment = 0;
+    for (size_t s = 0; s < segments.size(); s++) {
+        struct stat info;
+        if (stat(segments[s].second.c_str(), &info) != 0 || info.st_size > 0) tailSegment = s;
+    }
+
+    for (size_t s = 0; s < segments.size(); s++) {
+        const std::string& file = segments[s].second;
+        bool tail = s >= tailSegment;
+        int fd = open(file.c_str(), tail ? O_RDWR : O_RDONLY);
+        if (fd < 0) {
+            error = file + ": " + strerror(errno);
+            return false;
+        }
+
+        std::vector<Record> records;
+        struct stat info;
+        bool readOk = fstat(fd, &info) == 0;
+        if (readOk) {
+            records.resize(info.st_size / sizeof(Record));
+            size_t want = records.size() * sizeof(Record), got = 0;
+            char* buffer = reinterpret_cast<char*>(records.data());
+            while (got < want) {
+                ssize_t n = read(fd, buffer + got, want - got);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) break;
+                got += n;
+            }
+            readOk = got == want;
+        }
+        if (!readOk) {
+            error = file + ": " + strerror(errno);
+            close(fd);
+            return false;
+        }
+
+        size_t valid = 0;
+        while (valid < records.size() && records[valid].checksum == checksumOf(records[valid])) valid++;
+        bool torn = valid < records.size() || (uint64_t)info.st_size % sizeof(Record) != 0;
+        if (torn && !tail) {
+            error = file + ": damaged record " + std::to_string(valid + 1);
+            close(fd);
+            return false;
+        }
+        if (torn && ftruncate(fd, valid * sizeof(Record)) != 0) {
+            error = file + ": cannot cut off the torn tail: " + strerror(errno);
+            close(fd);
+            return false;
+        }
+        close(fd);
+        if (torn) {
+            // Their names promise LSNs the log no longer reaches
+            for (size_t later = s + 1; later < segments.size(); later++) unlink(segments[later].second.c_str());
+            segments.resize(s + 1);
+        }
+
+        for (size_t i = 0; i < valid; i++) {
+            const Record& record = records[i];
+            if (record.lsn <= snapshotLsn) continue;
+            if (record.lsn != lastLsn + 1) {
+                error = file + ": expected LSN " + std::to_string(lastLsn + 1) + ", found " + std::to_string(record.lsn);
+                return false;
+            }
+            if (record.type == RECORD_CLEAR) {
+                points.clear();
+            } else if (record.type == RECORD_ADD) {
+                points.push_back(PointT(record.x, record.y));
+            } else if (record.type == RECORD_REMOVE && record.index < points.size() &&
+                       points[record.index].x == record.x && points[record.index].y == record.y) {
+                points.erase(points.begin() + record.index);
+            } else {
+                error = file + ": record " + std::to_string(record.lsn) + " does not apply to the graph";
+                return false;
+            }
+            lastLsn = record.lsn;
+            applied++;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief The log: appends from the graph's writers, commits on its own thread.
+ */
+class Log {
+public:
+    Log(const std::string& path, Durability durability, int commitWindowMicros = 0)
+        : path(path), durability(durability), commitWindow(commitWindowMicros) {}
+
+    ~Log() { stop(); }
+
+    Log(const Log&) = delete;
+    Log& operator=(const Log&) = delete;
+
+    bool enabled() const { return durability != DURABILITY_NONE; }
+    Durability mode() const { return durability; }
+    const std::string& file() const { return path; }
+
+    // Continues numbering after lastLsn and starts the log thread if the log is enabled; may follow stop()
+    void start(uint64_t lastLsn) {
+        nextLsn = lastLsn + 1;
+        stopping = false;
+        finished = false;
+        durableLsn.store(lastLsn, std::memory_order_relaxed);
+        if (enabled()) writer = std::thread(&Log::run, this);
+    }
+
+    // Commits everything queued, then stops the log thread
+    void stop() {
+        if (!writer.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queued.notify_one();
+        writer.join();
+    }
+
+    // Call with the graph lock held: the LSN order must be the order of the changes
+    void append(RecordType type, double x = 0, double y = 0, uint64_t index = 0) {
+        if (!enabled()) return;
+        std::lock_guard<std::mutex> lock(queueMutex);
+        push(type, x, y, index);
+        queued.notify_one();
+    }
+
+    // One RECORD_ADD per point, queued under a single lock acquisition
+    template <typename Iterator>
+    void appendPoints(Iterator first, Iterator last) {
+        if (!enabled() || first == last) return;
+        std::lock_guard<std::mutex> lock(queueMutex);
+        for (; first != last; ++first) push(RECORD_ADD, first->x, first->y, 0);
+        queued.notify_one();
+    }
+
+    // In sync mode, blocks until every record the calling thread appended is on disk
+    void waitDurable() {
+        if (durability != DURABILITY_SYNC) return;
+        uint64_t lsn = threadLastLsn();
+        if (durableLsn.load(std::memory_order_acquire) >= lsn) return;
+        std::unique_lock<std::mutex> lock(durableMutex);
+        committed.wait(lock, [&] { return durableLsn.load(std::memory_order_acquire) >= lsn || finished; });
+    }
+
+    // Last LSN handed out; with the graph lock held, the LSN a snapshot of the graph covers
+    uint64_t lastLsn() {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        return nextLsn - 1;
+    }
+
+    // Starts a new segment with the next record; call with the graph lock held as a snapshot starts
+    void rotate() {
+        if (!enabled()) return;
+        std::lock_guard<std::mutex> lock(queueMutex);
+        pending.push_back(Record{nextLsn, RECORD_ROTATE, 0, 0, 0, 0});
+        queued.notify_one();
+    }
+
+    // Deletes the segments whose records all have LSNs up to lsn, i.e. are in a snapshot
+    void discardUpTo(uint64_t lsn) {
+        auto segments = listSegments(path);
+        for (size_t i = 0; i + 1 < segments.size() && segments[i + 1].first <= lsn + 1; i++) {
+            unlink(segments[i].second.c_str());
+        }
+    }
+
+private:
+    static uint64_t& threadLastLsn() {
+        thread_local uint64_t lsn = 0;
+        return lsn;
+    }
+
+    // Call with queueMutex held
+    void push(RecordType type, double x, double y, uint64_t index) {
+        Record record{nextLsn++, type, 0, index, x, y};
+        record.checksum = checksumOf(record);
+        pending.push_back(record);
+        threadLastLsn() = record.lsn;
+    }
+
+    [[noreturn]] void fail(const char* what) {
+        fprintf(stderr, "Write-ahead log %s: %s failed: %s; stopping\n", path.c_str(), what, strerror(errno));
+        abort();
+    }
+
+    void openSegment(uint64_t firstLsn) {
+        std::string file = segmentPath(path, firstLsn);
+        fd = open(file.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0) fail("open");
+        unsynced = true;   // The new directory entry
+    }
+
+    void writeRun(const Record* records, size_t count) {
+        if (count == 0) return;
+        if (fd < 0) openSegment(records[0].lsn);
+        const char* data = reinterpret_cast<const char*>(records);
+        size_t size = count * sizeof(Record);
+        while (size > 0) {
+            ssize_t written = write(fd, data, size);
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0) fail("write");
+            data += written;
+            size -= written;
+        }
+        dirty = true;
+    }
+
+    void sync() {
+        if (durability != DURABILITY_SYNC || fd < 0 || (!dirty && !unsynced)) return;
+        if (dirty && fdatasync(fd) != 0) fail("fdatasync");
+        if (unsynced) {
+            // Make a new segment's directory entry durable too
+            size_t slash = path.rfind('/');
+            std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+            int dirFd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (dirFd >= 0) {
+                fsync(dirFd);
+                close(dirFd);
+            }
+            unsynced = false;
+        }
+        dirty = false;
+    }
+
+    void run() {
+        std::vector<Record> batch;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queued.wait(lock, [&] { return !pending.empty() || stopping; });
+                if (pending.empty()) break;
+                if (commitWindow > 0 && !stopping) {
+                    lock.unlock();
+                    std::this_thread::sleep_for(std::chrono::microseconds(commitWindow));
+                    lock.lock();
+                }
+                batch.swap(pending);
+            }
+
+            // One write per run of records; a rotation closes the segment between runs
+            uint64_t last = 0;
+            size_t runStart = 0;
+            for (size_t i = 0; i < batch.size(); i++) {
+                if (batch[i].type != RECORD_ROTATE) {
+                    last = batch[i].lsn;
+                    continue;
+                }
+                writeRun(batch.data() + runStart, i - runStart);
+                runStart = i + 1;
+                if (fd >= 0) {
+                    sync();
+                    close(fd);
+                }
+                // Opened now, even if empty, so the segments before it can be discarded
+                openSegment(batch[i].lsn);
+            }
+            writeRun(batch.data() + runStart, batch.size() - runStart);
+            sync();
+            batch.clear();
+
+            if (last > 0) {
+                {
+                    std::lock_guard<std::mutex> lock(durableMutex);
+                    durableLsn.store(last, std::memory_order_release);
+                }
+                committed.notify_all();
+            }
+        }
+        if (fd >= 0) {
+            sync();
+            close(fd);
+            fd = -1;
+        }
+        {
+            // Nothing appended from now on is written; do not leave anyone waiting for it
+            std::lock_guard<std::mutex> lock(durableMutex);
+            finished = true;
+        }
+        committed.notify_all();
+    }
+
+    const std::string path;
+    const Durability durability;
+    const int commitWindow;
+
+    std::mutex queueMutex;              ///< Protects nextLsn, pending and stopping
+    std::condition_variable queued;
+    uint64_t nextLsn = 1;
+    std::vector<Record> pending;
+    bool stopping = false;
+
+    std::mutex durableMutex;
+    std::condition_variable committed;
+    std::atomic<uint64_t> durableLsn{0};
+    bool finished = false;              ///< Log thread exited; protected by durableMutex
+
+    std::thread writer;
+    int fd = -1;            ///< Current segment, owned by the log thread
+    bool dirty = false;     ///< Written since the last sync
+    bool unsynced = false;  ///< Segment created since the last sync
+};
+
+} // namespace wal
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Fixed set of worker threads, each with its own task deque.
+ *
+ * submit() deals tasks round-robin over the deques. A worker runs its own
+ * tasks newest first and, once its deque is empty, steals the oldest task of
+ * another worker, so a batch of very uneven tasks still keeps every worker
+ * busy until the whole batch is done. Each deque has its own mutex, so
+ * workers only meet on a lock when one of them steals.
+ *
+ * Tasks must not throw. The destructor runs the tasks still queued, then
+ * joins the workers.
+ */
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit WorkStealingPool(unsigned threadCount = std::thread::hardware_concurrency()) {
+        if (threadCount == 0) threadCount = 1;
+        for (unsigned i = 0; i < threadCount; i++) workers.push_back(std::make_unique<Worker>());
+        for (unsigned i = 0; i < threadCount; i++) threads.emplace_back(&WorkStealingPool::run, this, i);
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(idleMutex);
+            stopping = true;
+        }
+        idle.notify_all();
+        for (std::thread& thread : threads) thread.join();
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    unsigned size() const { return (unsigned)workers.size(); }
+
+    void submit(Task task) {
+        Worker& worker = *workers[nextWorker.fetch_add(1, std::memory_order_relaxed) % workers.size()];
+        pending.fetch_add(1);   // Before the push, so a worker that finds the task never sees 0
+        {
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            worker.tasks.push_back(std::move(task));
+        }
+        {
+            // Pairs with the predicate check in run(): no worker misses the wakeup
+            std::lock_guard<std::mutex> lock(idleMutex);
+        }
+        idle.notify_one();
+    }
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    // The newest task of worker self, or the oldest of another
+    bool take(unsigned self, Task& task) {
+        for (size_t i = 0; i < workers.size(); i++) {
+            Worker& worker = *workers[(self + i) % workers.size()];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            if (worker.tasks.empty()) continue;
+            if (i == 0) {
+                task = std::move(worker.tasks.back());
+                worker.tasks.pop_back();
+            } else {
+                task = std::move(worker.tasks.front());
+                worker.tasks.pop_front();
+            }
+            pending.fetch_sub(1);
+            return true;
+        }
+        return false;
+    }
+
+    void run(unsigned self) {
+        Task task;
+        for (;;) {
+            if (take(self, task)) {
+                task();
+                task = nullptr;
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(idleMutex);
+            idle.wait(lock, [&] { return stopping || pending.load() > 0; });
+            if (stopping && pending.load() == 0) return;
+        }
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    std::atomic<size_t> nextWorker{0};
+    std::atomic<size_t> pending{0};   ///< Submitted and not yet taken
+    std::mutex idleMutex;
+    std::condition_variable idle;
+    bool stopping = false;
+};
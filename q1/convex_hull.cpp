@@ -3,121 +3,547 @@
 #include <algorithm>
 #include <cmath>
 #include <iomanip>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../common/convex_hull.hpp"
+#include "../common/point_file.hpp"
+#include "../common/point_parser.hpp"
+
+using hull::Point;
+
+// A float64 point file's coordinates are used in place as Points
+static_assert(sizeof(Point) == 2 * sizeof(double), "Point must match the point file layout");
 
 /**
- * Point structure for 2D coordinates
+ * Convex hull area of a binary point file (common/point_file.hpp)
+ * A float64 file is mapped and sorted in place, with no parse step or copy;
+ * a float32 file is widened into a vector first
  */
-struct Point {
-    double x, y;
+int area_of_point_file(const std::string& path) {
+    pointfile::Mapping mapping;
+    std::string error;
+    if (!mapping.open(path, error)) {
+        std::cerr << "Error: " << error << std::endl;
+        return 1;
+    }
     
-    Point() : x(0), y(0) {}
-    Point(double x, double y) : x(x), y(y) {}
-};
+    if (mapping.size() < 3) {
+        std::cerr << "Error: Need at least 3 points for convex hull" << std::endl;
+        return 1;
+    }
+    
+    std::vector<Point> hull;
+    if (mapping.coordType() == pointfile::COORD_FLOAT64) {
+        Point* points = reinterpret_cast<Point*>(mapping.float64Coords());
+        hull = hull::monotoneChainInPlace(points, points + mapping.size());
+    } else {
+        std::vector<Point> points;
+        points.reserve(mapping.size());
+        mapping.adviseSequential();
+        mapping.appendTo<Point>(points);
+        hull = hull::monotoneChainInPlace(points.begin(), points.end());
+    }
+    
+    double area = hull::polygonArea(hull);
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "Convex Hull Area: " << area << std::endl;
+    
+    return 0;
+}
 
 /**
- * Cross product of vectors OA and OB
- * Returns positive if counter-clockwise, negative if clockwise, 0 if collinear
+ * Replaces hull with the hull of hull and points together
+ * points is used as scratch space and left in unspecified order
  */
-double cross_product(const Point& O, const Point& A, const Point& B) {
-    return (A.x - O.x) * (B.y - O.y) - (A.y - O.y) * (B.x - O.x);
+void merge_into_hull(std::vector<Point>& points, std::vector<Point>& hull) {
+    points.insert(points.end(), hull.begin(), hull.end());
+    hull::sortPoints(points.begin(), points.end());
+    hull::monotoneChainSorted(points.begin(), points.end(), hull);
 }
 
+// Points per chunk in --stream mode unless --chunk is given
+const size_t DEFAULT_CHUNK_POINTS = 1 << 20;
+
+// Chunks in flight in --stream mode: one being read, one being merged, one spare
+const size_t CHUNK_BUFFERS = 3;
+
 /**
- * Comparison function for sorting points
- * First by x-coordinate, then by y-coordinate
+ * A block of input points handed from the reader thread to the hull thread
  */
-bool compare_points(const Point& a, const Point& b) {
-    if (a.x != b.x) 
-        return a.x < b.x;
-    return a.y < b.y;
-}
+struct PointChunk {
+    std::vector<Point> points;
+    std::string error;   // Set on the chunk where reading failed
+    bool last;
+    
+    PointChunk() : last(false) {}
+};
 
 /**
- * Andrew's Monotone Chain Convex Hull Algorithm
- * Returns vector of points forming the convex hull in counter-clockwise order
+ * Bounded hand-off between the reader and the hull thread
+ * Chunks cycle between a free list and a ready list, so only CHUNK_BUFFERS
+ * chunks ever exist no matter how large the input is
  */
-std::vector<Point> convex_hull(std::vector<Point> points) {
-    int n = points.size();
-    if (n <= 1) return points;
+class ChunkPipeline {
+public:
+    explicit ChunkPipeline(size_t buffers) : storage(buffers) {
+        for (size_t i = 0; i < storage.size(); i++) free_chunks.push_back(&storage[i]);
+    }
     
-    // Sort points lexicographically
-    std::sort(points.begin(), points.end(), compare_points);
+    PointChunk* take_free() { return take(free_chunks); }
+    PointChunk* take_ready() { return take(ready_chunks); }
+    void submit(PointChunk* chunk) { put(ready_chunks, chunk); }
+    void release(PointChunk* chunk) { put(free_chunks, chunk); }
     
-    // Build lower hull
-    std::vector<Point> hull;
-    for (int i = 0; i < n; i++) {
-        while (hull.size() >= 2 && 
-               cross_product(hull[hull.size()-2], hull[hull.size()-1], points[i]) <= 0) {
-            hull.pop_back();
+private:
+    PointChunk* take(std::deque<PointChunk*>& from) {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&from] { return !from.empty(); });
+        PointChunk* chunk = from.front();
+        from.pop_front();
+        return chunk;
+    }
+    
+    void put(std::deque<PointChunk*>& to, PointChunk* chunk) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            to.push_back(chunk);
         }
-        hull.push_back(points[i]);
+        changed.notify_all();
     }
     
-    // Build upper hull
-    size_t lower_size = hull.size();
-    for (int i = n - 2; i >= 0; i--) {
-        while (hull.size() >= lower_size + 1 && 
-               cross_product(hull[hull.size()-2], hull[hull.size()-1], points[i]) <= 0) {
-            hull.pop_back();
+    std::vector<PointChunk> storage;
+    std::deque<PointChunk*> free_chunks;
+    std::deque<PointChunk*> ready_chunks;
+    std::mutex mutex;
+    std::condition_variable changed;
+};
+
+/**
+ * Fills a chunk with up to chunk_size points; returns true once the input is
+ * exhausted or failed (with chunk.error set)
+ */
+typedef std::function<bool(PointChunk&, size_t)> ChunkReader;
+
+/**
+ * Streaming convex hull with bounded memory
+ * A reader thread fills chunks while this thread merges each one into a
+ * running hull: the hull's points are appended to the chunk and the hull of
+ * the combined set replaces it. Peak memory is CHUNK_BUFFERS * (chunk + h)
+ * points however long the input is.
+ */
+int area_streaming(const ChunkReader& read_chunk, size_t chunk_size) {
+    ChunkPipeline pipeline(CHUNK_BUFFERS);
+    
+    std::thread reader([&pipeline, &read_chunk, chunk_size] {
+        bool done = false;
+        while (!done) {
+            PointChunk* chunk = pipeline.take_free();
+            chunk->points.clear();
+            chunk->error.clear();
+            done = read_chunk(*chunk, chunk_size);
+            chunk->last = done;
+            pipeline.submit(chunk);
         }
-        hull.push_back(points[i]);
+    });
+    
+    std::vector<Point> hull;
+    std::string error;
+    unsigned long long total_points = 0;
+    bool last = false;
+    while (!last) {
+        PointChunk* chunk = pipeline.take_ready();
+        last = chunk->last;
+        if (!chunk->error.empty()) {
+            error = chunk->error;
+        } else {
+            total_points += chunk->points.size();
+            merge_into_hull(chunk->points, hull);
+        }
+        pipeline.release(chunk);
+    }
+    reader.join();
+    
+    if (!error.empty()) {
+        std::cerr << "Error: " << error << std::endl;
+        return 1;
+    }
+    if (total_points < 3) {
+        std::cerr << "Error: Need at least 3 points for convex hull" << std::endl;
+        return 1;
     }
     
-    // Remove the last point as it's the same as the first
-    if (hull.size() > 1) hull.pop_back();
+    double area = hull::polygonArea(hull);
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "Convex Hull Area: " << area << std::endl;
     
-    return hull;
+    return 0;
 }
 
 /**
- * Calculate area of polygon using Shoelace formula
+ * Streams a binary point file with buffered reads instead of mmap, so the
+ * input never has to fit in memory
  */
-double calculate_area(const std::vector<Point>& hull) {
-    if (hull.size() < 3) return 0.0;
-    
-    double area = 0.0;
-    int n = hull.size();
+int area_of_point_file_streaming(const std::string& path, size_t chunk_size) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        std::cerr << "Error: " << path << ": cannot open" << std::endl;
+        return 1;
+    }
     
-    for (int i = 0; i < n; i++) {
-        int j = (i + 1) % n;
-        area += hull[i].x * hull[j].y;
-        area -= hull[j].x * hull[i].y;
+    pointfile::Header header;
+    struct stat info;
+    std::string error = "not a binary point file";
+    if (fstat(fileno(file), &info) == 0 && fread(&header, sizeof(header), 1, file) == 1) {
+        error = pointfile::checkHeader(header, info.st_size);
+    }
+    if (!error.empty()) {
+        std::cerr << "Error: " << path << ": " << error << std::endl;
+        fclose(file);
+        return 1;
     }
     
-    return std::abs(area) / 2.0;
+    unsigned long long remaining = header.count;
+    std::vector<float> narrow;
+    ChunkReader read_chunk = [&](PointChunk& chunk, size_t limit) {
+        size_t count = (size_t)std::min<unsigned long long>(limit, remaining);
+        size_t start = chunk.points.size();
+        chunk.points.resize(start + count);
+        bool ok;
+        if (header.coordType == pointfile::COORD_FLOAT64) {
+            ok = fread(&chunk.points[start], sizeof(Point), count, file) == count;
+        } else {
+            narrow.resize(2 * count);
+            ok = fread(narrow.data(), 2 * sizeof(float), count, file) == count;
+            for (size_t i = 0; ok && i < count; i++) {
+                chunk.points[start + i] = Point(narrow[2 * i], narrow[2 * i + 1]);
+            }
+        }
+        if (!ok) {
+            chunk.error = path + ": read failed";
+            return true;
+        }
+        remaining -= count;
+        return remaining == 0;
+    };
+    
+    int result = area_streaming(read_chunk, chunk_size);
+    fclose(file);
+    return result;
 }
 
 /**
- * Main function - Convex Hull Area Calculator
- * Input: number of points, then x,y coordinates (comma-separated)
- * Output: area of convex hull
+ * Reads and validates the number of points from stdin
  */
-int main() {
+bool read_point_count(long long& num_points) {
     std::cout << "Enter number of points: ";
-    int num_points;
     
     // Validate input for number of points
     if (!(std::cin >> num_points)) {
         std::cerr << "Error: Invalid input for number of points" << std::endl;
-        return 1;
+        return false;
     }
     
     if (num_points <= 0) {
         std::cerr << "Error: Number of points must be positive" << std::endl;
+        return false;
+    }
+    
+    if (num_points < 3) {
+        std::cerr << "Error: Need at least 3 points for convex hull" << std::endl;
+        return false;
+    }
+    
+    return true;
+}
+
+/**
+ * Streams text input from stdin; same prompts and validation as the default mode
+ */
+int area_of_stdin_streaming(size_t chunk_size) {
+    long long num_points;
+    if (!read_point_count(num_points)) return 1;
+    
+    std::cout << "Enter points in format x,y (one per line):" << std::endl;
+    long long next_point = 0;
+    ChunkReader read_chunk = [&](PointChunk& chunk, size_t limit) {
+        while (chunk.points.size() < limit && next_point < num_points) {
+            double x, y;
+            char comma;
+            if (!(std::cin >> x >> comma >> y) || comma != ',') {
+                chunk.error = "Invalid input format for point " + std::to_string(next_point + 1);
+                return true;
+            }
+            chunk.points.push_back(Point(x, y));
+            next_point++;
+        }
+        return next_point == num_points;
+    };
+    
+    return area_streaming(read_chunk, chunk_size);
+}
+
+/**
+ * Read-only mapping of a whole text file
+ */
+class MappedText {
+public:
+    MappedText() : data(nullptr), length(0) {}
+    ~MappedText() {
+        if (data) munmap(data, length);
+    }
+    
+    MappedText(const MappedText&) = delete;
+    MappedText& operator=(const MappedText&) = delete;
+    
+    bool open(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        if (fstat(fd, &info) < 0) {
+            close(fd);
+            return false;
+        }
+        length = info.st_size;
+        if (length > 0) {
+            void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                data = static_cast<char*>(mapped);
+                madvise(data, length, MADV_SEQUENTIAL);
+            }
+        }
+        close(fd);
+        return length == 0 || data != nullptr;
+    }
+    
+    std::string_view text() const { return std::string_view(data, length); }
+    
+private:
+    char* data;
+    size_t length;
+};
+
+/**
+ * One thread's newline-aligned slice of the point lines
+ */
+struct TextRange {
+    const char* begin;
+    const char* end;
+    unsigned long long first_point;   // Global index of the range's first point, from 0
+    unsigned long long point_lines;   // Non-blank lines in the range
+    unsigned long long parsed;        // Points taken from the range
+    unsigned long long error_point;   // Global index of the first bad line, or 0 if none
+    std::vector<Point> hull;
+};
+
+// Calls on_line(begin, end) for every non-blank line, without the blanks around it;
+// stops early when on_line returns false
+template <typename OnLine>
+void for_each_point_line(const char* p, const char* end, OnLine on_line) {
+    while (p != end) {
+        const char* newline = static_cast<const char*>(memchr(p, '\n', end - p));
+        const char* line_end = newline ? newline : end;
+        const char* line_begin = skipBlanks(p, line_end);
+        p = newline ? newline + 1 : end;
+        if (line_begin != line_end && !on_line(line_begin, line_end)) return;
+    }
+}
+
+/**
+ * Convex hull area of a text input file, parsed in parallel
+ * The mapped file is split into newline-aligned ranges, one per thread.
+ * A first pass counts each range's points, so every thread knows the index
+ * of its first point: errors name the same point as the stdin reader and
+ * lines beyond the declared count are ignored, as with stdin. The second pass
+ * parses each range into the thread's own buffer and takes its hull there;
+ * with stream set, each thread folds every chunk_size points into a running
+ * hull instead, keeping memory at threads * (chunk + h) points.
+ * The main thread merges the per-thread hulls.
+ */
+int area_of_text_file(const std::string& path, unsigned threads, bool stream, size_t chunk_size) {
+    MappedText file;
+    if (!file.open(path)) {
+        std::cerr << "Error: " << path << ": cannot open" << std::endl;
         return 1;
     }
+    std::string_view text = file.text();
+    const char* end = text.data() + text.size();
     
+    // The number of points, on the first non-blank line
+    const char* body = text.data();
+    long long num_points = 0;
+    bool have_count = false;
+    for_each_point_line(text.data(), end, [&](const char* line_begin, const char* line_end) {
+        const char* count_end = line_end;
+        while (count_end != line_begin && (count_end[-1] == ' ' || count_end[-1] == '\t' || count_end[-1] == '\r')) count_end--;
+        std::from_chars_result result = std::from_chars(line_begin, count_end, num_points);
+        have_count = result.ec == std::errc() && result.ptr == count_end;
+        body = line_end == end ? end : line_end + 1;
+        return false;
+    });
+    if (!have_count) {
+        std::cerr << "Error: Invalid input for number of points" << std::endl;
+        return 1;
+    }
+    if (num_points <= 0) {
+        std::cerr << "Error: Number of points must be positive" << std::endl;
+        return 1;
+    }
     if (num_points < 3) {
         std::cerr << "Error: Need at least 3 points for convex hull" << std::endl;
         return 1;
     }
+    const unsigned long long wanted = num_points;
+    
+    // Newline-aligned ranges
+    threads = std::max(1u, threads);
+    std::vector<TextRange> ranges(threads);
+    size_t body_size = end - body;
+    const char* start = body;
+    for (unsigned t = 0; t < threads; t++) {
+        const char* stop = t + 1 == threads ? end : body + body_size * (t + 1) / threads;
+        if (stop < start) stop = start;
+        if (stop != end) {
+            const char* newline = static_cast<const char*>(memchr(stop, '\n', end - stop));
+            stop = newline ? newline + 1 : end;
+        }
+        TextRange& range = ranges[t];
+        range.begin = start;
+        range.end = stop;
+        range.point_lines = range.parsed = range.error_point = 0;
+        start = stop;
+    }
+    
+    auto run_on_ranges = [&](const std::function<void(TextRange&)>& work) {
+        std::vector<std::thread> workers;
+        for (unsigned t = 1; t < threads; t++) workers.emplace_back(work, std::ref(ranges[t]));
+        work(ranges[0]);
+        for (std::thread& worker : workers) worker.join();
+    };
+    
+    // Pass 1: points per range
+    run_on_ranges([](TextRange& range) {
+        for_each_point_line(range.begin, range.end, [&range](const char*, const char*) {
+            range.point_lines++;
+            return true;
+        });
+    });
+    unsigned long long seen = 0;
+    for (TextRange& range : ranges) {
+        range.first_point = seen;
+        seen += range.point_lines;
+    }
+    
+    // Pass 2: parse up to the declared count and take each range's hull
+    run_on_ranges([wanted, stream, chunk_size](TextRange& range) {
+        std::vector<Point> points;
+        if (range.first_point >= wanted) return;
+        unsigned long long limit = std::min(range.point_lines, wanted - range.first_point);
+        points.reserve(stream ? std::min<unsigned long long>(limit, chunk_size) : limit);
+        
+        for_each_point_line(range.begin, range.end, [&](const char* line_begin, const char* line_end) {
+            double x, y;
+            if (parsePoint(std::string_view(line_begin, line_end - line_begin), x, y) != ParseStatus::Ok) {
+                range.error_point = range.first_point + range.parsed + 1;
+                return false;
+            }
+            points.push_back(Point(x, y));
+            range.parsed++;
+            if (stream && points.size() >= chunk_size) {
+                merge_into_hull(points, range.hull);
+                points.clear();
+            }
+            return range.parsed < limit;
+        });
+        if (range.error_point == 0) merge_into_hull(points, range.hull);
+    });
+    
+    // First error by point index; too few lines fail at the first missing point, like stdin
+    for (const TextRange& range : ranges) {
+        if (range.error_point != 0) {
+            std::cerr << "Error: Invalid input format for point " << range.error_point << std::endl;
+            return 1;
+        }
+    }
+    if (seen < wanted) {
+        std::cerr << "Error: Invalid input format for point " << (seen + 1) << std::endl;
+        return 1;
+    }
+    
+    std::vector<Point> hull;
+    for (TextRange& range : ranges) merge_into_hull(range.hull, hull);
+    
+    double area = hull::polygonArea(hull);
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "Convex Hull Area: " << area << std::endl;
+    
+    return 0;
+}
+
+void print_usage() {
+    std::cerr << "Usage: convex_hull_cpp [--stream] [--chunk POINTS] [--threads N] [POINTS.txt|POINTS.bin]" << std::endl;
+    std::cerr << "  Reads text from stdin, or the text or binary point file given." << std::endl;
+    std::cerr << "  --stream keeps only a running hull in memory, reading --chunk points at a time." << std::endl;
+    std::cerr << "  --threads sets how many threads parse a text file (default: all cores)." << std::endl;
+}
+
+/**
+ * Main function - Convex Hull Area Calculator
+ * Input: number of points, then x,y coordinates (comma-separated),
+ *        on stdin or in a text file, or the path of a binary point file
+ * Output: area of convex hull
+ */
+int main(int argc, char* argv[]) {
+    bool stream = false;
+    size_t chunk_size = DEFAULT_CHUNK_POINTS;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    std::string path;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--stream") {
+            stream = true;
+        } else if (arg == "--chunk" && i + 1 < argc) {
+            chunk_size = std::max(1L, std::atol(argv[++i]));
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threads = (unsigned)std::max(1, std::atoi(argv[++i]));
+        } else if (arg[0] == '-' || !path.empty()) {
+            print_usage();
+            return 1;
+        } else {
+            path = arg;
+        }
+    }
+    
+    if (!path.empty() && !pointfile::isPointFile(path)) {
+        return area_of_text_file(path, threads, stream, chunk_size);
+    }
+    if (stream) {
+        return path.empty() ? area_of_stdin_streaming(chunk_size) : area_of_point_file_streaming(path, chunk_size);
+    }
+    if (!path.empty()) {
+        return area_of_point_file(path);
+    }
+    
+    long long num_points;
+    if (!read_point_count(num_points)) return 1;
     
     // Read point coordinates
     std::vector<Point> points;
     points.reserve(num_points);
     
     std::cout << "Enter points in format x,y (one per line):" << std::endl;
-    for (int i = 0; i < num_points; i++) {
+    for (long long i = 0; i < num_points; i++) {
         double x, y;
         char comma;
         
@@ -131,10 +557,10 @@ int main() {
     }
     
     // Compute convex hull
-    std::vector<Point> hull = convex_hull(points);
+    std::vector<Point> hull = hull::monotoneChain(points);
     
     // Calculate and display area
-    double area = calculate_area(hull);
+    double area = hull::polygonArea(hull);
     std::cout << std::fixed << std::setprecision(1);
     std::cout << "Convex Hull Area: " << area << std::endl;
     
@@ -4,124 +4,58 @@
 #include <algorithm>
 #include <cmath>
 #include <iomanip>
+#include <string>
+#include "../common/convex_hull.hpp"
+#include "../common/point_file.hpp"
 
-/**
- * Point structure for 2D coordinates
- */
-struct Point {
-    double x, y;
-    
-    Point() : x(0), y(0) {}
-    Point(double x, double y) : x(x), y(y) {}
-};
+using hull::Point;
 
-/**
- * Cross product of vectors OA and OB
- * Returns positive if counter-clockwise, negative if clockwise, 0 if collinear
- */
-double cross_product(const Point& O, const Point& A, const Point& B) {
-    return (A.x - O.x) * (B.y - O.y) - (A.y - O.y) * (B.x - O.x);
-}
-
-/**
- * Comparison function for sorting points
- * First by x-coordinate, then by y-coordinate
- */
-bool compare_points(const Point& a, const Point& b) {
-    if (a.x != b.x) 
-        return a.x < b.x;
-    return a.y < b.y;
-}
+// The shared monotone chain (common/convex_hull.hpp) instantiated for std::list:
+// both chains are built by push_back/pop_back on a std::list
+// (sorting goes through a vector, since std::sort needs random access)
 
 /**
- * Andrew's Monotone Chain Convex Hull Algorithm using std::list
- * Returns list of points forming the convex hull in counter-clockwise order
+ * Convex hull area of a binary point file (common/point_file.hpp)
+ * The file is mapped and its points copied into the std::list without a parse step
  */
-std::list<Point> convex_hull(std::list<Point> points) {
-    if (points.size() <= 1) return points;
-    
-    // Convert to vector for sorting (list sort is less efficient for this case)
-    std::vector<Point> point_vec(points.begin(), points.end());
-    std::sort(point_vec.begin(), point_vec.end(), compare_points);
-    
-    // Build lower hull using list
-    std::list<Point> hull;
-    for (const auto& point : point_vec) {
-        // Remove points that create right turn (list advantage: efficient removal)
-        while (hull.size() >= 2) {
-            auto it = hull.end();
-            --it;  // last point
-            Point last = *it;
-            --it;  // second to last point
-            Point second_last = *it;
-            
-            if (cross_product(second_last, last, point) <= 0) {
-                hull.pop_back();  // list advantage: efficient back removal
-            } else {
-                break;
-            }
-        }
-        hull.push_back(point);  // list advantage: efficient insertion
+int area_of_point_file(const std::string& path) {
+    pointfile::Mapping mapping;
+    std::string error;
+    if (!pointfile::isPointFile(path)) {
+        std::cerr << "Error: " << path << " is not a binary point file "
+                  << "(convert text input with tools/points_to_binary)" << std::endl;
+        return 1;
     }
-    
-    // Build upper hull
-    size_t lower_size = hull.size();
-    for (auto it = point_vec.rbegin() + 1; it != point_vec.rend(); ++it) {
-        const Point& point = *it;
-        
-        while (hull.size() >= lower_size + 1) {
-            auto hull_it = hull.end();
-            --hull_it;  // last point
-            Point last = *hull_it;
-            --hull_it;  // second to last point
-            Point second_last = *hull_it;
-            
-            if (cross_product(second_last, last, point) <= 0) {
-                hull.pop_back();  // list advantage: efficient back removal
-            } else {
-                break;
-            }
-        }
-        hull.push_back(point);  // list advantage: efficient insertion
+    if (!mapping.open(path, error)) {
+        std::cerr << "Error: " << error << std::endl;
+        return 1;
     }
-    
-    // Remove the last point as it's the same as the first
-    if (hull.size() > 1) hull.pop_back();
-    
-    return hull;
-}
-
-/**
- * Calculate area of polygon using Shoelace formula
- */
-double calculate_area(const std::list<Point>& hull) {
-    if (hull.size() < 3) return 0.0;
-    
-    double area = 0.0;
-    
-    auto it = hull.begin();
-    auto next_it = hull.begin();
-    ++next_it;
-    
-    for (; next_it != hull.end(); ++it, ++next_it) {
-        area += it->x * next_it->y;
-        area -= next_it->x * it->y;
+    if (mapping.size() < 3) {
+        std::cerr << "Error: Need at least 3 points for convex hull" << std::endl;
+        return 1;
     }
     
-    // Connect last point to first
-    auto last = hull.end();
-    --last;
-    auto first = hull.begin();
-    area += last->x * first->y;
-    area -= first->x * last->y;
+    std::list<Point> points;
+    mapping.adviseSequential();
+    mapping.appendTo<Point>(points);
     
-    return std::abs(area) / 2.0;
+    std::list<Point> hull = hull::monotoneChain(std::move(points));
+    double area = hull::polygonArea(hull);
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "Convex Hull Area (list): " << area << std::endl;
+    
+    return 0;
 }
 
 /**
  * Main function - Convex Hull Area Calculator with List
+ * With a binary point file path as the only argument, reads that instead of stdin
  */
-int main() {
+int main(int argc, char* argv[]) {
+    if (argc > 1) {
+        return area_of_point_file(argv[1]);
+    }
+    
     std::cout << "Enter number of points: ";
     int num_points;
     
@@ -159,10 +93,10 @@ int main() {
     }
     
     // Compute convex hull
-    std::list<Point> hull = convex_hull(points);
+    std::list<Point> hull = hull::monotoneChain(points);
     
     // Calculate and display area
-    double area = calculate_area(hull);
+    double area = hull::polygonArea(hull);
     std::cout << std::fixed << std::setprecision(1);
     std::cout << "Convex Hull Area (list): " << area << std::endl;
     
@@ -3,96 +3,60 @@
 #include <algorithm>
 #include <cmath>
 #include <iomanip>
+#include <string>
+#include "../common/convex_hull.hpp"
+#include "../common/point_file.hpp"
 
-/**
- * Point structure for 2D coordinates
- */
-struct Point {
-    double x, y;
-    
-    Point() : x(0), y(0) {}
-    Point(double x, double y) : x(x), y(y) {}
-};
+using hull::Point;
 
-/**
- * Cross product of vectors OA and OB
- * Returns positive if counter-clockwise, negative if clockwise, 0 if collinear
- */
-double cross_product(const Point& O, const Point& A, const Point& B) {
-    return (A.x - O.x) * (B.y - O.y) - (A.y - O.y) * (B.x - O.x);
-}
+// The shared monotone chain (common/convex_hull.hpp) instantiated for std::vector:
+// both chains are built by push_back/pop_back on a std::vector
 
 /**
- * Comparison function for sorting points
- * First by x-coordinate, then by y-coordinate
+ * Convex hull area of a binary point file (common/point_file.hpp)
+ * The file is mapped and its points copied into the std::vector without a parse step
  */
-bool compare_points(const Point& a, const Point& b) {
-    if (a.x != b.x) 
-        return a.x < b.x;
-    return a.y < b.y;
-}
-
-/**
- * Andrew's Monotone Chain Convex Hull Algorithm
- * Returns vector of points forming the convex hull in counter-clockwise order
- */
-std::vector<Point> convex_hull(std::vector<Point> points) {
-    int n = points.size();
-    if (n <= 1) return points;
-    
-    // Sort points lexicographically
-    std::sort(points.begin(), points.end(), compare_points);
-    
-    // Build lower hull
-    std::vector<Point> hull;
-    for (int i = 0; i < n; i++) {
-        while (hull.size() >= 2 && 
-               cross_product(hull[hull.size()-2], hull[hull.size()-1], points[i]) <= 0) {
-            hull.pop_back();
-        }
-        hull.push_back(points[i]);
+int area_of_point_file(const std::string& path) {
+    pointfile::Mapping mapping;
+    std::string error;
+    if (!pointfile::isPointFile(path)) {
+        std::cerr << "Error: " << path << " is not a binary point file "
+                  << "(convert text input with tools/points_to_binary)" << std::endl;
+        return 1;
     }
-    
-    // Build upper hull
-    size_t lower_size = hull.size();
-    for (int i = n - 2; i >= 0; i--) {
-        while (hull.size() >= lower_size + 1 && 
-               cross_product(hull[hull.size()-2], hull[hull.size()-1], points[i]) <= 0) {
-            hull.pop_back();
-        }
-        hull.push_back(points[i]);
+    if (!mapping.open(path, error)) {
+        std::cerr << "Error: " << error << std::endl;
+        return 1;
+    }
+    if (mapping.size() < 3) {
+        std::cerr << "Error: Need at least 3 points for convex hull" << std::endl;
+        return 1;
     }
     
-    // Remove the last point as it's the same as the first
-    if (hull.size() > 1) hull.pop_back();
-    
-    return hull;
-}
-
-/**
- * Calculate area of polygon using Shoelace formula
- */
-double calculate_area(const std::vector<Point>& hull) {
-    if (hull.size() < 3) return 0.0;
-    
-    double area = 0.0;
-    int n = hull.size();
+    std::vector<Point> points;
+    points.reserve(mapping.size());
+    mapping.adviseSequential();
+    mapping.appendTo<Point>(points);
     
-    for (int i = 0; i < n; i++) {
-        int j = (i + 1) % n;
-        area += hull[i].x * hull[j].y;
-        area -= hull[j].x * hull[i].y;
-    }
+    std::vector<Point> hull = hull::monotoneChain(std::move(points));
+    double area = hull::polygonArea(hull);
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "Convex Hull Area: " << area << std::endl;
     
-    return std::abs(area) / 2.0;
+    return 0;
 }
 
 /**
  * Main function - Convex Hull Area Calculator
  * Input: number of points, then x,y coordinates (comma-separated)
  * Output: area of convex hull
+ * With a binary point file path as the only argument, reads that instead of stdin
  */
-int main() {
+int main(int argc, char* argv[]) {
+    if (argc > 1) {
+        return area_of_point_file(argv[1]);
+    }
+    
     std::cout << "Enter number of points: ";
     int num_points;
     
@@ -131,10 +95,10 @@ int main() {
     }
     
     // Compute convex hull
-    std::vector<Point> hull = convex_hull(points);
+    std::vector<Point> hull = hull::monotoneChain(points);
     
     // Calculate and display area
-    double area = calculate_area(hull);
+    double area = hull::polygonArea(hull);
     std::cout << std::fixed << std::setprecision(1);
     std::cout << "Convex Hull Area: " << area << std::endl;
     
@@ -5,88 +5,11 @@
 #include <iomanip>
 #include <string>
 #include <sstream>
+#include "../common/convex_hull.hpp"
 
 using namespace std;
 
-/**
- * Point structure for 2D coordinates
- */
-struct Point {
-    double x, y;
-    
-    Point() : x(0), y(0) {}
-    Point(double x, double y) : x(x), y(y) {}
-};
-
-/**
- * Cross product of vectors OA and OB
- */
-double cross_product(const Point& O, const Point& A, const Point& B) {
-    return (A.x - O.x) * (B.y - O.y) - (A.y - O.y) * (B.x - O.x);
-}
-
-/**
- * Comparison function for sorting points
- */
-bool compare_points(const Point& a, const Point& b) {
-    if (a.x != b.x) 
-        return a.x < b.x;
-    return a.y < b.y;
-}
-
-/**
- * Andrew's Monotone Chain Convex Hull Algorithm
- */
-vector<Point> convex_hull(vector<Point> points) {
-    int n = points.size();
-    if (n <= 1) return points;
-    
-    // Sort points lexicographically
-    sort(points.begin(), points.end(), compare_points);
-    
-    // Build lower hull
-    vector<Point> hull;
-    for (int i = 0; i < n; i++) {
-        while (hull.size() >= 2 && 
-               cross_product(hull[hull.size()-2], hull[hull.size()-1], points[i]) <= 0) {
-            hull.pop_back();
-        }
-        hull.push_back(points[i]);
-    }
-    
-    // Build upper hull
-    size_t lower_size = hull.size();
-    for (int i = n - 2; i >= 0; i--) {
-        while (hull.size() >= lower_size + 1 && 
-               cross_product(hull[hull.size()-2], hull[hull.size()-1], points[i]) <= 0) {
-            hull.pop_back();
-        }
-        hull.push_back(points[i]);
-    }
-    
-    // Remove the last point as it's the same as the first
-    if (hull.size() > 1) hull.pop_back();
-    
-    return hull;
-}
-
-/**
- * Calculate area of polygon using Shoelace formula
- */
-double calculate_area(const vector<Point>& hull) {
-    if (hull.size() < 3) return 0.0;
-    
-    double area = 0.0;
-    int n = hull.size();
-    
-    for (int i = 0; i < n; i++) {
-        int j = (i + 1) % n;
-        area += hull[i].x * hull[j].y;
-        area -= hull[j].x * hull[i].y;
-    }
-    
-    return abs(area) / 2.0;
-}
+using hull::Point;
 
 /**
  * Safely parse integer from string
@@ -252,8 +175,7 @@ int main() {
                 cout << "0" << endl;
             } else {
                 try {
-                    vector<Point> hull = convex_hull(currentGraph);
-                    double area = calculate_area(hull);
+                    double area = hull::convexHullArea(currentGraph);
                     cout << fixed << setprecision(1) << area << endl;
                 } catch (...) {
                     cout << "Error: Failed to compute convex hull" << endl;
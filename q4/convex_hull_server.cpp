@@ -12,34 +12,48 @@
 #include <sstream>
 #include <map>
 #include <queue>
+#include <set>
+#include <fcntl.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <cstring>
+#include <string_view>
+#include "../common/convex_hull.hpp"
+#include "../common/line_buffer.hpp"
+#include "../common/point_parser.hpp"
+#include "../common/response_buffer.hpp"
+#include "../common/log.hpp"
+#include "../common/stats.hpp"
+#include "../common/hull_cache.hpp"
+#include "../common/metrics_http.hpp"
+#include "../common/snapshot.hpp"
+#include "../common/wal.hpp"
+#include "../common/hot_restart.hpp"
 
 using namespace std;
 
 #define PORT 9034
 #define BACKLOG 10
-#define MAX_BUFFER_SIZE 1024
+#define RECV_BUFFER_SIZE (64 * 1024)
+#define SELECT_TIMEOUT_SEC 1   // Bounds how late a periodic snapshot can start
 
-// 2D Point structure
-struct Point {
-    double x, y;
-    Point() : x(0), y(0) {}
-    Point(double x, double y) : x(x), y(y) {}
-};
+using hull::Point;
 
 // Queued command for clients waiting for graph access
 struct PendingCommand {
     int clientSocket;
     string commandText;
-    PendingCommand(int socket, const string& command) : clientSocket(socket), commandText(command) {}
+    PendingCommand(int socket, string_view command) : clientSocket(socket), commandText(command) {}
 };
 
 // Global shared state
 vector<Point> sharedGraphPoints;
+HullCache hullCache;                   // Last CH area, valid until the graph changes
+snapshot::BackgroundSaver snapshotSaver(snapshot::pathFromEnv(), snapshot::intervalFromEnv());
+wal::Log walLog(wal::pathFromEnv(), wal::durabilityFromEnv(), wal::commitWindowFromEnv());
+handoff::WriteGate writeGate;          // Closed once the graph is handed to a new process
 bool isGraphLocked = false;
 int lockingClientSocket = -1;
 
@@ -47,120 +61,129 @@ int lockingClientSocket = -1;
 map<int, int> clientInputState;        // 0=normal, 1=reading_points_for_newgraph
 map<int, int> pointsToRead;           // How many points client needs to input
 map<int, int> pointsAlreadyRead;      // How many points client has already input
+map<int, LineBuffer> clientInputBuffers;
 
 // Command queue for operations waiting for graph access
 queue<PendingCommand> waitingCommands;
 
-// Convex Hull Algorithm Implementation
-double crossProduct(const Point& origin, const Point& pointA, const Point& pointB) {
-    return (pointA.x - origin.x) * (pointB.y - origin.y) - (pointA.y - origin.y) * (pointB.x - origin.x);
-}
+// Replies queued per client, written once per select() round
+map<int, ResponseBuffer> clientResponseBuffers;
+set<int> clientsWithReplies;     // Queued a reply since the last flush
+set<int> clientsAwaitingWrite;   // Socket full; select() watches them for writability
+set<int> clientsToDrop;          // Send failed or replies not read; disconnected after the flush
 
-bool comparePointsLexicographically(const Point& a, const Point& b) {
-    return (a.x != b.x) ? a.x < b.x : a.y < b.y;
+// Record a change to the shared graph
+void graphChanged() {
+    hullCache.invalidate();
+    stats::graphPoints.store(sharedGraphPoints.size(), memory_order_relaxed);
+    snapshotSaver.graphChanged();
 }
 
-vector<Point> computeConvexHull(vector<Point> inputPoints) {
-    int numPoints = inputPoints.size();
-    if (numPoints <= 1) return inputPoints;
-    
-    sort(inputPoints.begin(), inputPoints.end(), comparePointsLexicographically);
-    
-    // Build lower hull
-    vector<Point> hullPoints;
-    for (int i = 0; i < numPoints; i++) {
-        while (hullPoints.size() >= 2 && 
-               crossProduct(hullPoints[hullPoints.size()-2], hullPoints[hullPoints.size()-1], inputPoints[i]) <= 0) {
-            hullPoints.pop_back();
-        }
-        hullPoints.push_back(inputPoints[i]);
+// Fork a background save of the graph; the reply for SAVE
+string startSnapshot() {
+    if (!snapshotSaver.start(sharedGraphPoints, walLog.lastLsn())) {
+        return errno == EBUSY ? "Error: Snapshot already in progress" : "Error: Snapshot failed: " + string(strerror(errno));
     }
-    
-    // Build upper hull
-    size_t lowerHullSize = hullPoints.size();
-    for (int i = numPoints - 2; i >= 0; i--) {
-        while (hullPoints.size() >= lowerHullSize + 1 && 
-               crossProduct(hullPoints[hullPoints.size()-2], hullPoints[hullPoints.size()-1], inputPoints[i]) <= 0) {
-            hullPoints.pop_back();
-        }
-        hullPoints.push_back(inputPoints[i]);
+    walLog.rotate();   // Changes from here on go to a segment the snapshot does not cover
+    LOG_INFO("Snapshot of " << sharedGraphPoints.size() << " points started");
+    return "Snapshot started (" + to_string(sharedGraphPoints.size()) + " points)";
+}
+
+// Reap a finished save, then start the periodic one if it is due and no upload is in progress
+void serviceSnapshots() {
+    int finished = snapshotSaver.poll();
+    if (finished > 0) {
+        LOG_INFO("Snapshot saved to " << snapshotSaver.file() << ": " << snapshotSaver.lastSavedPoints()
+                 << " points in " << snapshotSaver.lastSaveMillis() << " ms");
+        walLog.discardUpTo(snapshotSaver.lastSavedLsn());
+    } else if (finished < 0) {
+        LOG_ERROR("Snapshot to " << snapshotSaver.file() << " failed");
     }
-    
-    if (hullPoints.size() > 1) hullPoints.pop_back();
-    return hullPoints;
+    if (!isGraphLocked && !writeGate.frozen() && snapshotSaver.due()) startSnapshot();
 }
 
-double calculatePolygonArea(const vector<Point>& polygonVertices) {
-    if (polygonVertices.size() < 3) return 0.0;
-    
-    double area = 0.0;
-    int numVertices = polygonVertices.size();
-    
-    for (int i = 0; i < numVertices; i++) {
-        int nextIndex = (i + 1) % numVertices;
-        area += polygonVertices[i].x * polygonVertices[nextIndex].y;
-        area -= polygonVertices[nextIndex].x * polygonVertices[i].y;
+// Queue message for specific client; sent by flushClientResponses()
+void sendMessageToClient(int clientSocket, const string& message) {
+    if (!clientResponseBuffers.try_emplace(clientSocket, clientSocket).first->second.append(message)) {
+        clientsToDrop.insert(clientSocket);
     }
-    
-    return abs(area) / 2.0;
+    clientsWithReplies.insert(clientSocket);
+    stats::addBytesOut(message.size() + 1);
+    LOG_DEBUG("Sent to client " << clientSocket << ": " << message);
 }
 
-// Parse point from "x,y" format
-Point parsePointFromString(const string& pointString) {
-    size_t commaPosition = pointString.find(',');
-    double x = stod(pointString.substr(0, commaPosition));
-    double y = stod(pointString.substr(commaPosition + 1));
-    return Point(x, y);
+// Write the queued replies, one send per client, once the changes they acknowledge are logged.
+// Never waits for a full socket: the rest goes out when select() reports it writable
+void flushClientResponses() {
+    walLog.waitDurable();
+    for (int clientSocket : clientsWithReplies) {
+        auto it = clientResponseBuffers.find(clientSocket);
+        if (it == clientResponseBuffers.end() || clientsAwaitingWrite.count(clientSocket)) continue;
+        if (!it->second.flush()) {
+            LOG_ERROR("Error sending to client " << clientSocket << ": " << strerror(errno));
+            clientsToDrop.insert(clientSocket);
+        } else if (it->second.pending() > 0) {
+            clientsAwaitingWrite.insert(clientSocket);
+        }
+    }
+    clientsWithReplies.clear();
 }
 
-// Send message to specific client
-void sendMessageToClient(int clientSocket, const string& message) {
-    string formattedMessage = message + "\n";
-    send(clientSocket, formattedMessage.c_str(), formattedMessage.length(), 0);
-    cout << "Sent to client " << clientSocket << ": " << message << endl;
+// A full socket has room again: send more of its queued replies
+void flushWritableClient(int clientSocket) {
+    auto it = clientResponseBuffers.find(clientSocket);
+    bool sent = it != clientResponseBuffers.end() && it->second.flush();
+    if (!sent) clientsToDrop.insert(clientSocket);
+    if (!sent || it->second.pending() == 0) clientsAwaitingWrite.erase(clientSocket);
 }
 
 // Forward declaration
-void executeClientCommand(int clientSocket, const string& command);
+void executeClientCommand(int clientSocket, string_view command);
 
 // Process all queued commands when graph becomes available
 void processWaitingCommands() {
     if (isGraphLocked || waitingCommands.empty()) return;
     
-    cout << "Processing " << waitingCommands.size() << " waiting commands..." << endl;
+    LOG_DEBUG("Processing " << waitingCommands.size() << " waiting commands...");
     
     while (!waitingCommands.empty() && !isGraphLocked) {
         PendingCommand nextCommand = waitingCommands.front();
         waitingCommands.pop();
         
-        cout << "Executing waiting command from client " << nextCommand.clientSocket 
-             << ": " << nextCommand.commandText << endl;
+        LOG_DEBUG("Executing waiting command from client " << nextCommand.clientSocket << ": " << nextCommand.commandText);
         
         executeClientCommand(nextCommand.clientSocket, nextCommand.commandText);
         
         // Stop if graph got locked again
         if (isGraphLocked) {
-            cout << "Command processing paused - graph locked again" << endl;
+            LOG_DEBUG("Command processing paused - graph locked again");
             break;
         }
     }
     
     if (waitingCommands.empty()) {
-        cout << "All waiting commands processed." << endl;
+        LOG_DEBUG("All waiting commands processed.");
     }
 }
 
 // Execute command immediately (assumes graph is available)
-void executeClientCommand(int clientSocket, const string& command) {
+void executeClientCommand(int clientSocket, string_view command) {
+    // A command queued before a handoff runs after it
+    if (writeGate.frozen() && handoff::mutates(stats::classifyCommand(command, false))) {
+        sendMessageToClient(clientSocket, handoff::FROZEN_REPLY);
+        return;
+    }
     
     // Handle "Newgraph n" command
     if (command.substr(0, 9) == "Newgraph ") {
         isGraphLocked = true;
         lockingClientSocket = clientSocket;
-        cout << "Graph locked by client " << clientSocket << endl;
+        LOG_DEBUG("Graph locked by client " << clientSocket);
         
-        int numberOfPoints = stoi(command.substr(9));
+        int numberOfPoints = stoi(string(command.substr(9)));
         sharedGraphPoints.clear();
+        walLog.append(wal::RECORD_CLEAR);
+        graphChanged();
         sendMessageToClient(clientSocket, "Enter " + to_string(numberOfPoints) + " points (x,y):");
         
         clientInputState[clientSocket] = 1;
@@ -173,9 +196,15 @@ void executeClientCommand(int clientSocket, const string& command) {
         if (sharedGraphPoints.size() < 3) {
             sendMessageToClient(clientSocket, "0");
         } else {
-            cout << "Client " << clientSocket << " computing convex hull..." << endl;
-            vector<Point> hullVertices = computeConvexHull(sharedGraphPoints);
-            double hullArea = calculatePolygonArea(hullVertices);
+            // Served from the cache until the graph changes
+            double hullArea;
+            bool cached = hullCache.lookup(hullArea);
+            stats::recordHullCache(cached);
+            if (!cached) {
+                LOG_DEBUG("Client " << clientSocket << " computing convex hull...");
+                hullArea = hull::convexHullArea(sharedGraphPoints);
+                hullCache.store(hullCache.currentVersion(), hullArea);
+            }
             
             ostringstream areaStream;
             areaStream << fixed << setprecision(1) << hullArea;
@@ -185,125 +214,256 @@ void executeClientCommand(int clientSocket, const string& command) {
     
     // Handle "Newpoint x,y" command
     else if (command.substr(0, 9) == "Newpoint ") {
+        Point newPoint;
+        ParseStatus status = parsePoint(command.substr(9), newPoint.x, newPoint.y);
+        if (status != ParseStatus::Ok) {
+            sendMessageToClient(clientSocket, "Error: " + parseErrorMessage(status));
+            return;
+        }
+        
         isGraphLocked = true;
         lockingClientSocket = clientSocket;
-        cout << "Graph locked by client " << clientSocket << endl;
+        LOG_DEBUG("Graph locked by client " << clientSocket);
         
-        Point newPoint = parsePointFromString(command.substr(9));
         sharedGraphPoints.push_back(newPoint);
+        walLog.append(wal::RECORD_ADD, newPoint.x, newPoint.y);
+        graphChanged();
         sendMessageToClient(clientSocket, "Point added");
-        cout << "Point (" << newPoint.x << "," << newPoint.y << ") added" << endl;
+        LOG_DEBUG("Point (" << newPoint.x << "," << newPoint.y << ") added");
         
         isGraphLocked = false;
         lockingClientSocket = -1;
-        cout << "Graph unlocked" << endl;
+        LOG_DEBUG("Graph unlocked");
         processWaitingCommands();
     }
     
     // Handle "Removepoint x,y" command
     else if (command.substr(0, 12) == "Removepoint ") {
+        Point targetPoint;
+        ParseStatus status = parsePoint(command.substr(12), targetPoint.x, targetPoint.y);
+        if (status != ParseStatus::Ok) {
+            sendMessageToClient(clientSocket, "Error: " + parseErrorMessage(status));
+            return;
+        }
+        
         isGraphLocked = true;
         lockingClientSocket = clientSocket;
-        cout << "Graph locked by client " << clientSocket << endl;
-        
-        Point targetPoint = parsePointFromString(command.substr(12));
+        LOG_DEBUG("Graph locked by client " << clientSocket);
         
         // Find and remove the point
         for (int i = sharedGraphPoints.size() - 1; i >= 0; i--) {
             if (abs(sharedGraphPoints[i].x - targetPoint.x) < 1e-9 && 
                 abs(sharedGraphPoints[i].y - targetPoint.y) < 1e-9) {
+                walLog.append(wal::RECORD_REMOVE, sharedGraphPoints[i].x, sharedGraphPoints[i].y, i);
                 sharedGraphPoints.erase(sharedGraphPoints.begin() + i);
+                graphChanged();
                 break;
             }
         }
         
         sendMessageToClient(clientSocket, "Point removed");
-        cout << "Point (" << targetPoint.x << "," << targetPoint.y << ") removed" << endl;
+        LOG_DEBUG("Point (" << targetPoint.x << "," << targetPoint.y << ") removed");
         
         isGraphLocked = false;
         lockingClientSocket = -1;
-        cout << "Graph unlocked" << endl;
+        LOG_DEBUG("Graph unlocked");
         processWaitingCommands();
     }
+    
+    // Handle "SAVE" command: the snapshot is written by a forked child
+    else if (command == "SAVE") {
+        sendMessageToClient(clientSocket, startSnapshot());
+    }
 }
 
 // Process command from client
-void handleClientCommand(int clientSocket, const string& rawCommand) {
-    string cleanCommand = rawCommand;
-    
-    // Remove trailing whitespace
-    while (!cleanCommand.empty() && (cleanCommand.back() == ' ' || cleanCommand.back() == '\t' || cleanCommand.back() == '\r')) {
-        cleanCommand.pop_back();
-    }
-    
+void handleClientCommand(int clientSocket, string_view cleanCommand) {
+    // Lines arrive already trimmed from the client's LineBuffer
     if (cleanCommand.empty()) return;
     
-    cout << "Client " << clientSocket << " command: " << cleanCommand << endl;
+    LOG_DEBUG("Client " << clientSocket << " command: " << cleanCommand);
+    stats::Command kind = stats::classifyCommand(cleanCommand, clientInputState[clientSocket] == 1);
+    stats::CommandTimer timer(kind);
+    
+    // After a handoff the graph belongs to the new process; this one only reads it
+    handoff::WriteGate::Pass pass(writeGate, handoff::mutates(kind));
+    if (!pass) {
+        if (clientInputState[clientSocket] == 1) {
+            clientInputState[clientSocket] = 0;
+            isGraphLocked = false;
+            lockingClientSocket = -1;
+            processWaitingCommands();
+        }
+        sendMessageToClient(clientSocket, handoff::FROZEN_REPLY);
+        return;
+    }
     
     // Handle point input during Newgraph command
     if (clientInputState[clientSocket] == 1) {
-        Point inputPoint = parsePointFromString(cleanCommand);
+        Point inputPoint;
+        ParseStatus status = parsePoint(cleanCommand, inputPoint.x, inputPoint.y);
+        if (status != ParseStatus::Ok) {
+            sendMessageToClient(clientSocket, "Error: " + parseErrorMessage(status));
+            return;
+        }
         sharedGraphPoints.push_back(inputPoint);
+        walLog.append(wal::RECORD_ADD, inputPoint.x, inputPoint.y);
+        graphChanged();
         pointsAlreadyRead[clientSocket]++;
         
         sendMessageToClient(clientSocket, "Point " + to_string(pointsAlreadyRead[clientSocket]) + " accepted");
         
         if (pointsAlreadyRead[clientSocket] >= pointsToRead[clientSocket]) {
             sendMessageToClient(clientSocket, "Graph created with " + to_string(pointsAlreadyRead[clientSocket]) + " points");
-            cout << "Shared graph updated: " << sharedGraphPoints.size() << " points" << endl;
+            LOG_DEBUG("Shared graph updated: " << sharedGraphPoints.size() << " points");
             
             clientInputState[clientSocket] = 0;
             isGraphLocked = false;
             lockingClientSocket = -1;
-            cout << "Graph unlocked" << endl;
+            LOG_DEBUG("Graph unlocked");
             processWaitingCommands();
         }
         return;
     }
     
+    // STATS never touches the graph, so it is answered even while the graph is locked
+    if (cleanCommand == "STATS") {
+        for (const string& line : stats::formatReport(stats::collect())) {
+            sendMessageToClient(clientSocket, line);
+        }
+        return;
+    }
+    
     // Check if command requires graph access
     bool requiresGraphAccess = (cleanCommand.substr(0, 9) == "Newgraph ") ||
                               (cleanCommand.substr(0, 9) == "Newpoint ") ||
                               (cleanCommand.substr(0, 12) == "Removepoint ") ||
-                              (cleanCommand == "CH");
+                              (cleanCommand == "CH") || (cleanCommand == "SAVE");
     
     // Queue command if graph is busy
     if (isGraphLocked && requiresGraphAccess) {
         waitingCommands.push(PendingCommand(clientSocket, cleanCommand));
-        cout << "Queuing command from client " << clientSocket << ": " << cleanCommand << endl;
+        LOG_DEBUG("Queuing command from client " << clientSocket << ": " << cleanCommand);
         sendMessageToClient(clientSocket, "Command queued (position " + to_string(waitingCommands.size()) + ")");
         return;
     }
     
     // Execute command immediately
-    cout << "Executing immediate command from client " << clientSocket << ": " << cleanCommand << endl;
+    LOG_DEBUG("Executing immediate command from client " << clientSocket << ": " << cleanCommand);
     executeClientCommand(clientSocket, cleanCommand);
 }
 
+// Restore the graph from the last snapshot and the write-ahead log; lastLsn is where logging resumes
+bool restoreGraph(uint64_t& lastLsn) {
+    uint64_t restoredPoints = 0, snapshotLsn = 0, replayedChanges = 0;
+    string restoreError;
+    if (!snapshot::load(snapshotSaver.file(), sharedGraphPoints, restoredPoints, snapshotLsn, restoreError)) {
+        cerr << "Could not load snapshot " << restoreError << endl;
+    }
+    if (!wal::replay(walLog.file(), snapshotLsn, sharedGraphPoints, lastLsn, replayedChanges, restoreError)) {
+        cerr << "Could not replay the write-ahead log: " << restoreError << endl;
+        return false;
+    }
+    if (restoredPoints > 0 || replayedChanges > 0) {
+        graphChanged();
+        cout << "Restored " << sharedGraphPoints.size() << " points from " << snapshotSaver.file()
+             << " and " << replayedChanges << " logged changes" << endl;
+    }
+    return true;
+}
+
+// Close a client and forget its state; commands that waited for its graph lock run
+void disconnectClient(int clientSocket, fd_set& masterSocketSet) {
+    stats::activeConnections.fetch_sub(1, memory_order_relaxed);
+    
+    // Release graph lock if held by this client
+    if (lockingClientSocket == clientSocket) {
+        isGraphLocked = false;
+        lockingClientSocket = -1;
+        LOG_DEBUG("Graph unlocked (client disconnected)");
+        processWaitingCommands();
+    }
+    
+    // Remove client's commands from queue
+    queue<PendingCommand> filteredQueue;
+    while (!waitingCommands.empty()) {
+        PendingCommand command = waitingCommands.front();
+        waitingCommands.pop();
+        if (command.clientSocket != clientSocket) {
+            filteredQueue.push(command);
+        }
+    }
+    waitingCommands = filteredQueue;
+    
+    // Clean up client data
+    close(clientSocket);
+    FD_CLR(clientSocket, &masterSocketSet);
+    clientInputBuffers.erase(clientSocket);
+    clientResponseBuffers.erase(clientSocket);
+    clientsWithReplies.erase(clientSocket);
+    clientsAwaitingWrite.erase(clientSocket);
+    clientsToDrop.erase(clientSocket);
+    clientInputState.erase(clientSocket);
+    pointsToRead.erase(clientSocket);
+    pointsAlreadyRead.erase(clientSocket);
+}
+
 int main() {
-    int serverSocket;
+    int serverSocket = -1;
     struct sockaddr_in serverAddress, clientAddress;
     socklen_t clientAddressSize;
     int socketOption = 1;
     
-    fd_set masterSocketSet, readSocketSet;
+    fd_set masterSocketSet, readSocketSet, writeSocketSet;
     int maxSocketDescriptor;
-    map<int, string> clientInputBuffers;
+    map<int, metrics::ScrapeConnection> scrapeConnections;   // Open connections on the metrics port
     
     cout << "=== Multi-Client Convex Hull Server ===" << endl;
     cout << "Port: " << PORT << endl;
     
-    // Create and configure server socket
-    serverSocket = socket(AF_INET, SOCK_STREAM, 0);
-    setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &socketOption, sizeof(int));
-    
-    serverAddress.sin_family = AF_INET;
-    serverAddress.sin_port = htons(PORT);
-    serverAddress.sin_addr.s_addr = INADDR_ANY;
-    memset(serverAddress.sin_zero, '\0', sizeof serverAddress.sin_zero);
+    // With hot restart on, take the sockets and graph over from a running server if there is one
+    string handoffPath = handoff::pathFromEnv();
+    int metricsSocket = -1;
+    uint64_t lastLsn = 0;
+    string handoffError;
+    bool tookOver = !handoffPath.empty() &&
+                    handoff::receive(handoffPath, serverSocket, metricsSocket, sharedGraphPoints, lastLsn, handoffError);
+    if (!handoffError.empty()) {
+        cerr << "Hot restart failed, starting cold: " << handoffError << endl;
+    }
+    if (tookOver) {
+        graphChanged();
+        cout << "Took over from the running server with " << sharedGraphPoints.size() << " points" << endl;
+    } else {
+        // Create and configure server socket
+        serverSocket = socket(AF_INET, SOCK_STREAM, 0);
+        setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &socketOption, sizeof(int));
+        
+        serverAddress.sin_family = AF_INET;
+        serverAddress.sin_port = htons(PORT);
+        serverAddress.sin_addr.s_addr = INADDR_ANY;
+        memset(serverAddress.sin_zero, '\0', sizeof serverAddress.sin_zero);
+        
+        bind(serverSocket, (struct sockaddr *)&serverAddress, sizeof serverAddress);
+        listen(serverSocket, BACKLOG);
+        
+        if (!restoreGraph(lastLsn)) return 1;
+    }
+    walLog.start(lastLsn);
+    if (walLog.enabled()) {
+        cout << "Write-ahead log: " << walLog.file() << " (" << wal::durabilityName(walLog.mode()) << ")" << endl;
+    }
     
-    bind(serverSocket, (struct sockaddr *)&serverAddress, sizeof serverAddress);
-    listen(serverSocket, BACKLOG);
+    // Optional Prometheus endpoint, served by the same select() loop; a hot restart hands it over too
+    int metricsPort = metrics::portFromEnv();
+    if (metricsSocket < 0 && metricsPort) {
+        metricsSocket = metrics::openListener(metricsPort);
+        if (metricsSocket < 0) {
+            cerr << "Could not open metrics port " << metricsPort << ": " << strerror(errno) << endl;
+        } else {
+            cout << "Metrics: http://127.0.0.1:" << metricsPort << "/metrics" << endl;
+        }
+    }
     
     cout << "Server ready! Shared graph: " << sharedGraphPoints.size() << " points" << endl;
     cout << "Waiting for clients..." << endl;
@@ -312,11 +472,39 @@ int main() {
     FD_ZERO(&masterSocketSet);
     FD_SET(serverSocket, &masterSocketSet);
     maxSocketDescriptor = serverSocket;
+    if (metricsSocket >= 0) {
+        FD_SET(metricsSocket, &masterSocketSet);
+        maxSocketDescriptor = max(maxSocketDescriptor, metricsSocket);
+    }
+    
+    // A successor started with the same CH_HANDOFF_PATH connects here
+    handoff::Endpoint endpoint;
+    if (!handoffPath.empty()) {
+        if (endpoint.open(handoffPath, handoffError)) {
+            FD_SET(endpoint.fd(), &masterSocketSet);
+            maxSocketDescriptor = max(maxSocketDescriptor, endpoint.fd());
+            cout << "Hot restart: " << handoffPath << endl;
+        } else {
+            cerr << "Could not open handoff socket " << handoffError << endl;
+        }
+    }
+    handoff::Drain drain;
     
     // Main server loop using select()
     while (true) {
         readSocketSet = masterSocketSet;
-        select(maxSocketDescriptor + 1, &readSocketSet, NULL, NULL, NULL);
+        FD_ZERO(&writeSocketSet);
+        for (int clientSocket : clientsAwaitingWrite) FD_SET(clientSocket, &writeSocketSet);
+        struct timeval selectTimeout = {SELECT_TIMEOUT_SEC, 0};
+        if (select(maxSocketDescriptor + 1, &readSocketSet, &writeSocketSet, NULL, &selectTimeout) <= 0) {
+            FD_ZERO(&readSocketSet);
+            FD_ZERO(&writeSocketSet);
+        }
+        
+        // Sockets that were full have room again
+        for (int clientSocket : vector<int>(clientsAwaitingWrite.begin(), clientsAwaitingWrite.end())) {
+            if (FD_ISSET(clientSocket, &writeSocketSet)) flushWritableClient(clientSocket);
+        }
         
         for (int currentSocket = 0; currentSocket <= maxSocketDescriptor; currentSocket++) {
             if (FD_ISSET(currentSocket, &readSocketSet)) {
@@ -325,72 +513,109 @@ int main() {
                 if (currentSocket == serverSocket) {
                     clientAddressSize = sizeof clientAddress;
                     int newClientSocket = accept(serverSocket, (struct sockaddr *)&clientAddress, &clientAddressSize);
+                    if (newClientSocket < 0) continue;
+                    
+                    // Non-blocking, so a client that stops reading cannot stall the loop in send()
+                    int socketFlags = fcntl(newClientSocket, F_GETFL, 0);
+                    fcntl(newClientSocket, F_SETFL, socketFlags | O_NONBLOCK);
                     
                     FD_SET(newClientSocket, &masterSocketSet);
                     if (newClientSocket > maxSocketDescriptor) maxSocketDescriptor = newClientSocket;
                     
-                    cout << "New client " << newClientSocket << " connected" << endl;
+                    LOG_INFO("New client " << newClientSocket << " connected");
+                    stats::activeConnections.fetch_add(1, memory_order_relaxed);
                     sendMessageToClient(newClientSocket, "Convex Hull Server");
-                    sendMessageToClient(newClientSocket, "Commands: Newgraph n, CH, Newpoint x,y, Removepoint x,y");
-                    clientInputBuffers[newClientSocket] = "";
+                    sendMessageToClient(newClientSocket, "Commands: Newgraph n, CH, Newpoint x,y, Removepoint x,y, STATS, SAVE");
+                    clientInputBuffers.emplace(newClientSocket, LineBuffer(RECV_BUFFER_SIZE));
+                }
+                
+                // Scrape connection on the metrics port
+                else if (currentSocket == metricsSocket) {
+                    int scrapeSocket = accept(metricsSocket, NULL, NULL);
+                    if (scrapeSocket >= 0) {
+                        FD_SET(scrapeSocket, &masterSocketSet);
+                        if (scrapeSocket > maxSocketDescriptor) maxSocketDescriptor = scrapeSocket;
+                        scrapeConnections.try_emplace(scrapeSocket);
+                    }
+                }
+                
+                // A successor taking over; from then on it accepts and this process only drains
+                else if (currentSocket == endpoint.fd()) {
+                    int successor = endpoint.accept();
+                    if (successor < 0) continue;
+                    bool handedOver = handoff::handOver(successor, writeGate, walLog, sharedGraphPoints,
+                                                        serverSocket, metricsSocket, handoffError);
+                    close(successor);
+                    if (!handedOver) {
+                        cerr << "Handoff failed: " << handoffError << endl;
+                        continue;
+                    }
+                    for (int* listener : {&serverSocket, &metricsSocket}) {
+                        if (*listener < 0) continue;
+                        FD_CLR(*listener, &masterSocketSet);
+                        close(*listener);
+                        *listener = -1;
+                    }
+                    FD_CLR(endpoint.fd(), &masterSocketSet);
+                    endpoint.close();
+                    cout << "Handed over to a new process; draining " << stats::activeConnections.load() << " clients" << endl;
+                    drain.start(handoff::drainSecondsFromEnv());
+                    break;   // This round's other ready descriptors may be the closed listeners
+                }
+                else if (auto scrape = scrapeConnections.find(currentSocket); scrape != scrapeConnections.end()) {
+                    if (scrape->second.onReadable(currentSocket)) {
+                        close(currentSocket);
+                        FD_CLR(currentSocket, &masterSocketSet);
+                        scrapeConnections.erase(scrape);
+                    }
                 }
                 
                 // Handle data from existing client
                 else {
-                    char dataBuffer[MAX_BUFFER_SIZE];
-                    int bytesReceived = recv(currentSocket, dataBuffer, sizeof(dataBuffer), 0);
+                    LineBuffer& clientBuffer = clientInputBuffers[currentSocket];
+                    int bytesReceived = -1;
+                    if (clientBuffer.prepareWrite()) {
+                        bytesReceived = recv(currentSocket, clientBuffer.writePtr(), clientBuffer.writable(), 0);
+                    }
                     
+                    if (bytesReceived < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                        continue;
+                    }
                     if (bytesReceived <= 0) {
-                        // Client disconnected
-                        cout << "Client " << currentSocket << " disconnected" << endl;
-                        
-                        // Release graph lock if held by this client
-                        if (lockingClientSocket == currentSocket) {
-                            isGraphLocked = false;
-                            lockingClientSocket = -1;
-                            cout << "Graph unlocked (client disconnected)" << endl;
-                            processWaitingCommands();
-                        }
-                        
-                        // Remove client's commands from queue
-                        queue<PendingCommand> filteredQueue;
-                        while (!waitingCommands.empty()) {
-                            PendingCommand command = waitingCommands.front();
-                            waitingCommands.pop();
-                            if (command.clientSocket != currentSocket) {
-                                filteredQueue.push(command);
-                            }
-                        }
-                        waitingCommands = filteredQueue;
-                        
-                        // Clean up client data
-                        close(currentSocket);
-                        FD_CLR(currentSocket, &masterSocketSet);
-                        clientInputBuffers.erase(currentSocket);
-                        clientInputState.erase(currentSocket);
-                        pointsToRead.erase(currentSocket);
-                        pointsAlreadyRead.erase(currentSocket);
+                        LOG_INFO("Client " << currentSocket << " disconnected");
+                        disconnectClient(currentSocket, masterSocketSet);
                     } else {
-                        // Process received data
-                        dataBuffer[bytesReceived] = '\0';
-                        clientInputBuffers[currentSocket] += string(dataBuffer);
-                        
-                        // Process complete lines
-                        string& clientBuffer = clientInputBuffers[currentSocket];
-                        size_t newlinePosition;
+                        // Process complete lines in place
+                        clientBuffer.commit(bytesReceived);
+                        stats::addBytesIn(bytesReceived);
+                        string_view commandLine;
                         
-                        while ((newlinePosition = clientBuffer.find('\n')) != string::npos) {
-                            string commandLine = clientBuffer.substr(0, newlinePosition);
-                            clientBuffer.erase(0, newlinePosition + 1);
-                            
+                        while (clientBuffer.nextLine(commandLine)) {
                             handleClientCommand(currentSocket, commandLine);
                         }
                     }
                 }
             }
         }
+        
+        serviceSnapshots();
+        
+        // Replies from this round, including ones to clients whose queued commands ran
+        flushClientResponses();
+        while (!clientsToDrop.empty()) {
+            int clientSocket = *clientsToDrop.begin();
+            LOG_ERROR("Dropping client " << clientSocket << ": send failed or replies not read");
+            disconnectClient(clientSocket, masterSocketSet);
+            flushClientResponses();   // For the commands that were waiting on it
+        }
+        
+        if (drain.finished()) {
+            cout << "Drained after handoff" << endl;
+            break;
+        }
     }
     
-    close(serverSocket);
+    if (serverSocket >= 0) close(serverSocket);
+    walLog.stop();
     return 0;
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "Reactor.hpp"
+#include "../common/log.hpp"
 #include <sys/select.h>
 #include <unistd.h>
 #include <iostream>
@@ -16,29 +17,29 @@ void Reactor::start() {
     if (!running) {
         running = true;
         reactorThread = std::thread(&Reactor::reactorLoop, this);
-        std::cout << "[Reactor] Started reactor loop" << std::endl;
+        LOG_INFO("[Reactor] Started reactor loop");
     }
 }
 
 int Reactor::addFd(int fd, reactorFunc func) {
     if (fd < 0 || !func) {
-        std::cerr << "[Reactor] Error: Invalid fd or function" << std::endl;
+        LOG_ERROR("[Reactor] Error: Invalid fd or function");
         return -1;
     }
     
     std::lock_guard<std::mutex> lock(reactorMutex);
-    std::cout << "[Reactor] Adding fd " << fd << " to reactor" << std::endl;
+    LOG_DEBUG("[Reactor] Adding fd " << fd << " to reactor");
     fdFuncMap[fd] = func;
     return 0;
 }
 
 int Reactor::removeFd(int fd) {
     std::lock_guard<std::mutex> lock(reactorMutex);
-    std::cout << "[Reactor] Removing fd " << fd << " from reactor" << std::endl;
+    LOG_DEBUG("[Reactor] Removing fd " << fd << " from reactor");
     
     auto it = fdFuncMap.find(fd);
     if (it == fdFuncMap.end()) {
-        std::cerr << "[Reactor] Warning: fd " << fd << " not found in reactor" << std::endl;
+        LOG_WARN("[Reactor] Warning: fd " << fd << " not found in reactor");
         return -1;
     }
     
@@ -48,27 +49,45 @@ int Reactor::removeFd(int fd) {
 
 int Reactor::stop() {
     if (running) {
-        std::cout << "[Reactor] Stopping reactor..." << std::endl;
+        LOG_INFO("[Reactor] Stopping reactor...");
         running = false;
         
         if (reactorThread.joinable()) {
             reactorThread.join();
         }
-        std::cout << "[Reactor] Reactor stopped" << std::endl;
+        LOG_INFO("[Reactor] Reactor stopped");
     }
     return 0;
 }
 
+int Reactor::addWriteFd(int fd, reactorFunc func) {
+    if (fd < 0 || !func) {
+        LOG_ERROR("[Reactor] Error: Invalid fd or function");
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(reactorMutex);
+    LOG_DEBUG("[Reactor] Watching fd " << fd << " for writability");
+    writeFuncMap[fd] = func;
+    return 0;
+}
+
+int Reactor::removeWriteFd(int fd) {
+    std::lock_guard<std::mutex> lock(reactorMutex);
+    return writeFuncMap.erase(fd) == 1 ? 0 : -1;
+}
+
 bool Reactor::isRunning() const {
     return running;
 }
 
 void Reactor::reactorLoop() {
-    std::cout << "[Reactor] Reactor loop started" << std::endl;
+    LOG_INFO("[Reactor] Reactor loop started");
     
     while (running) {
-        fd_set readfds;
+        fd_set readfds, writefds;
         FD_ZERO(&readfds);
+        FD_ZERO(&writefds);
         int maxfd = -1;
 
         // Build the fd_set from our map
@@ -87,12 +106,18 @@ void Reactor::reactorLoop() {
                     maxfd = fd;
                 }
             }
+            for (const auto& [fd, func] : writeFuncMap) {
+                FD_SET(fd, &writefds);
+                if (fd > maxfd) {
+                    maxfd = fd;
+                }
+            }
         }
 
         // Set timeout to 1 second (reduced CPU usage)
         timeval tv = {1, 0};
         
-        int activity = select(maxfd + 1, &readfds, nullptr, nullptr, &tv);
+        int activity = select(maxfd + 1, &readfds, &writefds, nullptr, &tv);
         
         // Handle select errors
         if (activity < 0) {
@@ -111,28 +136,43 @@ void Reactor::reactorLoop() {
         }
 
         // Create a copy of the map to avoid holding the lock during callbacks
-        std::map<int, reactorFunc> tmpMap;
+        std::map<int, reactorFunc> tmpMap, tmpWriteMap;
         {
             std::lock_guard<std::mutex> lock(reactorMutex);
             tmpMap = fdFuncMap;
+            tmpWriteMap = writeFuncMap;
+        }
+
+        // Writable first: draining a reply can make room before the next read adds to it
+        for (const auto& [fd, func] : tmpWriteMap) {
+            if (FD_ISSET(fd, &writefds)) {
+                LOG_DEBUG("[Reactor] fd " << fd << " is writable, calling handler");
+
+                try {
+                    func(fd);
+                } catch (const std::exception& e) {
+                    LOG_ERROR("[Reactor] Exception in write handler for fd " << fd << ": " << e.what());
+                } catch (...) {
+                    LOG_ERROR("[Reactor] Unknown exception in write handler for fd " << fd);
+                }
+            }
         }
 
         // Check which file descriptors are ready and call their handlers
         for (const auto& [fd, func] : tmpMap) {
             if (FD_ISSET(fd, &readfds)) {
-                std::cout << "[Reactor] fd " << fd << " is ready, calling handler" << std::endl;
+                LOG_DEBUG("[Reactor] fd " << fd << " is ready, calling handler");
                 
                 try {
                     func(fd);
                 } catch (const std::exception& e) {
-                    std::cerr << "[Reactor] Exception in handler for fd " << fd 
-                              << ": " << e.what() << std::endl;
+                    LOG_ERROR("[Reactor] Exception in handler for fd " << fd << ": " << e.what());
                 } catch (...) {
-                    std::cerr << "[Reactor] Unknown exception in handler for fd " << fd << std::endl;
+                    LOG_ERROR("[Reactor] Unknown exception in handler for fd " << fd);
                 }
             }
         }
     }
     
-    std::cout << "[Reactor] Reactor loop ended" << std::endl;
+    LOG_INFO("[Reactor] Reactor loop ended");
 }
\ No newline at end of file
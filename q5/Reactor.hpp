@@ -11,12 +11,14 @@
  * 
  * This class allows you to register file descriptors and corresponding callback functions.
  * When any of the registered file descriptors becomes readable, the associated function is called.
+ * A descriptor can also be watched for writability, e.g. while a reply waits for a full socket.
  */
 typedef std::function<void(int)> reactorFunc;
 
 class Reactor {
 private:
     std::map<int, reactorFunc> fdFuncMap;    ///< Maps file descriptors to their handler functions
+    std::map<int, reactorFunc> writeFuncMap; ///< Descriptors watched for writability, and their handlers
     std::atomic<bool> running;               ///< Indicates whether the reactor is currently running
     std::thread reactorThread;               ///< Background thread running the reactor loop
     std::mutex reactorMutex;                 ///< Protects fdFuncMap from concurrent access
@@ -60,6 +62,23 @@ public:
      */
     int removeFd(int fd);
 
+    /**
+     * @brief Calls func whenever fd is writable, until removeWriteFd(fd).
+     * 
+     * @param fd    File descriptor to monitor.
+     * @param func  Callback function to call when fd is ready for writing.
+     * @return int  0 on success, -1 on error.
+     */
+    int addWriteFd(int fd, reactorFunc func);
+
+    /**
+     * @brief Stops watching fd for writability; its read handler is kept.
+     * 
+     * @param fd    File descriptor to remove.
+     * @return int  0 on success, -1 if fd was not watched.
+     */
+    int removeWriteFd(int fd);
+
     /**
      * @brief Stops the reactor loop and joins the background thread.
      * 
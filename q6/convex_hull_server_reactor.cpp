@@ -3,6 +3,7 @@
  * --------------------------------------------------------------------
  * This server handles multiple clients using the Reactor pattern from step 5.
  * It implements all command logic from step 4: Newgraph, Newpoint, Removepoint, CH.
+ * "Newgraph n bulk" takes the whole point block in one pass with a single reply.
  * Uses a shared graph, client input states, and command queuing with proper locking.
  * All race conditions fixed with proper mutex protection.
  */
@@ -20,138 +21,239 @@
 #include <sstream>
 #include <map>
 #include <queue>
+#include <set>
 #include <mutex>
 #include <netinet/in.h>
 #include <unistd.h>
 #include <cstring>
+#include <string_view>
+#include <charconv>
 #include "../q5/Reactor.hpp"
+#include "../common/convex_hull.hpp"
+#include "../common/line_buffer.hpp"
+#include "../common/point_parser.hpp"
+#include "../common/response_buffer.hpp"
+#include "../common/log.hpp"
+#include "../common/stats.hpp"
+#include "../common/hull_cache.hpp"
+#include "../common/metrics_http.hpp"
+#include "../common/snapshot.hpp"
+#include "../common/wal.hpp"
+#include "../common/hot_restart.hpp"
+#include "../common/lock_profiler.hpp"
+#include "../common/trace.hpp"
 
 using namespace std;
 
 #define PORT 9034
-#define MAX_BUFFER_SIZE 1024
+#define RECV_BUFFER_SIZE (64 * 1024)
+#define MAX_REPORTED_ERRORS 10
 
-// Basic point structure
-struct Point {
-    double x, y;
-    Point() : x(0), y(0) {}
-    Point(double x, double y) : x(x), y(y) {}
-};
+using hull::Point;
 
 // Represents a command that must wait for access to the shared graph
 struct PendingCommand {
     int clientSocket;
     string commandText;
-    PendingCommand(int socket, const string& command) : clientSocket(socket), commandText(command) {}
+    uint64_t traceId;    // Non-zero if the command is being traced
+    uint64_t queuedAt;   // trace::mark() when it was queued
+    PendingCommand(int socket, string_view command, uint64_t traceId = 0)
+        : clientSocket(socket), commandText(command), traceId(traceId), queuedAt(trace::mark()) {}
 };
 
 // Global state with proper mutex protection
 vector<Point> sharedGraphPoints;
 bool isGraphLocked = false;
 int lockingClientSocket = -1;
-mutex globalStateMutex;  // Protects all global state
+HullCache hullCache;     // Last CH area, valid until the graph changes
+snapshot::BackgroundSaver snapshotSaver(snapshot::pathFromEnv(), snapshot::intervalFromEnv());
+wal::Log walLog(wal::pathFromEnv(), wal::durabilityFromEnv(), wal::commitWindowFromEnv());
+handoff::WriteGate writeGate;   // Closed once the graph is handed to a new process
+lockprof::Mutex globalStateMutex("globalStateMutex");  // Protects all global state
 
 // Per-client tracking with mutex protection
 map<int, int> clientInputState;      // 0: normal, 1: reading points
 map<int, int> pointsToRead;
 map<int, int> pointsAlreadyRead;
-map<int, string> clientBuffers;
-mutex clientDataMutex;  // Protects client tracking data
+map<int, LineBuffer> clientBuffers;
+map<int, bool> clientBulkMode;                // Newgraph n bulk in progress
+map<int, vector<string>> clientBulkErrors;    // Per-line errors of the current bulk block
+map<int, vector<Point>> clientBulkPoints;     // The bulk block read so far, applied once complete
+lockprof::Mutex clientDataMutex("clientDataMutex");  // Protects client tracking data
 
 // Command queue with mutex protection
 queue<PendingCommand> waitingCommands;
-mutex commandQueueMutex;  // Protects the waiting commands queue
+lockprof::Mutex commandQueueMutex("commandQueueMutex");  // Protects the waiting commands queue
+
+// Replies queued per client, written once at the end of each reactor callback.
+// Separate mutex: replies are queued while clientDataMutex is already held.
+map<int, ResponseBuffer> clientResponses;
+set<int> clientsWithReplies;     // Queued a reply since the last flush
+set<int> clientsAwaitingWrite;   // Socket full; the reactor flushes them once writable
+set<int> clientsToDrop;          // Not reading their replies; closed by the next flush
+lockprof::Mutex responseMutex("responseMutex");
 
 Reactor reactor;
 int serverSocket;
 
 // Forward declarations
-void executeClientCommand(int clientSocket, const string& command);
+void executeClientCommand(int clientSocket, string_view command);
 void processWaitingCommands();
 
 // Utility functions
-Point parsePointFromString(const string& pointString) {
-    try {
-        size_t comma = pointString.find(',');
-        if (comma == string::npos) {
-            throw invalid_argument("Invalid point format: missing comma");
-        }
-        
-        string xStr = pointString.substr(0, comma);
-        string yStr = pointString.substr(comma + 1);
-        
-        // Remove whitespace
-        xStr.erase(remove_if(xStr.begin(), xStr.end(), ::isspace), xStr.end());
-        yStr.erase(remove_if(yStr.begin(), yStr.end(), ::isspace), yStr.end());
-        
-        if (xStr.empty() || yStr.empty()) {
-            throw invalid_argument("Invalid point format: empty coordinate");
-        }
-        
-        double x = stod(xStr);
-        double y = stod(yStr);
-        
-        return Point(x, y);
-    } catch (const exception& e) {
-        throw invalid_argument("Invalid point format: " + string(e.what()));
+// Parse the arguments of "Newgraph n [bulk]"
+bool parseNewgraphArguments(string_view args, int& numPoints, bool& bulk) {
+    args = LineBuffer::trim(args);
+    auto [end, ec] = from_chars(args.data(), args.data() + args.size(), numPoints);
+    if (ec != errc() || numPoints <= 0) return false;
+
+    string_view mode = LineBuffer::trim(args.substr(end - args.data()));
+    bulk = (mode == "bulk");
+    return bulk || mode.empty();
+}
+
+/**
+ * Bulk upload: parse point lines straight from the receive buffer in one pass.
+ * Only complete lines are consumed and blank lines are skipped. A malformed line
+ * still counts towards the block so client and server stay in step; it is
+ * recorded in errors by its 1-based position in the block.
+ */
+void parsePointBlock(LineBuffer& input, int pointsToRead, int& pointsRead,
+                     vector<Point>& points, vector<string>& errors) {
+    vector<LineError> lineErrors;
+    size_t linesParsed;
+    input.consume(parsePointLines(input.completeLines(), pointsToRead - pointsRead, points, lineErrors, linesParsed));
+
+    for (const LineError& error : lineErrors) {
+        errors.push_back("line " + to_string(pointsRead + error.line) + ": " + parseErrorMessage(error.status));
     }
+    pointsRead += linesParsed;
 }
 
+// Single acknowledgement for a bulk upload: accepted count plus per-line errors
+string bulkUploadSummary(int pointsRead, const vector<string>& errors) {
+    string summary = "Graph created with " + to_string(pointsRead - (int)errors.size()) + " points";
+    if (errors.empty()) return summary;
+
+    summary += " (" + to_string(errors.size()) + " rejected: ";
+    for (size_t i = 0; i < errors.size() && i < MAX_REPORTED_ERRORS; i++) {
+        if (i > 0) summary += "; ";
+        summary += errors[i];
+    }
+    if (errors.size() > MAX_REPORTED_ERRORS) summary += "; ...";
+    return summary + ")";
+}
+
+// Queue a reply; it is written by the next flushClientResponses()
 void sendMessageToClient(int clientSocket, const string& msg) {
-    string formatted = msg + "\n";
-    ssize_t sent = send(clientSocket, formatted.c_str(), formatted.size(), 0);
-    if (sent < 0) {
-        cerr << "[sendMessageToClient] Error sending to socket " << clientSocket 
-             << ": " << strerror(errno) << endl;
-        return;
+    {
+        lockprof::Guard responseLock(responseMutex);
+        auto it = clientResponses.find(clientSocket);
+        if (it == clientResponses.end()) {
+            LOG_WARN("[sendMessageToClient] Dropping message for closed socket " << clientSocket);
+            return;
+        }
+        if (!it->second.append(msg)) clientsToDrop.insert(clientSocket);
+        clientsWithReplies.insert(clientSocket);
     }
-    cout << "[sendMessageToClient] socket=" << clientSocket << ", message=\"" << msg << "\"" << endl;
+    stats::addBytesOut(msg.size() + 1);
+    LOG_DEBUG("[sendMessageToClient] socket=" << clientSocket << ", message=\"" << msg << "\"");
 }
 
-double crossProduct(const Point& o, const Point& a, const Point& b) {
-    return (a.x - o.x)*(b.y - o.y) - (a.y - o.y)*(b.x - o.x);
+void handleClientWritable(int clientSocket);
+void cleanupClient(int clientSocket);
+
+// Write the queued replies, one send per client, once the changes they acknowledge are logged.
+// Never waits for a full socket: the rest goes out from handleClientWritable()
+void flushClientResponses() {
+    walLog.waitDurable();
+    uint64_t started = trace::mark();
+    vector<int> failed;
+    {
+        lockprof::Guard responseLock(responseMutex);
+        for (int clientSocket : clientsWithReplies) {
+            auto it = clientResponses.find(clientSocket);
+            if (it == clientResponses.end() || clientsAwaitingWrite.count(clientSocket)) continue;
+            if (!it->second.flush()) {
+                clientsToDrop.insert(clientSocket);
+            } else if (it->second.pending() > 0) {
+                clientsAwaitingWrite.insert(clientSocket);
+                reactor.addWriteFd(clientSocket, handleClientWritable);
+            }
+        }
+        clientsWithReplies.clear();
+        failed.assign(clientsToDrop.begin(), clientsToDrop.end());
+        clientsToDrop.clear();
+    }
+    trace::sent(started);
+
+    // Dropping a client may run commands that were waiting for it, so flush again after
+    for (int clientSocket : failed) {
+        LOG_ERROR("[flushClientResponses] Dropping socket " << clientSocket << ": send failed or replies not read");
+        cleanupClient(clientSocket);
+    }
+    if (!failed.empty()) flushClientResponses();
 }
 
-vector<Point> computeConvexHull(vector<Point> pts) {
-    if (pts.size() <= 1) return pts;
-    
-    sort(pts.begin(), pts.end(), [](const Point& a, const Point& b) {
-        return (a.x != b.x) ? a.x < b.x : a.y < b.y;
-    });
+// A full socket has room again: send more of its queued replies
+void handleClientWritable(int clientSocket) {
+    bool sent;
+    {
+        lockprof::Guard responseLock(responseMutex);
+        auto it = clientResponses.find(clientSocket);
+        if (it == clientResponses.end()) {
+            reactor.removeWriteFd(clientSocket);
+            return;
+        }
+        sent = it->second.flush();
+        if (!sent || it->second.pending() == 0) {
+            clientsAwaitingWrite.erase(clientSocket);
+            reactor.removeWriteFd(clientSocket);
+        }
+    }
+    if (!sent) {
+        LOG_ERROR("[handleClientWritable] Dropping socket " << clientSocket << ": " << strerror(errno));
+        cleanupClient(clientSocket);
+        flushClientResponses();
+    }
+}
 
-    vector<Point> hull;
-    // Build lower hull
-    for (const Point& p : pts) {
-        while (hull.size() >= 2 && crossProduct(hull[hull.size()-2], hull[hull.size()-1], p) <= 0)
-            hull.pop_back();
-        hull.push_back(p);
+// Record a change to the shared graph; call with globalStateMutex held
+void graphChanged() {
+    hullCache.invalidate();
+    stats::graphPoints.store(sharedGraphPoints.size(), memory_order_relaxed);
+    snapshotSaver.graphChanged();
+}
+
+// Fork a background save of the graph; call with globalStateMutex held. The reply for SAVE
+string startSnapshot() {
+    if (!snapshotSaver.start(sharedGraphPoints, walLog.lastLsn())) {
+        return errno == EBUSY ? "Error: Snapshot already in progress" : "Error: Snapshot failed: " + string(strerror(errno));
     }
-    
-    // Build upper hull
-    size_t lower = hull.size();
-    for (int i = pts.size()-2; i >= 0; i--) {
-        while (hull.size() > lower && crossProduct(hull[hull.size()-2], hull[hull.size()-1], pts[i]) <= 0)
-            hull.pop_back();
-        hull.push_back(pts[i]);
-    }
-    if (hull.size() > 1) hull.pop_back();
-    return hull;
+    walLog.rotate();   // Changes from here on go to a segment the snapshot does not cover
+    LOG_INFO("[Snapshot] Started for " << sharedGraphPoints.size() << " points");
+    return "Snapshot started (" + to_string(sharedGraphPoints.size()) + " points)";
 }
 
-double calculatePolygonArea(const vector<Point>& poly) {
-    if (poly.size() < 3) return 0.0;
-    
-    double area = 0;
-    for (size_t i = 0; i < poly.size(); i++) {
-        size_t j = (i + 1) % poly.size();
-        area += poly[i].x * poly[j].y - poly[j].x * poly[i].y;
+// Reap a finished save, then start the periodic one if it is due and no upload is in progress
+void serviceSnapshots() {
+    int finished = snapshotSaver.poll();
+    if (finished > 0) {
+        LOG_INFO("[Snapshot] Saved to " << snapshotSaver.file() << ": " << snapshotSaver.lastSavedPoints()
+                 << " points in " << snapshotSaver.lastSaveMillis() << " ms");
+        walLog.discardUpTo(snapshotSaver.lastSavedLsn());
+    } else if (finished < 0) {
+        LOG_ERROR("[Snapshot] Saving to " << snapshotSaver.file() << " failed");
+    }
+    if (snapshotSaver.due() && !writeGate.frozen()) {
+        stats::TimedLockGuard<lockprof::Mutex> stateLock(globalStateMutex);
+        if (!isGraphLocked) startSnapshot();
     }
-    return fabs(area) / 2.0;
 }
 
 void processWaitingCommands() {
-    lock_guard<mutex> queueLock(commandQueueMutex);
-    lock_guard<mutex> stateLock(globalStateMutex);
+    lockprof::Guard queueLock(commandQueueMutex);
+    stats::TimedLockGuard<lockprof::Mutex> stateLock(globalStateMutex);
     
     while (!waitingCommands.empty() && !isGraphLocked) {
         auto cmd = waitingCommands.front();
@@ -160,68 +262,109 @@ void processWaitingCommands() {
         // Execute command without holding locks (recursive call protection)
         globalStateMutex.unlock();
         commandQueueMutex.unlock();
-        executeClientCommand(cmd.clientSocket, cmd.commandText);
+        {
+            trace::Request traced(cmd.commandText, cmd.clientSocket, cmd.traceId);
+            if (traced.sampled()) traced.asyncPhase("queue_wait", cmd.queuedAt, trace::nowNanos());
+            executeClientCommand(cmd.clientSocket, cmd.commandText);
+        }
         commandQueueMutex.lock();
         globalStateMutex.lock();
     }
 }
 
-void executeClientCommand(int clientSocket, const string& command) {
-    cout << "[executeClientCommand] socket=" << clientSocket << ", command='" << command << "'" << endl;
+void executeClientCommand(int clientSocket, string_view command) {
+    LOG_DEBUG("[executeClientCommand] socket=" << clientSocket << ", command='" << command << "'");
+
+    // A command queued before a handoff runs after it
+    if (writeGate.frozen() && handoff::mutates(stats::classifyCommand(command, false))) {
+        sendMessageToClient(clientSocket, handoff::FROZEN_REPLY);
+        return;
+    }
 
     try {
         if (command.substr(0, 9) == "Newgraph ") {
             int n;
-            try {
-                n = stoi(command.substr(9));
-                if (n <= 0) {
-                    throw invalid_argument("Number of points must be positive");
-                }
-            } catch (const exception& e) {
+            bool bulk;
+            trace::Phase parsing("parse");
+            bool valid = parseNewgraphArguments(command.substr(9), n, bulk);
+            parsing.end();
+            if (!valid) {
                 sendMessageToClient(clientSocket, "Error: Invalid number of points");
                 return;
             }
             
             {
-                lock_guard<mutex> stateLock(globalStateMutex);
-                lock_guard<mutex> clientLock(clientDataMutex);
+                stats::TimedLockGuard<lockprof::Mutex> stateLock(globalStateMutex);
+                lockprof::Guard clientLock(clientDataMutex);
                 
                 isGraphLocked = true;
                 lockingClientSocket = clientSocket;
-                sharedGraphPoints.clear();
+                // A bulk block replaces the graph when complete, so a broken upload changes nothing
+                if (!bulk) {
+                    sharedGraphPoints.clear();
+                    walLog.append(wal::RECORD_CLEAR);
+                    graphChanged();
+                }
                 
                 clientInputState[clientSocket] = 1;
                 pointsToRead[clientSocket] = n;
                 pointsAlreadyRead[clientSocket] = 0;
+                clientBulkMode[clientSocket] = bulk;
+                clientBulkErrors[clientSocket].clear();
+                clientBulkPoints[clientSocket].clear();
             }
             
-            sendMessageToClient(clientSocket, "Enter " + to_string(n) + " points (x,y):");
+            // Bulk uploads are acknowledged once, after the whole block
+            if (!bulk) {
+                sendMessageToClient(clientSocket, "Enter " + to_string(n) + " points (x,y):");
+            }
             
         } else if (command == "CH") {
+            // Served from the cache until the graph changes
+            double area = 0.0;
+            uint64_t version = 0;
             vector<Point> pointsCopy;
+            bool cached;
             {
-                lock_guard<mutex> stateLock(globalStateMutex);
-                pointsCopy = sharedGraphPoints;
+                stats::TimedLockGuard<lockprof::Mutex> stateLock(globalStateMutex);
+                cached = hullCache.lookup(area);
+                if (!cached) {
+                    version = hullCache.currentVersion();
+                    pointsCopy = sharedGraphPoints;
+                }
             }
+            stats::recordHullCache(cached);
             
-            if (pointsCopy.size() < 3) {
-                sendMessageToClient(clientSocket, "0.0");
-            } else {
-                auto hull = computeConvexHull(pointsCopy);
-                double area = calculatePolygonArea(hull);
-                ostringstream out;
-                out << fixed << setprecision(1) << area;
-                sendMessageToClient(clientSocket, out.str());
+            if (!cached) {
+                {
+                    trace::Phase computing("hull_compute");
+                    area = pointsCopy.size() < 3 ? 0.0 : hull::convexHullArea(pointsCopy);
+                }
+                stats::TimedLockGuard<lockprof::Mutex> stateLock(globalStateMutex);
+                hullCache.store(version, area);
             }
             
+            ostringstream out;
+            out << fixed << setprecision(1) << area;
+            sendMessageToClient(clientSocket, out.str());
+            
         } else if (command.substr(0, 9) == "Newpoint ") {
-            Point p = parsePointFromString(command.substr(9));
+            Point p;
+            trace::Phase parsing("parse");
+            ParseStatus status = parsePoint(command.substr(9), p.x, p.y);
+            parsing.end();
+            if (status != ParseStatus::Ok) {
+                sendMessageToClient(clientSocket, "Error: " + parseErrorMessage(status));
+                return;
+            }
             
             {
-                lock_guard<mutex> stateLock(globalStateMutex);
+                stats::TimedLockGuard<lockprof::Mutex> stateLock(globalStateMutex);
                 isGraphLocked = true;
                 lockingClientSocket = clientSocket;
                 sharedGraphPoints.push_back(p);
+                walLog.append(wal::RECORD_ADD, p.x, p.y);
+                graphChanged();
                 isGraphLocked = false;
                 lockingClientSocket = -1;
             }
@@ -230,18 +373,27 @@ void executeClientCommand(int clientSocket, const string& command) {
             processWaitingCommands();
             
         } else if (command.substr(0, 12) == "Removepoint ") {
-            Point p = parsePointFromString(command.substr(12));
+            Point p;
+            trace::Phase parsing("parse");
+            ParseStatus status = parsePoint(command.substr(12), p.x, p.y);
+            parsing.end();
+            if (status != ParseStatus::Ok) {
+                sendMessageToClient(clientSocket, "Error: " + parseErrorMessage(status));
+                return;
+            }
             bool found = false;
             
             {
-                lock_guard<mutex> stateLock(globalStateMutex);
+                stats::TimedLockGuard<lockprof::Mutex> stateLock(globalStateMutex);
                 isGraphLocked = true;
                 lockingClientSocket = clientSocket;
                 
                 for (int i = sharedGraphPoints.size()-1; i >= 0; --i) {
                     if (fabs(sharedGraphPoints[i].x - p.x) < 1e-9 && 
                         fabs(sharedGraphPoints[i].y - p.y) < 1e-9) {
+                        walLog.append(wal::RECORD_REMOVE, sharedGraphPoints[i].x, sharedGraphPoints[i].y, i);
                         sharedGraphPoints.erase(sharedGraphPoints.begin() + i);
+                        graphChanged();
                         found = true;
                         break;
                     }
@@ -254,6 +406,15 @@ void executeClientCommand(int clientSocket, const string& command) {
             sendMessageToClient(clientSocket, found ? "Point removed" : "Point not found");
             processWaitingCommands();
             
+        } else if (command == "SAVE") {
+            // The snapshot is written by a forked child; only the fork holds the lock
+            string reply;
+            {
+                stats::TimedLockGuard<lockprof::Mutex> stateLock(globalStateMutex);
+                reply = startSnapshot();
+            }
+            sendMessageToClient(clientSocket, reply);
+            
         } else {
             sendMessageToClient(clientSocket, "Error: Unknown command");
         }
@@ -262,7 +423,7 @@ void executeClientCommand(int clientSocket, const string& command) {
         
         // If we were in the middle of a graph operation, unlock
         {
-            lock_guard<mutex> stateLock(globalStateMutex);
+            stats::TimedLockGuard<lockprof::Mutex> stateLock(globalStateMutex);
             if (lockingClientSocket == clientSocket) {
                 isGraphLocked = false;
                 lockingClientSocket = -1;
@@ -272,29 +433,62 @@ void executeClientCommand(int clientSocket, const string& command) {
     }
 }
 
-void handleClientCommand(int clientSocket, const string& input) {
-    cout << "[handleClientCommand] socket=" << clientSocket << ", input=\"" << input << "\"" << endl;
+void handleClientCommand(int clientSocket, string_view command) {
+    LOG_DEBUG("[handleClientCommand] socket=" << clientSocket << ", input=\"" << command << "\"");
 
-    string command = input;
-    while (!command.empty() && isspace(command.back())) command.pop_back();
     if (command.empty()) return;
 
     try {
         // Check if client is in point-reading mode
         bool inPointMode = false;
         {
-            lock_guard<mutex> clientLock(clientDataMutex);
+            lockprof::Guard clientLock(clientDataMutex);
             inPointMode = (clientInputState[clientSocket] == 1);
         }
+        stats::Command kind = stats::classifyCommand(command, inPointMode);
+        stats::CommandTimer timer(kind);
+        trace::Request traced(command, clientSocket);
+
+        // After a handoff the graph belongs to the new process; this one only reads it
+        handoff::WriteGate::Pass pass(writeGate, handoff::mutates(kind));
+        if (!pass) {
+            if (inPointMode) {
+                {
+                    stats::TimedLockGuard<lockprof::Mutex> stateLock(globalStateMutex);
+                    lockprof::Guard clientLock(clientDataMutex);
+                    clientInputState[clientSocket] = 0;
+                    isGraphLocked = false;
+                    lockingClientSocket = -1;
+                }
+                processWaitingCommands();
+            }
+            sendMessageToClient(clientSocket, handoff::FROZEN_REPLY);
+            return;
+        }
         
         if (inPointMode) {
-            Point p = parsePointFromString(command);
+            Point p;
+            trace::Phase parsing("parse");
+            ParseStatus status = parsePoint(command, p.x, p.y);
+            parsing.end();
+            if (status != ParseStatus::Ok) {
+                int nextPoint;
+                {
+                    lockprof::Guard clientLock(clientDataMutex);
+                    nextPoint = pointsAlreadyRead[clientSocket] + 1;
+                }
+                sendMessageToClient(clientSocket, "Error: " + parseErrorMessage(status));
+                sendMessageToClient(clientSocket, "Please enter point " + to_string(nextPoint) + " again (x,y):");
+                return;
+            }
             
             {
-                lock_guard<mutex> stateLock(globalStateMutex);
-                lock_guard<mutex> clientLock(clientDataMutex);
+                stats::TimedLockGuard<lockprof::Mutex> stateLock(globalStateMutex);
+                lockprof::Guard clientLock(clientDataMutex);
                 
                 sharedGraphPoints.push_back(p);
+                walLog.append(wal::RECORD_ADD, p.x, p.y);
+                graphChanged();
                 pointsAlreadyRead[clientSocket]++;
                 
                 int currentPoints = pointsAlreadyRead[clientSocket];
@@ -313,7 +507,7 @@ void handleClientCommand(int clientSocket, const string& input) {
             
             // Check if we finished reading points
             {
-                lock_guard<mutex> clientLock(clientDataMutex);
+                lockprof::Guard clientLock(clientDataMutex);
                 if (pointsAlreadyRead[clientSocket] >= pointsToRead[clientSocket]) {
                     processWaitingCommands();
                 }
@@ -321,21 +515,36 @@ void handleClientCommand(int clientSocket, const string& input) {
             return;
         }
 
+        // STATS and LOCKS never touch the graph, so they are answered even while the graph is locked
+        if (command == "STATS") {
+            for (const string& line : stats::formatReport(stats::collect())) {
+                sendMessageToClient(clientSocket, line);
+            }
+            return;
+        }
+        if (command == "LOCKS") {
+            for (const string& line : lockprof::formatReport()) {
+                sendMessageToClient(clientSocket, line);
+            }
+            return;
+        }
+
         // Handle regular commands
         bool needsLock = command == "CH" || command.substr(0,9) == "Newgraph " ||
-                        command.substr(0,9) == "Newpoint " || command.substr(0,12) == "Removepoint ";
+                        command.substr(0,9) == "Newpoint " || command.substr(0,12) == "Removepoint " ||
+                        command == "SAVE";
                       
         if (needsLock) {
             bool shouldQueue = false;
             {
-                lock_guard<mutex> stateLock(globalStateMutex);
+                stats::TimedLockGuard<lockprof::Mutex> stateLock(globalStateMutex);
                 shouldQueue = (isGraphLocked && lockingClientSocket != clientSocket);
             }
             
             if (shouldQueue) {
                 {
-                    lock_guard<mutex> queueLock(commandQueueMutex);
-                    waitingCommands.push(PendingCommand(clientSocket, command));
+                    lockprof::Guard queueLock(commandQueueMutex);
+                    waitingCommands.push(PendingCommand(clientSocket, command, traced.traceId()));
                 }
                 sendMessageToClient(clientSocket, "Command queued");
                 return;
@@ -350,7 +559,7 @@ void handleClientCommand(int clientSocket, const string& input) {
         bool inPointMode = false;
         int nextPoint = 0;
         {
-            lock_guard<mutex> clientLock(clientDataMutex);
+            lockprof::Guard clientLock(clientDataMutex);
             inPointMode = (clientInputState[clientSocket] == 1);
             nextPoint = pointsAlreadyRead[clientSocket] + 1;
         }
@@ -362,12 +571,75 @@ void handleClientCommand(int clientSocket, const string& input) {
     }
 }
 
+bool isClientInBulkUpload(int clientSocket) {
+    lockprof::Guard clientLock(clientDataMutex);
+    return clientInputState[clientSocket] == 1 && clientBulkMode[clientSocket];
+}
+
+// Consume as much of a bulk point block as the buffer holds
+void handleBulkPointBlock(int clientSocket, LineBuffer& input) {
+    int pointsRead, totalPoints;
+    {
+        lockprof::Guard clientLock(clientDataMutex);
+        pointsRead = pointsAlreadyRead[clientSocket];
+        totalPoints = pointsToRead[clientSocket];
+    }
+
+    vector<Point> block;
+    vector<string> errors;
+    int pointsBefore = pointsRead;
+    parsePointBlock(input, totalPoints, pointsRead, block, errors);
+    stats::countCommands(stats::CMD_POINT, pointsRead - pointsBefore);
+
+    // Past a handoff the finished block is dropped
+    handoff::WriteGate::Pass pass(writeGate, pointsRead >= totalPoints);
+    string summary;
+    {
+        stats::TimedLockGuard<lockprof::Mutex> stateLock(globalStateMutex);
+        lockprof::Guard clientLock(clientDataMutex);
+
+        vector<Point>& blockPoints = clientBulkPoints[clientSocket];
+        blockPoints.insert(blockPoints.end(), block.begin(), block.end());
+        pointsAlreadyRead[clientSocket] = pointsRead;
+        vector<string>& blockErrors = clientBulkErrors[clientSocket];
+        blockErrors.insert(blockErrors.end(), errors.begin(), errors.end());
+
+        if (pointsRead >= totalPoints) {
+            // The whole block replaces the graph at once
+            summary = handoff::FROZEN_REPLY;
+            if (pass) {
+                sharedGraphPoints.assign(blockPoints.begin(), blockPoints.end());
+                walLog.append(wal::RECORD_CLEAR);
+                walLog.appendPoints(blockPoints.begin(), blockPoints.end());
+                graphChanged();
+                summary = bulkUploadSummary(pointsRead, blockErrors);
+            }
+            blockPoints = vector<Point>();
+            blockErrors.clear();
+            clientInputState[clientSocket] = 0;
+            clientBulkMode[clientSocket] = false;
+            isGraphLocked = false;
+            lockingClientSocket = -1;
+        }
+    }
+
+    if (!summary.empty()) {
+        sendMessageToClient(clientSocket, summary);
+        processWaitingCommands();
+    }
+}
+
 void cleanupClient(int clientSocket) {
-    cout << "[cleanupClient] Cleaning up client " << clientSocket << endl;
+    {
+        lockprof::Guard responseLock(responseMutex);
+        if (clientResponses.count(clientSocket) == 0) return;   // Already cleaned up
+    }
+    LOG_INFO("[cleanupClient] Cleaning up client " << clientSocket);
+    stats::activeConnections.fetch_sub(1, memory_order_relaxed);
     
     // Release lock if this client holds it
     {
-        lock_guard<mutex> stateLock(globalStateMutex);
+        stats::TimedLockGuard<lockprof::Mutex> stateLock(globalStateMutex);
         if (lockingClientSocket == clientSocket) {
             isGraphLocked = false;
             lockingClientSocket = -1;
@@ -376,11 +648,21 @@ void cleanupClient(int clientSocket) {
     
     // Remove client from all tracking maps
     {
-        lock_guard<mutex> clientLock(clientDataMutex);
+        lockprof::Guard clientLock(clientDataMutex);
         clientBuffers.erase(clientSocket);
         clientInputState.erase(clientSocket);
         pointsToRead.erase(clientSocket);
         pointsAlreadyRead.erase(clientSocket);
+        clientBulkMode.erase(clientSocket);
+        clientBulkErrors.erase(clientSocket);
+        clientBulkPoints.erase(clientSocket);
+    }
+    {
+        lockprof::Guard responseLock(responseMutex);
+        clientResponses.erase(clientSocket);
+        clientsWithReplies.erase(clientSocket);
+        clientsToDrop.erase(clientSocket);
+        if (clientsAwaitingWrite.erase(clientSocket)) reactor.removeWriteFd(clientSocket);
     }
     
     // Remove client from reactor and close socket
@@ -396,113 +678,168 @@ void handleNewConnection(int fd) {
     socklen_t size = sizeof(addr);
     int client = accept(fd, (sockaddr*)&addr, &size);
     if (client < 0) {
-        cerr << "[handleNewConnection] Error accepting client: " << strerror(errno) << endl;
+        LOG_ERROR("[handleNewConnection] Error accepting client: " << strerror(errno));
         return;
     }
 
-    cout << "[handleNewConnection] New client connected: " << client << endl;
+    LOG_INFO("[handleNewConnection] New client connected: " << client);
     
     // Set non-blocking mode for client socket
     int flags = fcntl(client, F_GETFL, 0);
     if (flags == -1 || fcntl(client, F_SETFL, flags | O_NONBLOCK) == -1) {
-        cerr << "[handleNewConnection] Error setting non-blocking mode: " << strerror(errno) << endl;
+        LOG_ERROR("[handleNewConnection] Error setting non-blocking mode: " << strerror(errno));
         close(client);
         return;
     }
     
     // Initialize client state
     {
-        lock_guard<mutex> clientLock(clientDataMutex);
-        clientBuffers[client] = "";
+        lockprof::Guard clientLock(clientDataMutex);
+        clientBuffers.emplace(client, LineBuffer(RECV_BUFFER_SIZE));
         clientInputState[client] = 0;
         pointsToRead[client] = 0;
         pointsAlreadyRead[client] = 0;
+        clientBulkMode[client] = false;
     }
+    {
+        lockprof::Guard responseLock(responseMutex);
+        clientResponses.try_emplace(client, client);
+    }
+    stats::activeConnections.fetch_add(1, memory_order_relaxed);
 
     sendMessageToClient(client, "Convex Hull Server Ready");
-    sendMessageToClient(client, "Commands: Newgraph n, CH, Newpoint x,y, Removepoint x,y");
+    sendMessageToClient(client, "Commands: Newgraph n [bulk], CH, Newpoint x,y, Removepoint x,y, STATS, SAVE");
+    flushClientResponses();
 
     auto clientHandler = [](int fd) {
-        char buf[MAX_BUFFER_SIZE];
-        ssize_t bytes = recv(fd, buf, sizeof(buf)-1, 0);
+        // Only the reactor thread touches a client's buffer, and map nodes never move
+        LineBuffer* input;
+        {
+            lockprof::Guard clientLock(clientDataMutex);
+            auto it = clientBuffers.find(fd);
+            if (it == clientBuffers.end()) return;
+            input = &it->second;
+        }
+
+        if (!input->prepareWrite()) {
+            sendMessageToClient(fd, "Error: Line too long");
+            flushClientResponses();
+            cleanupClient(fd);
+            flushClientResponses();
+            return;
+        }
+
+        uint64_t recvStarted = trace::mark();
+        ssize_t bytes = recv(fd, input->writePtr(), input->writable(), 0);
+        trace::received(recvStarted);
         
         if (bytes <= 0) {
             if (bytes == 0) {
-                cout << "[clientHandler] Client " << fd << " disconnected normally" << endl;
+                LOG_INFO("[clientHandler] Client " << fd << " disconnected normally");
             } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
-                cout << "[clientHandler] Client " << fd << " disconnected with error: " 
-                     << strerror(errno) << endl;
+                LOG_ERROR("[clientHandler] Client " << fd << " disconnected with error: " << strerror(errno));
             } else {
                 // EAGAIN/EWOULDBLOCK - no data available, not an error
                 return;
             }
             
             cleanupClient(fd);
+            flushClientResponses();  // Waiting commands of other clients may have run
             return;
         }
 
-        buf[bytes] = '\0';
-        string input(buf);
-        cout << "[clientHandler] received from fd=" << fd << ": \"" << input << "\"" << endl;
+        input->commit(bytes);
+        stats::addBytesIn(bytes);
+        LOG_DEBUG("[clientHandler] received " << bytes << " bytes from fd=" << fd);
 
-        // Add to client buffer and process complete lines
-        {
-            lock_guard<mutex> clientLock(clientDataMutex);
-            clientBuffers[fd] += input;
-        }
-
-        string buffer;
-        {
-            lock_guard<mutex> clientLock(clientDataMutex);
-            buffer = clientBuffers[fd];
-        }
-
-        size_t pos;
-        while ((pos = buffer.find('\n')) != string::npos) {
-            string cmd = buffer.substr(0, pos);
-            buffer.erase(0, pos + 1);
-            
-            // Update client buffer
-            {
-                lock_guard<mutex> clientLock(clientDataMutex);
-                clientBuffers[fd] = buffer;
+        // Process complete lines in place
+        string_view cmd;
+        while (input->hasLine()) {
+            if (isClientInBulkUpload(fd)) {
+                handleBulkPointBlock(fd, *input);
+                continue;
             }
-            
-            // Clean command string
-            cmd.erase(0, cmd.find_first_not_of(" \t\r\n"));
-            cmd.erase(cmd.find_last_not_of(" \t\r\n") + 1);
-            
+
+            input->nextLine(cmd);
             if (!cmd.empty()) {
                 handleClientCommand(fd, cmd);
             }
-            
-            // Refresh buffer for next iteration
-            {
-                lock_guard<mutex> clientLock(clientDataMutex);
-                buffer = clientBuffers[fd];
-            }
         }
+
+        // Everything this read produced, for this client and any unblocked ones, in one send each
+        flushClientResponses();
     };
 
     if (reactor.addFd(client, clientHandler) != 0) {
-        cerr << "[handleNewConnection] Failed to add client to reactor" << endl;
+        LOG_ERROR("[handleNewConnection] Failed to add client to reactor");
         cleanupClient(client);
     }
 }
 
-int main() {
-    cout << "=== Convex Hull Server with Reactor Pattern ===" << endl;
-    
-    serverSocket = socket(AF_INET, SOCK_STREAM, 0);
+// Scrape connections on the metrics port; only the reactor thread touches them
+map<int, metrics::ScrapeConnection> scrapeConnections;
+
+void handleScrapeConnection(int fd) {
+    int scrape = accept(fd, nullptr, nullptr);
+    if (scrape < 0) return;
+
+    scrapeConnections.try_emplace(scrape);
+    auto scrapeHandler = [](int fd) {
+        auto it = scrapeConnections.find(fd);
+        if (it == scrapeConnections.end() || it->second.onReadable(fd)) {
+            reactor.removeFd(fd);
+            close(fd);
+            scrapeConnections.erase(fd);
+        }
+    };
+    if (reactor.addFd(scrape, scrapeHandler) != 0) {
+        close(scrape);
+        scrapeConnections.erase(scrape);
+    }
+}
+
+// Hot restart: the successor's end of the handoff socket, and the metrics listener if open
+handoff::Endpoint handoffEndpoint;
+handoff::Drain drain;
+int metricsSocket = -1;
+
+// A successor taking over; from then on it accepts and this process only drains
+void handleSuccessor(int fd) {
+    int successor = handoffEndpoint.accept();
+    if (successor < 0) return;
+    string error;
+    bool handedOver = handoff::handOver(successor, writeGate, walLog, sharedGraphPoints, serverSocket, metricsSocket, error);
+    close(successor);
+    if (!handedOver) {
+        cerr << "Handoff failed: " << error << endl;
+        return;
+    }
+
+    // Called on the reactor thread, so no callback is using the listeners
+    for (int listener : {serverSocket, metricsSocket, fd}) {
+        if (listener >= 0) reactor.removeFd(listener);
+    }
+    close(serverSocket);
+    serverSocket = -1;
+    if (metricsSocket >= 0) close(metricsSocket);
+    metricsSocket = -1;
+    handoffEndpoint.close();
+    cout << "Handed over to a new process; draining " << stats::activeConnections.load() << " clients" << endl;
+    drain.start(handoff::drainSecondsFromEnv());
+}
+
+// Listening socket on PORT, or -1 after reporting why not
+int openServerSocket() {
+    int serverSocket = socket(AF_INET, SOCK_STREAM, 0);
     if (serverSocket < 0) {
         cerr << "Error creating server socket: " << strerror(errno) << endl;
-        return 1;
+        return -1;
     }
     
     int opt = 1;
     if (setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
         cerr << "Error setting socket options: " << strerror(errno) << endl;
-        return 1;
+        return -1;
     }
 
     sockaddr_in addr;
@@ -513,31 +850,97 @@ int main() {
 
     if (bind(serverSocket, (sockaddr*)&addr, sizeof(addr)) < 0) {
         cerr << "Error binding socket: " << strerror(errno) << endl;
-        return 1;
+        return -1;
     }
     
     if (listen(serverSocket, 10) < 0) {
         cerr << "Error listening on socket: " << strerror(errno) << endl;
-        return 1;
+        return -1;
+    }
+    return serverSocket;
+}
+
+// Restore the graph from the last snapshot and the write-ahead log; lastLsn is where logging resumes
+bool restoreGraph(uint64_t& lastLsn) {
+    uint64_t restoredPoints = 0, snapshotLsn = 0, replayedChanges = 0;
+    string restoreError;
+    if (!snapshot::load(snapshotSaver.file(), sharedGraphPoints, restoredPoints, snapshotLsn, restoreError)) {
+        cerr << "Could not load snapshot " << restoreError << endl;
+    }
+    if (!wal::replay(walLog.file(), snapshotLsn, sharedGraphPoints, lastLsn, replayedChanges, restoreError)) {
+        cerr << "Could not replay the write-ahead log: " << restoreError << endl;
+        return false;
+    }
+    if (restoredPoints > 0 || replayedChanges > 0) {
+        graphChanged();
+        cout << "Restored " << sharedGraphPoints.size() << " points from " << snapshotSaver.file()
+             << " and " << replayedChanges << " logged changes" << endl;
+    }
+    return true;
+}
+
+int main() {
+    cout << "=== Convex Hull Server with Reactor Pattern ===" << endl;
+    
+    // With hot restart on, take the sockets and graph over from a running server if there is one
+    string handoffPath = handoff::pathFromEnv();
+    uint64_t lastLsn = 0;
+    string handoffError;
+    bool tookOver = !handoffPath.empty() &&
+                    handoff::receive(handoffPath, serverSocket, metricsSocket, sharedGraphPoints, lastLsn, handoffError);
+    if (!handoffError.empty()) {
+        cerr << "Hot restart failed, starting cold: " << handoffError << endl;
+    }
+    if (tookOver) {
+        graphChanged();
+        cout << "Took over from the running server with " << sharedGraphPoints.size() << " points" << endl;
+    } else {
+        serverSocket = openServerSocket();
+        if (serverSocket < 0) return 1;
     }
 
     cout << "Server started on port " << PORT << " using Reactor pattern" << endl;
     cout << "Waiting for connections..." << endl;
 
+    if (!tookOver && !restoreGraph(lastLsn)) return 1;
+    walLog.start(lastLsn);
+    if (walLog.enabled()) {
+        cout << "Write-ahead log: " << walLog.file() << " (" << wal::durabilityName(walLog.mode()) << ")" << endl;
+    }
+
     if (reactor.addFd(serverSocket, handleNewConnection) != 0) {
         cerr << "Failed to add server socket to reactor" << endl;
         return 1;
     }
+
+    // Optional Prometheus endpoint, served by the same reactor; a hot restart hands it over too
+    int metricsPort = metrics::portFromEnv();
+    if (metricsSocket < 0 && metricsPort) metricsSocket = metrics::openListener(metricsPort);
+    if (metricsSocket >= 0 && reactor.addFd(metricsSocket, handleScrapeConnection) == 0) {
+        cout << "Metrics: http://127.0.0.1:" << metricsPort << "/metrics" << endl;
+    } else if (metricsPort) {
+        cerr << "Could not open metrics port " << metricsPort << ": " << strerror(errno) << endl;
+    }
+
+    // A successor started with the same CH_HANDOFF_PATH connects here
+    if (!handoffPath.empty()) {
+        if (handoffEndpoint.open(handoffPath, handoffError) && reactor.addFd(handoffEndpoint.fd(), handleSuccessor) == 0) {
+            cout << "Hot restart: " << handoffPath << endl;
+        } else {
+            cerr << "Could not open handoff socket " << handoffError << endl;
+        }
+    }
     
     reactor.start();
 
-    // Main loop - keep server running
-    while (true) {
+    // Main loop - keep server running and look after background snapshots, until drained after a handoff
+    while (!drain.finished()) {
         this_thread::sleep_for(chrono::seconds(1));
+        serviceSnapshots();
     }
     
     cout << "Shutting down server..." << endl;
     reactor.stop();
-    close(serverSocket);
+    walLog.stop();
     return 0;
 }
\ No newline at end of file
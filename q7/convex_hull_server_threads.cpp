@@ -2,7 +2,8 @@
  * Q7 - Multi-threaded Convex Hull Server (Thread-Safe Fixed Version)
  * ------------------------------------------------------------------
  * This server implements a thread per client model for handling convex hull calculations.
- * Each client gets its own thread, with shared graph access protected by mutex.
+ * Each client gets its own thread. Clients pick a named graph (Use, or an @name
+ * prefix), and each graph is protected by its own mutex.
  * Proper thread management, cleanup, and graceful shutdown implemented.
  */
 
@@ -19,23 +20,38 @@
 #include <netinet/in.h>
 #include <unistd.h>
 #include <cstring>
+#include <cstdlib>
+#include <string_view>
+#include <charconv>
 #include <memory>
 #include <atomic>
 #include <condition_variable>
 #include <fcntl.h>
 #include <signal.h>
+#include "../common/convex_hull.hpp"
+#include "../common/line_buffer.hpp"
+#include "../common/point_parser.hpp"
+#include "../common/response_buffer.hpp"
+#include "../common/log.hpp"
+#include "../common/stats.hpp"
+#include "../common/hull_cache.hpp"
+#include "../common/metrics_http.hpp"
+#include "../common/snapshot.hpp"
+#include "../common/wal.hpp"
+#include "../common/hot_restart.hpp"
+#include "../common/graph_registry.hpp"
+#include "../common/hull_queries.hpp"
+#include "../common/lock_profiler.hpp"
+#include "../common/work_stealing_pool.hpp"
 
 using namespace std;
 
 #define PORT 9034
-#define MAX_BUFFER_SIZE 1024
+#define RECV_BUFFER_SIZE (64 * 1024)
+#define MAX_REPORTED_ERRORS 10
+#define MAX_BATCH_ITEMS 100000
 
-// Basic Point structure
-struct Point {
-    double x, y;
-    Point() : x(0), y(0) {}
-    Point(double x, double y) : x(x), y(y) {}
-};
+using hull::Point;
 
 // Thread management structure
 struct ClientThread {
@@ -47,8 +63,14 @@ struct ClientThread {
 };
 
 // Global shared resources protected by mutexes
-vector<Point> sharedGraphPoints;
-mutex graphMutex;                    // Protects the shared graph
+using GraphRegistry = graphs::Registry<Point, lockprof::Mutex>;
+using Graph = GraphRegistry::GraphT;
+using PublishedHull = graphs::PublishedHull<Point>;
+GraphRegistry graphRegistry;         // Named graphs, each with its own lock and hull cache
+Graph& defaultGraph = graphRegistry.defaultGraph();   // The one persisted and handed over
+snapshot::BackgroundSaver snapshotSaver(snapshot::pathFromEnv(), snapshot::intervalFromEnv());
+wal::Log walLog(wal::pathFromEnv(), wal::durabilityFromEnv(), wal::commitWindowFromEnv());
+handoff::WriteGate writeGate;        // Closed once the graph is handed to a new process
 map<int, unique_ptr<ClientThread>> clientThreads;
 mutex threadMapMutex;                // Protects clientThreads map
 atomic<bool> serverRunning(true);    // Server shutdown flag
@@ -65,89 +87,467 @@ void handleClient(int clientSocket);
 void signalHandler(int signum);
 
 // Utility functions
-Point parsePointFromString(const string& pointString) {
-    try {
-        size_t comma = pointString.find(',');
-        if (comma == string::npos) {
-            throw invalid_argument("Invalid point format: missing comma");
+// Parse the arguments of "Newgraph n [bulk]"
+bool parseNewgraphArguments(string_view args, int& numPoints, bool& bulk) {
+    args = LineBuffer::trim(args);
+    auto [end, ec] = from_chars(args.data(), args.data() + args.size(), numPoints);
+    if (ec != errc() || numPoints <= 0) return false;
+
+    string_view mode = LineBuffer::trim(args.substr(end - args.data()));
+    bulk = (mode == "bulk");
+    return bulk || mode.empty();
+}
+
+/**
+ * Bulk upload: parse point lines straight from the receive buffer in one pass.
+ * Only complete lines are consumed and blank lines are skipped. A malformed line
+ * still counts towards the block so client and server stay in step; it is
+ * recorded in errors by its 1-based position in the block.
+ */
+void parsePointBlock(LineBuffer& input, int pointsToRead, int& pointsRead,
+                     vector<Point>& points, vector<string>& errors) {
+    vector<LineError> lineErrors;
+    size_t linesParsed;
+    input.consume(parsePointLines(input.completeLines(), pointsToRead - pointsRead, points, lineErrors, linesParsed));
+
+    for (const LineError& error : lineErrors) {
+        errors.push_back("line " + to_string(pointsRead + error.line) + ": " + parseErrorMessage(error.status));
+    }
+    pointsRead += linesParsed;
+}
+
+// Single acknowledgement for a bulk upload: accepted count plus per-line errors
+string bulkUploadSummary(int pointsRead, const vector<string>& errors) {
+    string summary = "Graph created with " + to_string(pointsRead - (int)errors.size()) + " points";
+    if (errors.empty()) return summary;
+
+    summary += " (" + to_string(errors.size()) + " rejected: ";
+    for (size_t i = 0; i < errors.size() && i < MAX_REPORTED_ERRORS; i++) {
+        if (i > 0) summary += "; ";
+        summary += errors[i];
+    }
+    if (errors.size() > MAX_REPORTED_ERRORS) summary += "; ...";
+    return summary + ")";
+}
+
+// Hull area as sent to the client
+string formatArea(double area) {
+    ostringstream out;
+    out << fixed << setprecision(1) << area;
+    return out.str();
+}
+
+// Parse a group of points "x,y; x,y; ...", as in CHBATCH items and Inside
+bool parsePointGroup(string_view text, vector<Point>& points, string& error) {
+    size_t position = 1;
+    while (!text.empty()) {
+        size_t end = text.find(';');
+        string_view field = LineBuffer::trim(text.substr(0, end));
+        text = end == string_view::npos ? string_view() : text.substr(end + 1);
+        if (field.empty()) continue;
+
+        Point p;
+        ParseStatus status = parsePoint(field, p.x, p.y);
+        if (status != ParseStatus::Ok) {
+            error = "Error: point " + to_string(position) + ": " + parseErrorMessage(status);
+            return false;
         }
-        
-        string xStr = pointString.substr(0, comma);
-        string yStr = pointString.substr(comma + 1);
-        
-        xStr.erase(remove_if(xStr.begin(), xStr.end(), ::isspace), xStr.end());
-        yStr.erase(remove_if(yStr.begin(), yStr.end(), ::isspace), yStr.end());
-        
-        if (xStr.empty() || yStr.empty()) {
-            throw invalid_argument("Invalid point format: empty coordinate");
+        points.push_back(p);
+        position++;
+    }
+    return true;
+}
+
+// Record a change to a graph; call with its lock held. graph_points counts all graphs
+void graphChanged(Graph& graph) {
+    graph.hullCache.invalidate();
+    atomic_store(&graph.publishedHull, shared_ptr<const PublishedHull>());
+    stats::graphPoints.fetch_add((int64_t)graph.size() - (int64_t)graph.reportedPoints, memory_order_relaxed);
+    graph.reportedPoints = graph.size();
+    if (graph.isDefault()) snapshotSaver.graphChanged();
+}
+
+// Add points to a graph; call with its lock held. A window lets its oldest points go as new ones arrive
+template <typename InputIt>
+void addPoints(Graph& graph, InputIt first, InputIt last) {
+    if (graph.window) {
+        auto now = hull::SlidingHull<Point>::Clock::now();
+        for (; first != last; ++first) graph.window->push(*first, now);
+    } else {
+        if (graph.index) {
+            for (InputIt it = first; it != last; ++it) graph.index->insert(*it);
         }
-        
-        return Point(stod(xStr), stod(yStr));
-    } catch (const exception& e) {
-        throw invalid_argument("Invalid point format: " + string(e.what()));
+        graph.points.insert(graph.points.end(), first, last);
     }
+    graphChanged(graph);
 }
 
-// Calculate cross product for convex hull algorithm
-double crossProduct(const Point& o, const Point& a, const Point& b) {
-    return (a.x - o.x)*(b.y - o.y) - (a.y - o.y)*(b.x - o.x);
+// Empty a graph for Newgraph and log it; call with its lock held, then graphChanged() once refilled
+void clearGraph(Graph& graph) {
+    graph.points.clear();
+    if (graph.window) graph.window->clear();
+    graph.index.reset();
+    if (graph.isDefault()) walLog.append(wal::RECORD_CLEAR);
 }
 
-// Compute convex hull using Graham's scan algorithm
-vector<Point> computeConvexHull(const vector<Point>& points) {
-    if (points.size() <= 1) return points;
-    
-    vector<Point> pts = points;  // Create a copy to sort
-    sort(pts.begin(), pts.end(), [](const Point& a, const Point& b) {
-        return (a.x != b.x) ? a.x < b.x : a.y < b.y;
-    });
-
-    vector<Point> hull;
-    // Build lower hull
-    for (const Point& p : pts) {
-        while (hull.size() >= 2 && 
-               crossProduct(hull[hull.size()-2], hull[hull.size()-1], p) <= 0)
-            hull.pop_back();
-        hull.push_back(p);
+// Drop the points of a windowed graph that are past its age limit; call with its lock held
+void expireWindow(Graph& graph) {
+    if (graph.window && graph.window->expire(hull::SlidingHull<Point>::Clock::now())) graphChanged(graph);
+}
+
+/**
+ * The area of the graph's hull if it is known without computing it. Otherwise
+ * returns false with a copy of the points to compute it from and the cache
+ * version to store() the result under. A window always knows its area.
+ */
+bool lookupArea(Graph& graph, double& area, uint64_t& version, vector<Point>& points) {
+    stats::TimedLockGuard<lockprof::Mutex> lock(graph.mutex);
+    if (graph.window) {
+        expireWindow(graph);
+        area = graph.window->area();
+        return true;
     }
-    
-    // Build upper hull
-    size_t lower = hull.size();
-    for (int i = pts.size()-2; i >= 0; i--) {
-        while (hull.size() > lower && 
-               crossProduct(hull[hull.size()-2], hull[hull.size()-1], pts[i]) <= 0)
-            hull.pop_back();
-        hull.push_back(pts[i]);
+    if (graph.hullCache.lookup(area)) return true;
+    version = graph.hullCache.currentVersion();
+    points = graph.points;
+    return false;
+}
+
+/**
+ * The graph's hull for Inside and Tangent. Once computed it is published on the
+ * graph and read without the graph lock until the next change clears it, so
+ * queries only contend on the lock right after a change.
+ */
+shared_ptr<const PublishedHull> currentHull(Graph& graph) {
+    auto now = chrono::steady_clock::now();
+    shared_ptr<const PublishedHull> published = atomic_load(&graph.publishedHull);
+    if (published && now <= published->expires) return published;
+
+    vector<Point> points;
+    uint64_t version;
+    {
+        stats::TimedLockGuard<lockprof::Mutex> lock(graph.mutex);
+        if (graph.window) {
+            expireWindow(graph);
+            published = make_shared<const PublishedHull>(PublishedHull{graph.window->hull(), graph.window->nextExpiry()});
+            atomic_store(&graph.publishedHull, published);
+            return published;
+        }
+        version = graph.hullCache.currentVersion();
+        points = graph.points;
     }
-    
-    if (hull.size() > 1) hull.pop_back();
-    return hull;
+
+    auto computed = make_shared<PublishedHull>();
+    computed->vertices = hull::monotoneChain(std::move(points));
+    computed->expires = chrono::steady_clock::time_point::max();
+    stats::TimedLockGuard<lockprof::Mutex> lock(graph.mutex);
+    graph.hullCache.store(version, hull::polygonArea(computed->vertices));
+    if (graph.hullCache.currentVersion() == version) atomic_store(&graph.publishedHull, shared_ptr<const PublishedHull>(computed));
+    return computed;
 }
 
-// Calculate area of polygon using shoelace formula
-double calculatePolygonArea(const vector<Point>& poly) {
-    if (poly.size() < 3) return 0.0;
-    
-    double area = 0;
-    for (size_t i = 0; i < poly.size(); i++) {
-        size_t j = (i + 1) % poly.size();
-        area += poly[i].x * poly[j].y - poly[j].x * poly[i].y;
+string formatPoint(const Point& p) {
+    ostringstream out;
+    out << p.x << "," << p.y;
+    return out.str();
+}
+
+// "Inside x,y; x,y; ...": Inside, On hull or Outside for each point, in the same order
+string insideReply(Graph& graph, string_view args) {
+    vector<Point> queries;
+    string error;
+    if (!parsePointGroup(args, queries, error)) return error;
+    if (queries.empty()) return "Error: Missing point";
+
+    shared_ptr<const PublishedHull> published = currentHull(graph);
+    string reply;
+    for (const Point& q : queries) {
+        if (!reply.empty()) reply += "; ";
+        switch (hull::locatePoint(published->vertices, q)) {
+            case hull::Location::Inside: reply += "Inside"; break;
+            case hull::Location::Boundary: reply += "On hull"; break;
+            case hull::Location::Outside: reply += "Outside"; break;
+        }
+    }
+    return reply;
+}
+
+// "Tangent x,y": the two hull vertices lines from the point touch, counter-clockwise
+string tangentReply(Graph& graph, string_view args) {
+    Point q;
+    ParseStatus status = parsePoint(args, q.x, q.y);
+    if (status != ParseStatus::Ok) return "Error: " + parseErrorMessage(status);
+
+    shared_ptr<const PublishedHull> published = currentHull(graph);
+    const vector<Point>& vertices = published->vertices;
+    if (vertices.empty()) return "Error: Graph is empty";
+    size_t first, last;
+    if (!hull::tangentPoints(vertices, q, first, last)) return "Error: Point is not outside the hull";
+    return "Tangents " + formatPoint(vertices[first]) + " " + formatPoint(vertices[last]);
+}
+
+/**
+ * "CH minx,miny,maxx,maxy" and "Count minx,miny,maxx,maxy": the hull area or
+ * the number of the points inside the rectangle, borders included. They come
+ * from the graph's grid index, built on the first such query and rebuilt once
+ * the graph has grown or shrunk well past it. A window is small enough to scan.
+ */
+string rectReply(Graph& graph, string_view args, bool countOnly) {
+    string_view usage = countOnly ? "Error: Usage: Count minx,miny,maxx,maxy" : "Error: Usage: CH minx,miny,maxx,maxy";
+    size_t comma = args.find(',');
+    comma = comma == string_view::npos ? comma : args.find(',', comma + 1);
+    if (comma == string_view::npos) return string(usage);
+    spatial::Rect rect;
+    if (parsePoint(args.substr(0, comma), rect.minX, rect.minY) != ParseStatus::Ok ||
+        parsePoint(args.substr(comma + 1), rect.maxX, rect.maxY) != ParseStatus::Ok) {
+        return string(usage);
+    }
+    if (rect.minX > rect.maxX || rect.minY > rect.maxY) return "Error: Invalid rectangle (min above max)";
+
+    vector<Point> inside;
+    size_t count;
+    {
+        stats::TimedLockGuard<lockprof::Mutex> lock(graph.mutex);
+        if (graph.window) {
+            expireWindow(graph);
+            for (const Point& p : graph.window->points()) {
+                if (rect.contains(p)) inside.push_back(p);
+            }
+            count = inside.size();
+        } else {
+            if (!graph.index || graph.index->stale()) graph.index = make_unique<spatial::GridIndex<Point>>(graph.points);
+            if (countOnly) count = graph.index->countIn(rect);
+            else graph.index->collect(rect, inside);
+        }
     }
-    return fabs(area) / 2.0;
+    if (countOnly) return to_string(count);
+    return formatArea(inside.size() < 3 ? 0.0 : hull::convexHullArea(inside));
+}
+
+// Largest window "Window" accepts (CH_WINDOW_MAX_POINTS, CH_WINDOW_MAX_SECONDS): its updates run under the graph lock
+long windowLimit(const char* variable, long fallback) {
+    const char* value = getenv(variable);
+    long limit = value ? atol(value) : 0;
+    return limit > 0 ? limit : fallback;
 }
+const long WINDOW_MAX_POINTS = windowLimit("CH_WINDOW_MAX_POINTS", 100000);
+const long WINDOW_MAX_SECONDS = windowLimit("CH_WINDOW_MAX_SECONDS", 86400);
+
+/**
+ * "Window n", "Window Ts", "Window n Ts" or "Window off": from now on only the
+ * last n points, or the points of the last T seconds, make up the graph. The
+ * points already in it enter the window as if they had just arrived. A time
+ * window also holds at most WINDOW_MAX_POINTS. Returns the reply.
+ */
+string setWindow(Graph& graph, string_view args) {
+    size_t maxPoints = 0;
+    long seconds = 0;
+    bool off = (args == "off");
+    while (!off && !args.empty()) {
+        size_t space = args.find(' ');
+        string_view field = args.substr(0, space);
+        args = space == string_view::npos ? string_view() : LineBuffer::trim(args.substr(space + 1));
 
-// Send formatted message to client with error checking
-bool sendMessageToClient(int clientSocket, const string& msg) {
-    string formatted = msg + "\n";
-    ssize_t sent = send(clientSocket, formatted.c_str(), formatted.length(), MSG_NOSIGNAL);
-    if (sent < 0) {
-        cout << "[Client " << clientSocket << "] Error sending message: " << strerror(errno) << endl;
+        bool isSeconds = field.size() > 1 && field.back() == 's';
+        if (isSeconds) field.remove_suffix(1);
+        long value = 0;
+        auto [end, ec] = from_chars(field.data(), field.data() + field.size(), value);
+        if (ec != errc() || end != field.data() + field.size() || value <= 0 || (isSeconds ? seconds : maxPoints) != 0) {
+            return "Error: Usage: Window n | Ts | n Ts | off";
+        }
+        if (isSeconds) seconds = value;
+        else maxPoints = value;
+    }
+    if (!off && maxPoints == 0 && seconds == 0) return "Error: Usage: Window n | Ts | n Ts | off";
+    if (maxPoints > (size_t)WINDOW_MAX_POINTS || seconds > WINDOW_MAX_SECONDS) {
+        return "Error: Window too large (at most " + to_string(WINDOW_MAX_POINTS) + " points and " +
+               to_string(WINDOW_MAX_SECONDS) + " seconds)";
+    }
+    if (graph.isDefault()) return "Error: The default graph cannot be windowed";
+
+    stats::TimedLockGuard<lockprof::Mutex> lock(graph.mutex);
+    vector<Point> points = graph.window ? graph.window->points() : std::move(graph.points);
+    graph.points.clear();
+    graph.window.reset();
+    graph.index.reset();
+    if (off) {
+        graph.points = std::move(points);
+        graphChanged(graph);
+        return "Window off";
+    }
+
+    graph.window = make_unique<hull::SlidingHull<Point>>(maxPoints > 0 ? maxPoints : WINDOW_MAX_POINTS, chrono::seconds(seconds));
+    addPoints(graph, points.begin(), points.end());
+    string reply = "Window set: last";
+    if (maxPoints > 0) reply += " " + to_string(maxPoints) + (maxPoints == 1 ? " point" : " points");
+    if (maxPoints > 0 && seconds > 0) reply += " within";
+    if (seconds > 0) reply += " " + to_string(seconds) + (seconds == 1 ? " second" : " seconds");
+    return reply;
+}
+
+// Finds or creates the graph for "Use name" and "@name"; nullptr with the reply in error if it cannot
+Graph* openGraph(string_view name, string& error) {
+    if (!graphs::validName(name)) {
+        error = "Error: Invalid graph name";
+        return nullptr;
+    }
+    Graph* graph = graphRegistry.open(name);
+    if (!graph) error = "Error: Too many graphs (limit " + to_string(graphRegistry.capacity()) + ")";
+    return graph;
+}
+
+// Points in the named graphs, which snapshots, the log and hot restart do not cover
+size_t unpersistedPoints() {
+    size_t total = 0;
+    for (Graph* graph : graphRegistry.all()) {
+        if (graph->isDefault()) continue;
+        stats::TimedLockGuard<lockprof::Mutex> lock(graph->mutex);
+        total += graph->size();
+    }
+    return total;
+}
+
+// Fork a background save of the default graph; call with its lock held. The reply for SAVE
+string startSnapshot() {
+    if (!snapshotSaver.start(defaultGraph.points, walLog.lastLsn())) {
+        return errno == EBUSY ? "Error: Snapshot already in progress" : "Error: Snapshot failed: " + string(strerror(errno));
+    }
+    walLog.rotate();   // Changes from here on go to a segment the snapshot does not cover
+    LOG_INFO("[Snapshot] Started for " << defaultGraph.points.size() << " points");
+    return "Snapshot started (" + to_string(defaultGraph.points.size()) + " points)";
+}
+
+// Reap a finished save, then start the periodic one if it is due
+void serviceSnapshots() {
+    int finished = snapshotSaver.poll();
+    if (finished > 0) {
+        LOG_INFO("[Snapshot] Saved to " << snapshotSaver.file() << ": " << snapshotSaver.lastSavedPoints()
+                 << " points in " << snapshotSaver.lastSaveMillis() << " ms");
+        walLog.discardUpTo(snapshotSaver.lastSavedLsn());
+    } else if (finished < 0) {
+        LOG_ERROR("[Snapshot] Saving to " << snapshotSaver.file() << " failed");
+    }
+    if (snapshotSaver.due() && !writeGate.frozen()) {
+        stats::TimedLockGuard<lockprof::Mutex> lock(defaultGraph.mutex);
+        startSnapshot();
+    }
+}
+
+// Queue a reply for the client; it goes out with the rest of the batch on flush
+bool sendMessageToClient(ResponseBuffer& replies, const string& msg) {
+    if (!replies.append(msg)) {
+        LOG_ERROR("[Client " << replies.socket() << "] Error sending message: " << strerror(errno));
+        return false;
+    }
+    stats::addBytesOut(msg.size() + 1);
+    LOG_DEBUG("[Client " << replies.socket() << "] Sent: " << msg);
+    return true;
+}
+
+// Write all replies queued for the client in one go, once the changes they acknowledge are logged
+bool flushClientResponses(ResponseBuffer& replies) {
+    walLog.waitDurable();
+    if (!replies.flush()) {
+        LOG_ERROR("[Client " << replies.socket() << "] Error sending message: " << strerror(errno));
         return false;
     }
-    cout << "[Client " << clientSocket << "] Sent: " << msg << endl;
     return true;
 }
 
+// Worker threads for CHBATCH, shared by all clients: CH_BATCH_THREADS, or one per core
+WorkStealingPool& hullPool() {
+    static WorkStealingPool pool([] {
+        const char* value = getenv("CH_BATCH_THREADS");
+        int threads = value ? atoi(value) : 0;
+        return threads > 0 ? (unsigned)threads : thread::hardware_concurrency();
+    }());
+    return pool;
+}
+
+// Replies of one CHBATCH, added by the pool as the hulls finish
+struct BatchResults {
+    mutex lock;
+    condition_variable ready;
+    vector<pair<size_t, string>> finished;   // 1-based item number, reply
+
+    void add(size_t item, string reply) {
+        {
+            lock_guard<mutex> guard(lock);
+            finished.emplace_back(item, std::move(reply));
+        }
+        ready.notify_one();
+    }
+};
+
+/**
+ * Answer the items of a CHBATCH: each is a graph name or an inline point group.
+ * Cached areas and bad items are answered at once; the other hulls run on the
+ * pool, and their replies are sent as they finish, tagged "<item> <reply>" since
+ * they come back out of order. "END" closes the batch.
+ */
+bool runHullBatch(ResponseBuffer& replies, const vector<string>& items) {
+    auto results = make_shared<BatchResults>();
+    bool connected = true;
+    size_t running = 0;
+
+    for (size_t i = 0; i < items.size(); i++) {
+        size_t item = i + 1;
+        string_view text = items[i];
+        Graph* graph = nullptr;
+        uint64_t version = 0;
+        vector<Point> points;
+        string reply;
+
+        if (text.find(',') == string_view::npos) {
+            graph = graphRegistry.find(text);
+            if (!graph) {
+                reply = "Error: No such graph";
+            } else {
+                double area = 0.0;
+                bool cached = lookupArea(*graph, area, version, points);
+                stats::recordHullCache(cached);
+                if (cached) reply = formatArea(area);
+            }
+        } else {
+            parsePointGroup(text, points, reply);
+        }
+
+        if (!reply.empty()) {
+            connected = connected && sendMessageToClient(replies, to_string(item) + " " + reply);
+            continue;
+        }
+
+        running++;
+        hullPool().submit([results, item, graph, version, points = std::move(points)] {
+            double area = points.size() < 3 ? 0.0 : hull::convexHullArea(points);
+            if (graph) {
+                stats::TimedLockGuard<lockprof::Mutex> lock(graph->mutex);
+                graph->hullCache.store(version, area);
+            }
+            results->add(item, formatArea(area));
+        });
+    }
+
+    // Stream the replies as they come in; the tasks hold results, so wait for all of them
+    vector<pair<size_t, string>> finished;
+    while (running > 0) {
+        connected = connected && flushClientResponses(replies);
+        {
+            unique_lock<mutex> lock(results->lock);
+            results->ready.wait(lock, [&] { return !results->finished.empty(); });
+            finished.swap(results->finished);
+        }
+        running -= finished.size();
+        for (auto& [item, reply] : finished) {
+            connected = connected && sendMessageToClient(replies, to_string(item) + " " + reply);
+        }
+        finished.clear();
+    }
+
+    stats::countCommands(stats::CMD_CH, items.size());
+    return connected && sendMessageToClient(replies, "END");
+}
+
 // Clean up finished threads periodically
 void cleanupFinishedThreads() {
     while (serverRunning) {
@@ -161,7 +561,7 @@ void cleanupFinishedThreads() {
             lock_guard<mutex> lock(threadMapMutex);
             for (auto it = clientThreads.begin(); it != clientThreads.end();) {
                 if (!it->second->isActive && it->second->clientThread.joinable()) {
-                    cout << "[CleanupThread] Joining finished thread for client " << it->first << endl;
+                    LOG_INFO("[CleanupThread] Joining finished thread for client " << it->first);
                     it->second->clientThread.join();
                     it = clientThreads.erase(it);
                 } else {
@@ -170,12 +570,12 @@ void cleanupFinishedThreads() {
             }
         }
     }
-    cout << "[CleanupThread] Cleanup thread terminated" << endl;
+    LOG_INFO("[CleanupThread] Cleanup thread terminated");
 }
 
 // Clean up specific client
 void cleanupClient(int clientSocket) {
-    cout << "[CleanupClient] Cleaning up client " << clientSocket << endl;
+    LOG_INFO("[CleanupClient] Cleaning up client " << clientSocket);
     
     {
         lock_guard<mutex> lock(threadMapMutex);
@@ -195,23 +595,35 @@ void cleanupClient(int clientSocket) {
  * Handles all communication with a single client
  */
 void handleClient(int clientSocket) {
-    cout << "[Client " << clientSocket << "] Thread started" << endl;
+    LOG_INFO("[Client " << clientSocket << "] Thread started");
+    stats::ConnectionScope connection;
     
+    // Replies are queued here and written once per read batch
+    ResponseBuffer replies(clientSocket);
+
     // Initial client setup
-    if (!sendMessageToClient(clientSocket, "Convex Hull Server Ready")) {
+    if (!sendMessageToClient(replies, "Convex Hull Server Ready")) {
         cleanupClient(clientSocket);
         return;
     }
-    if (!sendMessageToClient(clientSocket, "Commands: Newgraph n, CH, Newpoint x,y, Removepoint x,y")) {
+    if (!sendMessageToClient(replies, "Commands: Newgraph n [bulk], CH [rect], Count rect, Newpoint x,y, Removepoint x,y, STATS, SAVE, Use name, Graphs, CHBATCH n, Window n|Ts|off, Inside x,y, Tangent x,y") ||
+        !flushClientResponses(replies)) {
         cleanupClient(clientSocket);
         return;
     }
 
-    char buffer[MAX_BUFFER_SIZE];
-    string accumulatedInput;
+    LineBuffer input(RECV_BUFFER_SIZE);
+    string_view command;
     int pointsToRead = 0;
     int pointsRead = 0;
     bool readingPoints = false;
+    bool bulkUpload = false;
+    vector<Point> bulkPoints;              // The bulk block read so far
+    vector<string> bulkErrors;
+    int batchToRead = 0;                   // CHBATCH items still to come
+    vector<string> batchItems;
+    Graph* currentGraph = &defaultGraph;   // Selected with Use
+    Graph* uploadGraph = &defaultGraph;    // Target of the Newgraph upload in progress
 
     // Main client communication loop
     while (serverRunning) {
@@ -221,52 +633,128 @@ void handleClient(int clientSocket) {
         tv.tv_usec = 0;
         setsockopt(clientSocket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof tv);
         
-        ssize_t bytesRead = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
+        if (!input.prepareWrite()) {
+            sendMessageToClient(replies, "Error: Line too long");
+            flushClientResponses(replies);
+            break;
+        }
+
+        ssize_t bytesRead = recv(clientSocket, input.writePtr(), input.writable(), 0);
         if (bytesRead <= 0) {
             if (bytesRead == 0) {
-                cout << "[Client " << clientSocket << "] Disconnected normally" << endl;
+                LOG_INFO("[Client " << clientSocket << "] Disconnected normally");
             } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
                 // Timeout occurred, check if server is still running
                 continue;
             } else {
-                cout << "[Client " << clientSocket << "] Disconnected with error: " << strerror(errno) << endl;
+                LOG_ERROR("[Client " << clientSocket << "] Disconnected with error: " << strerror(errno));
             }
             break;
         }
 
-        buffer[bytesRead] = '\0';
-        accumulatedInput += buffer;
+        input.commit(bytesRead);
+        stats::addBytesIn(bytesRead);
 
         // Process complete commands
-        size_t pos;
-        while ((pos = accumulatedInput.find('\n')) != string::npos) {
-            string command = accumulatedInput.substr(0, pos);
-            accumulatedInput.erase(0, pos + 1);
-
-            // Clean command string
-            command.erase(0, command.find_first_not_of(" \t\r\n"));
-            command.erase(command.find_last_not_of(" \t\r\n") + 1);
-            
+        while (input.hasLine()) {
+            if (readingPoints && bulkUpload) {
+                // Bulk upload: take every complete point line of this read in one pass
+                int pointsBefore = pointsRead;
+                parsePointBlock(input, pointsToRead, pointsRead, bulkPoints, bulkErrors);
+                stats::countCommands(stats::CMD_POINT, pointsRead - pointsBefore);
+
+                if (pointsRead >= pointsToRead) {
+                    // The whole block replaces the graph at once, so no one sees it half uploaded
+                    readingPoints = false;
+                    string summary = handoff::FROZEN_REPLY;
+                    {
+                        handoff::WriteGate::Pass pass(writeGate, true);
+                        if (pass) {
+                            stats::TimedLockGuard<lockprof::Mutex> lock(uploadGraph->mutex);
+                            clearGraph(*uploadGraph);
+                            if (uploadGraph->isDefault()) walLog.appendPoints(bulkPoints.begin(), bulkPoints.end());
+                            addPoints(*uploadGraph, bulkPoints.begin(), bulkPoints.end());
+                            summary = bulkUploadSummary(pointsRead, bulkErrors);
+                        }
+                    }
+                    bulkPoints = vector<Point>();
+                    bulkErrors.clear();
+                    if (!sendMessageToClient(replies, summary)) {
+                        goto client_disconnected;
+                    }
+                }
+                continue;
+            }
+
+            input.nextLine(command);
             if (command.empty()) continue;
 
-            cout << "[Client " << clientSocket << "] Command: " << command << endl;
+            // CHBATCH items, one per line; the batch runs once the last one is in
+            if (batchToRead > 0) {
+                batchItems.emplace_back(command);
+                if (--batchToRead > 0) continue;
+                bool sent = runHullBatch(replies, batchItems);
+                batchItems.clear();
+                if (!sent) {
+                    goto client_disconnected;
+                }
+                continue;
+            }
+
+            // "@name command" runs a single command on another graph
+            Graph* graph = readingPoints ? uploadGraph : currentGraph;
+            if (!readingPoints && command[0] == '@') {
+                size_t space = command.find(' ');
+                string error;
+                graph = openGraph(command.substr(1, space == string_view::npos ? space : space - 1), error);
+                command = space == string_view::npos ? string_view() : LineBuffer::trim(command.substr(space + 1));
+                if (!graph || command.empty()) {
+                    if (!sendMessageToClient(replies, graph ? "Error: Missing command after graph name" : error)) {
+                        goto client_disconnected;
+                    }
+                    continue;
+                }
+            }
+
+            stats::Command kind = stats::classifyCommand(command, readingPoints);
+            stats::CommandTimer timer(kind);
+
+            LOG_DEBUG("[Client " << clientSocket << "] Command: " << command);
+
+            // After a handoff the graph belongs to the new process; this one only reads it
+            handoff::WriteGate::Pass pass(writeGate, handoff::mutates(kind));
+            if (!pass) {
+                readingPoints = false;
+                if (!sendMessageToClient(replies, handoff::FROZEN_REPLY)) {
+                    goto client_disconnected;
+                }
+                continue;
+            }
 
             try {
                 if (readingPoints) {
                     // Handle point input for Newgraph command
-                    Point p = parsePointFromString(command);
+                    Point p;
+                    ParseStatus status = parsePoint(command, p.x, p.y);
+                    if (status != ParseStatus::Ok) {
+                        if (!sendMessageToClient(replies, "Error: " + parseErrorMessage(status))) {
+                            goto client_disconnected;
+                        }
+                        continue;
+                    }
                     {
-                        lock_guard<mutex> lock(graphMutex);
-                        sharedGraphPoints.push_back(p);
+                        stats::TimedLockGuard<lockprof::Mutex> lock(graph->mutex);
+                        if (graph->isDefault()) walLog.append(wal::RECORD_ADD, p.x, p.y);
+                        addPoints(*graph, &p, &p + 1);
                     }
                     pointsRead++;
-                    if (!sendMessageToClient(clientSocket, "Point " + to_string(pointsRead) + " accepted")) {
+                    if (!sendMessageToClient(replies, "Point " + to_string(pointsRead) + " accepted")) {
                         goto client_disconnected;
                     }
 
                     if (pointsRead >= pointsToRead) {
                         readingPoints = false;
-                        if (!sendMessageToClient(clientSocket, 
+                        if (!sendMessageToClient(replies, 
                             "Graph created with " + to_string(pointsRead) + " points")) {
                             goto client_disconnected;
                         }
@@ -276,97 +764,208 @@ void handleClient(int clientSocket) {
 
                 // Handle main commands
                 if (command.substr(0, 9) == "Newgraph ") {
-                    try {
-                        pointsToRead = stoi(command.substr(9));
-                        if (pointsToRead <= 0) {
-                            throw invalid_argument("Number of points must be positive");
-                        }
-                    } catch (const exception& e) {
-                        if (!sendMessageToClient(clientSocket, "Error: Invalid number of points")) {
+                    if (!parseNewgraphArguments(command.substr(9), pointsToRead, bulkUpload)) {
+                        if (!sendMessageToClient(replies, "Error: Invalid number of points")) {
                             goto client_disconnected;
                         }
                         continue;
                     }
 
-                    {
-                        lock_guard<mutex> lock(graphMutex);
-                        sharedGraphPoints.clear();
+                    // A bulk block is buffered and replaces the graph when complete
+                    if (!bulkUpload) {
+                        stats::TimedLockGuard<lockprof::Mutex> lock(graph->mutex);
+                        clearGraph(*graph);
+                        graphChanged(*graph);
                     }
+                    uploadGraph = graph;
                     pointsRead = 0;
                     readingPoints = true;
-                    if (!sendMessageToClient(clientSocket, "Enter " + to_string(pointsToRead) + " points (x,y):")) {
+                    // Bulk uploads are acknowledged once, after the whole block
+                    if (!bulkUpload && !sendMessageToClient(replies, "Enter " + to_string(pointsToRead) + " points (x,y):")) {
                         goto client_disconnected;
                     }
                 }
                 else if (command == "CH") {
+                    // Served from the cache until the graph changes
+                    double area = 0.0;
+                    uint64_t version = 0;
                     vector<Point> points;
-                    {
-                        lock_guard<mutex> lock(graphMutex);
-                        points = sharedGraphPoints;
+                    bool cached = lookupArea(*graph, area, version, points);
+                    stats::recordHullCache(cached);
+
+                    if (!cached) {
+                        area = points.size() < 3 ? 0.0 : hull::convexHullArea(points);
+                        stats::TimedLockGuard<lockprof::Mutex> lock(graph->mutex);
+                        graph->hullCache.store(version, area);
                     }
-                    
-                    if (points.size() < 3) {
-                        if (!sendMessageToClient(clientSocket, "0.0")) {
-                            goto client_disconnected;
-                        }
-                    } else {
-                        auto hull = computeConvexHull(points);
-                        double area = calculatePolygonArea(hull);
-                        ostringstream out;
-                        out << fixed << setprecision(1) << area;
-                        if (!sendMessageToClient(clientSocket, out.str())) {
+
+                    if (!sendMessageToClient(replies, formatArea(area))) {
+                        goto client_disconnected;
+                    }
+                }
+                else if (command.substr(0, 8) == "CHBATCH ") {
+                    // Like a bulk upload, the items follow without a prompt
+                    string_view count = LineBuffer::trim(command.substr(8));
+                    int items = 0;
+                    auto [end, ec] = from_chars(count.data(), count.data() + count.size(), items);
+                    if (ec != errc() || end != count.data() + count.size() || items <= 0 || items > MAX_BATCH_ITEMS) {
+                        if (!sendMessageToClient(replies, "Error: Invalid number of items")) {
                             goto client_disconnected;
                         }
+                        continue;
                     }
+                    batchToRead = items;
                 }
                 else if (command.substr(0, 9) == "Newpoint ") {
-                    Point p = parsePointFromString(command.substr(9));
+                    Point p;
+                    ParseStatus status = parsePoint(command.substr(9), p.x, p.y);
+                    if (status != ParseStatus::Ok) {
+                        if (!sendMessageToClient(replies, "Error: " + parseErrorMessage(status))) {
+                            goto client_disconnected;
+                        }
+                        continue;
+                    }
                     {
-                        lock_guard<mutex> lock(graphMutex);
-                        sharedGraphPoints.push_back(p);
+                        stats::TimedLockGuard<lockprof::Mutex> lock(graph->mutex);
+                        if (graph->isDefault()) walLog.append(wal::RECORD_ADD, p.x, p.y);
+                        addPoints(*graph, &p, &p + 1);
                     }
-                    if (!sendMessageToClient(clientSocket, "Point added")) {
+                    if (!sendMessageToClient(replies, "Point added")) {
                         goto client_disconnected;
                     }
                 }
                 else if (command.substr(0, 12) == "Removepoint ") {
-                    Point p = parsePointFromString(command.substr(12));
+                    Point p;
+                    ParseStatus status = parsePoint(command.substr(12), p.x, p.y);
+                    if (status != ParseStatus::Ok) {
+                        if (!sendMessageToClient(replies, "Error: " + parseErrorMessage(status))) {
+                            goto client_disconnected;
+                        }
+                        continue;
+                    }
                     bool found = false;
+                    bool windowed = false;
                     {
-                        lock_guard<mutex> lock(graphMutex);
-                        for (auto it = sharedGraphPoints.begin(); it != sharedGraphPoints.end(); ++it) {
+                        stats::TimedLockGuard<lockprof::Mutex> lock(graph->mutex);
+                        windowed = (graph->window != nullptr);
+                        for (auto it = graph->points.begin(); it != graph->points.end(); ++it) {
                             if (fabs(it->x - p.x) < 1e-9 && fabs(it->y - p.y) < 1e-9) {
-                                sharedGraphPoints.erase(it);
+                                if (graph->isDefault()) {
+                                    walLog.append(wal::RECORD_REMOVE, it->x, it->y, it - graph->points.begin());
+                                }
+                                if (graph->index) graph->index->erase(*it);
+                                graph->points.erase(it);
+                                graphChanged(*graph);
                                 found = true;
                                 break;
                             }
                         }
                     }
-                    if (!sendMessageToClient(clientSocket, found ? "Point removed" : "Point not found")) {
+                    const char* reply = windowed ? "Error: Points of a windowed graph expire on their own"
+                                      : found ? "Point removed" : "Point not found";
+                    if (!sendMessageToClient(replies, reply)) {
+                        goto client_disconnected;
+                    }
+                }
+                else if (command == "STATS") {
+                    for (const string& line : stats::formatReport(stats::collect())) {
+                        if (!sendMessageToClient(replies, line)) {
+                            goto client_disconnected;
+                        }
+                    }
+                }
+                else if (command == "SAVE") {
+                    // The snapshot is written by a forked child; only the fork holds the lock
+                    string reply = "Error: Only the default graph is saved";
+                    if (graph->isDefault()) {
+                        stats::TimedLockGuard<lockprof::Mutex> lock(graph->mutex);
+                        reply = startSnapshot();
+                    }
+                    if (!sendMessageToClient(replies, reply)) {
+                        goto client_disconnected;
+                    }
+                }
+                else if (command.substr(0, 4) == "Use ") {
+                    string error;
+                    Graph* selected = openGraph(LineBuffer::trim(command.substr(4)), error);
+                    if (selected) currentGraph = selected;
+                    string reply = selected ? "Using graph " + selected->name : error;
+                    if (selected && !selected->isDefault()) reply += " (in memory only: not saved, logged or handed over on restart)";
+                    if (!sendMessageToClient(replies, reply)) {
+                        goto client_disconnected;
+                    }
+                }
+                else if (command.substr(0, 3) == "CH " || command.substr(0, 6) == "Count ") {
+                    bool countOnly = command.substr(0, 6) == "Count ";
+                    string_view rect = LineBuffer::trim(command.substr(countOnly ? 6 : 3));
+                    if (!sendMessageToClient(replies, rectReply(*graph, rect, countOnly))) {
+                        goto client_disconnected;
+                    }
+                }
+                else if (command.substr(0, 7) == "Inside ") {
+                    if (!sendMessageToClient(replies, insideReply(*graph, command.substr(7)))) {
+                        goto client_disconnected;
+                    }
+                }
+                else if (command.substr(0, 8) == "Tangent ") {
+                    if (!sendMessageToClient(replies, tangentReply(*graph, LineBuffer::trim(command.substr(8))))) {
                         goto client_disconnected;
                     }
                 }
+                else if (command.substr(0, 7) == "Window ") {
+                    if (!sendMessageToClient(replies, setWindow(*graph, LineBuffer::trim(command.substr(7))))) {
+                        goto client_disconnected;
+                    }
+                }
+                else if (command == "Graphs") {
+                    // One line per graph; the selected one is marked
+                    for (Graph* listed : graphRegistry.all()) {
+                        size_t size;
+                        {
+                            stats::TimedLockGuard<lockprof::Mutex> lock(listed->mutex);
+                            expireWindow(*listed);
+                            size = listed->size();
+                        }
+                        string line = listed->name + ": " + to_string(size) + " points";
+                        if (listed == currentGraph) line += " (current)";
+                        if (!sendMessageToClient(replies, line)) {
+                            goto client_disconnected;
+                        }
+                    }
+                }
+                else if (command == "LOCKS") {
+                    for (const string& line : lockprof::formatReport()) {
+                        if (!sendMessageToClient(replies, line)) {
+                            goto client_disconnected;
+                        }
+                    }
+                }
                 else if (command == "exit" || command == "quit") {
-                    sendMessageToClient(clientSocket, "Goodbye!");
+                    sendMessageToClient(replies, "Goodbye!");
                     break;
                 }
                 else {
-                    if (!sendMessageToClient(clientSocket, "Error: Unknown command")) {
+                    if (!sendMessageToClient(replies, "Error: Unknown command")) {
                         goto client_disconnected;
                     }
                 }
             }
             catch (const exception& e) {
                 string errorMsg = "Error: " + string(e.what());
-                if (!sendMessageToClient(clientSocket, errorMsg)) {
+                if (!sendMessageToClient(replies, errorMsg)) {
                     goto client_disconnected;
                 }
             }
         }
+
+        // Everything this read produced leaves in a single send
+        if (!flushClientResponses(replies)) {
+            break;
+        }
     }
 
 client_disconnected:
-    cout << "[Client " << clientSocket << "] Handler ending" << endl;
+    LOG_INFO("[Client " << clientSocket << "] Handler ending");
     cleanupClient(clientSocket);
 }
 
@@ -390,25 +989,19 @@ void signalHandler(int signum) {
     cleanupCondition.notify_all();
 }
 
-int main() {
-    // Set up signal handlers for graceful shutdown
-    signal(SIGINT, signalHandler);   // CTRL+C
-    signal(SIGTERM, signalHandler);  // Termination signal
-    
-    cout << "=== Multi-threaded Convex Hull Server ===" << endl;
-    
-    // Server setup
+// Listening socket on PORT, or -1 after reporting why not
+int openServerSocket() {
     int serverSocket = socket(AF_INET, SOCK_STREAM, 0);
     if (serverSocket < 0) {
         cerr << "Error creating socket: " << strerror(errno) << endl;
-        return 1;
+        return -1;
     }
 
     // Set socket options
     int opt = 1;
     if (setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
         cerr << "Error setting socket options: " << strerror(errno) << endl;
-        return 1;
+        return -1;
     }
 
     // Configure server address
@@ -420,12 +1013,63 @@ int main() {
 
     if (bind(serverSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
         cerr << "Error binding socket: " << strerror(errno) << endl;
-        return 1;
+        return -1;
     }
 
     if (listen(serverSocket, 10) < 0) {
         cerr << "Error listening on socket: " << strerror(errno) << endl;
-        return 1;
+        return -1;
+    }
+
+    return serverSocket;
+}
+
+// Restore the graph from the last snapshot and the write-ahead log; lastLsn is where logging resumes
+bool restoreGraph(uint64_t& lastLsn) {
+    uint64_t restoredPoints = 0, snapshotLsn = 0, replayedChanges = 0;
+    string restoreError;
+    if (!snapshot::load(snapshotSaver.file(), defaultGraph.points, restoredPoints, snapshotLsn, restoreError)) {
+        cerr << "Could not load snapshot " << restoreError << endl;
+    }
+    if (!wal::replay(walLog.file(), snapshotLsn, defaultGraph.points, lastLsn, replayedChanges, restoreError)) {
+        cerr << "Could not replay the write-ahead log: " << restoreError << endl;
+        return false;
+    }
+    if (restoredPoints > 0 || replayedChanges > 0) {
+        graphChanged(defaultGraph);
+        cout << "Restored " << defaultGraph.points.size() << " points from " << snapshotSaver.file()
+             << " and " << replayedChanges << " logged changes" << endl;
+    }
+    return true;
+}
+
+int main() {
+    // Set up signal handlers for graceful shutdown
+    signal(SIGINT, signalHandler);   // CTRL+C
+    signal(SIGTERM, signalHandler);  // Termination signal
+    
+    cout << "=== Multi-threaded Convex Hull Server ===" << endl;
+    
+    // With hot restart on, take the sockets and graph over from a running server if there is one
+    string handoffPath = handoff::pathFromEnv();
+    int serverSocket = -1, metricsSocket = -1;
+    uint64_t lastLsn = 0;
+    string handoffError;
+    bool tookOver = !handoffPath.empty() &&
+                    handoff::receive(handoffPath, serverSocket, metricsSocket, defaultGraph.points, lastLsn, handoffError);
+    if (!handoffError.empty()) {
+        cerr << "Hot restart failed, starting cold: " << handoffError << endl;
+    }
+    if (tookOver) {
+        graphChanged(defaultGraph);
+        cout << "Took over from the running server with " << defaultGraph.points.size() << " points" << endl;
+    } else {
+        serverSocket = openServerSocket();
+        if (serverSocket < 0 || !restoreGraph(lastLsn)) return 1;
+    }
+    walLog.start(lastLsn);
+    if (walLog.enabled()) {
+        cout << "Write-ahead log: " << walLog.file() << " (" << wal::durabilityName(walLog.mode()) << ")" << endl;
     }
 
     cout << "Server started on port " << PORT << " (Multi-threaded version)" << endl;
@@ -438,16 +1082,91 @@ int main() {
     int flags = fcntl(serverSocket, F_GETFL, 0);
     fcntl(serverSocket, F_SETFL, flags | O_NONBLOCK);
 
-    // Main accept loop
+    // Optional Prometheus endpoint, served by this accept thread
+    int metricsPort = metrics::portFromEnv();
+    if (metricsSocket < 0 && metricsPort) {
+        metricsSocket = metrics::openListener(metricsPort);
+        if (metricsSocket < 0) {
+            cerr << "Could not open metrics port " << metricsPort << ": " << strerror(errno) << endl;
+        } else {
+            cout << "Metrics: http://127.0.0.1:" << metricsPort << "/metrics" << endl;
+        }
+    }
+
+    // A successor started with the same CH_HANDOFF_PATH connects here
+    handoff::Endpoint endpoint;
+    if (!handoffPath.empty()) {
+        if (endpoint.open(handoffPath, handoffError)) {
+            cout << "Hot restart: " << handoffPath << endl;
+        } else {
+            cerr << "Could not open handoff socket " << handoffError << endl;
+        }
+    }
+    handoff::Drain drain;
+
+    // Main accept loop; it also looks after background snapshots and hot restarts
     while (serverRunning) {
+        serviceSnapshots();
+        if (drain.finished()) {
+            cout << "[Server] Drained after handoff" << endl;
+            serverRunning = false;
+            break;
+        }
+
+        // Wait on all listeners; the timeout lets the loop notice shutdown
+        // (poll() skips the entries whose fd is -1)
+        pollfd listeners[3] = {{serverSocket, POLLIN, 0}, {metricsSocket, POLLIN, 0}, {endpoint.fd(), POLLIN, 0}};
+        if (poll(listeners, 3, 100) <= 0) continue;
+
+        // From a successful handoff on, the successor accepts and this process only drains
+        if (listeners[2].revents & POLLIN) {
+            int successor = endpoint.accept();
+            if (successor >= 0) {
+                // Only the default graph can be handed over, so refuse while named graphs hold points.
+                // Checked frozen, so no write can land in one between the check and the handoff
+                writeGate.freeze();
+                size_t stranded = unpersistedPoints();
+                if (stranded > 0) {
+                    writeGate.thaw();
+                    cerr << "[Server] Handoff refused: named graphs hold " << stranded
+                         << " points the new process would not get" << endl;
+                } else if (handoff::handOver(successor, writeGate, walLog, defaultGraph.points, serverSocket, metricsSocket, handoffError)) {
+                    cout << "[Server] Handed over to a new process; draining "
+                         << stats::activeConnections.load() << " clients" << endl;
+                    close(serverSocket);
+                    serverSocket = -1;
+                    if (metricsSocket >= 0) close(metricsSocket);
+                    metricsSocket = -1;
+                    endpoint.close();
+                    drain.start(handoff::drainSecondsFromEnv());
+                } else {
+                    cerr << "[Server] Handoff failed: " << handoffError << endl;
+                }
+                close(successor);
+            }
+            continue;
+        }
+
+        // A scrape never takes the graph lock; it runs on its own short-lived thread
+        // (at most metrics::SCRAPE_TIMEOUT_MS) so a slow scraper never holds up accept()
+        if (listeners[1].revents & POLLIN) {
+            int scrapeSocket = accept(metricsSocket, nullptr, nullptr);
+            if (scrapeSocket >= 0) {
+                thread([scrapeSocket]() {
+                    metrics::serveScrape(scrapeSocket);
+                    close(scrapeSocket);
+                }).detach();
+            }
+        }
+        if (!(listeners[0].revents & POLLIN)) continue;
+
         sockaddr_in clientAddr;
         socklen_t clientLen = sizeof(clientAddr);
         int clientSocket = accept(serverSocket, (struct sockaddr*)&clientAddr, &clientLen);
         
         if (clientSocket < 0) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                // No pending connections, sleep briefly and continue
-                this_thread::sleep_for(chrono::milliseconds(100));
+                // Connection went away between poll() and accept()
                 continue;
             } else if (serverRunning) {  // Only print error if we're not shutting down
                 cerr << "Error accepting connection: " << strerror(errno) << endl;
@@ -455,11 +1174,16 @@ int main() {
             continue;
         }
 
-        cout << "[Server] New client connected: " << clientSocket << endl;
+        LOG_INFO("[Server] New client connected: " << clientSocket);
 
         // Create new client thread with proper management
         {
             lock_guard<mutex> lock(threadMapMutex);
+            // The descriptor may belong to a finished client the cleanup thread has not joined yet
+            auto previous = clientThreads.find(clientSocket);
+            if (previous != clientThreads.end() && previous->second->clientThread.joinable()) {
+                previous->second->clientThread.join();
+            }
             auto clientThreadObj = make_unique<ClientThread>(clientSocket);
             clientThreadObj->clientThread = thread(handleClient, clientSocket);
             clientThreads[clientSocket] = move(clientThreadObj);
@@ -470,7 +1194,9 @@ int main() {
     cout << "[Server] Shutting down..." << endl;
     
     // Stop accepting new connections
-    close(serverSocket);
+    if (serverSocket >= 0) close(serverSocket);
+    if (metricsSocket >= 0) close(metricsSocket);
+    endpoint.close();
     
     // Wait for all client threads to finish
     cout << "[Server] Waiting for client threads to finish..." << endl;
@@ -492,6 +1218,12 @@ int main() {
         cleanupThread.join();
     }
     
+    // Commit whatever the clients logged last
+    walLog.stop();
+    if (size_t lost = unpersistedPoints()) {
+        cerr << "[Server] " << lost << " points in named graphs were not persisted and are gone" << endl;
+    }
+    
     cout << "[Server] All threads terminated. Goodbye!" << endl;
     return 0;
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "proactor.hpp"
+#include "../common/log.hpp"
 #include <iostream>
 #include <unistd.h>
 #include <sys/socket.h>
@@ -35,7 +36,7 @@ void* Proactor::acceptThreadFunction(void* args) {
     proactorFunc clientFunc = data->threadFunc;
     Proactor* proactor = data->proactor;
     
-    std::cout << "[Proactor] Accept thread started on socket " << serverSocket << std::endl;
+    LOG_INFO("[Proactor] Accept thread started on socket " << serverSocket);
     
     // Set socket to non-blocking to avoid hanging on accept
     int flags = fcntl(serverSocket, F_GETFL, 0);
@@ -53,12 +54,12 @@ void* Proactor::acceptThreadFunction(void* args) {
                 usleep(100000); // 100ms
                 continue;
             } else {
-                std::cerr << "[Proactor] Accept failed: " << strerror(errno) << std::endl;
+                LOG_ERROR("[Proactor] Accept failed: " << strerror(errno));
                 break; // Exit on real error
             }
         }
         
-        std::cout << "[Proactor] New client connected: " << clientSocket << std::endl;
+        LOG_INFO("[Proactor] New client connected: " << clientSocket);
         
         // Create wrapper args for the client thread
         auto* clientArgs = new ClientThreadArgs{clientSocket, clientFunc};
@@ -68,7 +69,7 @@ void* Proactor::acceptThreadFunction(void* args) {
         int result = pthread_create(&clientThread, nullptr, clientThreadWrapper, clientArgs);
         
         if (result != 0) {
-            std::cerr << "[Proactor] Failed to create client thread: " << strerror(result) << std::endl;
+            LOG_ERROR("[Proactor] Failed to create client thread: " << strerror(result));
             close(clientSocket);
             delete clientArgs;
             continue;
@@ -83,13 +84,13 @@ void* Proactor::acceptThreadFunction(void* args) {
         pthread_detach(clientThread);
     }
     
-    std::cout << "[Proactor] Accept thread ending" << std::endl;
+    LOG_INFO("[Proactor] Accept thread ending");
     delete data;
     return nullptr;
 }
 
 pthread_t Proactor::startProactor(int sockfd, proactorFunc threadFunc) {
-    std::cout << "[Proactor] Starting proactor on socket " << sockfd << std::endl;
+    LOG_INFO("[Proactor] Starting proactor on socket " << sockfd);
     
     AcceptThreadData* data = new AcceptThreadData{sockfd, threadFunc, this};
     
@@ -100,17 +101,17 @@ pthread_t Proactor::startProactor(int sockfd, proactorFunc threadFunc) {
         pthread_mutex_lock(&proactorsMutex);
         activeProactors[tid] = sockfd;
         pthread_mutex_unlock(&proactorsMutex);
-        std::cout << "[Proactor] Proactor started with thread ID " << tid << std::endl;
+        LOG_INFO("[Proactor] Proactor started with thread ID " << tid);
         return tid;
     }
     
     delete data;
-    std::cerr << "[Proactor] Failed to start proactor: " << strerror(result) << std::endl;
+    LOG_ERROR("[Proactor] Failed to start proactor: " << strerror(result));
     return 0;
 }
 
 int Proactor::stopProactor(pthread_t tid) {
-    std::cout << "[Proactor] Stopping proactor " << tid << std::endl;
+    LOG_INFO("[Proactor] Stopping proactor " << tid);
     
     pthread_mutex_lock(&proactorsMutex);
     auto it = activeProactors.find(tid);
@@ -127,6 +128,6 @@ int Proactor::stopProactor(pthread_t tid) {
     pthread_join(tid, nullptr);
     close(sockfd);
     
-    std::cout << "[Proactor] Proactor " << tid << " stopped" << std::endl;
+    LOG_INFO("[Proactor] Proactor " << tid << " stopped");
     return 0;
 }
\ No newline at end of file
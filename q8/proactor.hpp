@@ -1,12 +1,15 @@
 #pragma once
 #include <pthread.h>
 #include <map>
+#include "../common/stats.hpp"
+#include "../common/lock_profiler.hpp"
 
 typedef void* (*proactorFunc)(int sockfd);
 
 class Proactor {
 private:
     pthread_mutex_t graphMutex;
+    lockprof::Tracker graphTracker{"Proactor::graphMutex"};   // Call-site profile with LOCK_PROFILING
     pthread_mutex_t proactorsMutex;
     std::map<pthread_t, int> activeProactors;
     
@@ -42,9 +45,25 @@ public:
      */
     int stopProactor(pthread_t tid);
 
-    // Mutex operations for graph modifications
-    void lockGraphForWrite() { pthread_mutex_lock(&graphMutex); }
-    void unlockGraphForWrite() { pthread_mutex_unlock(&graphMutex); }
+    // Mutex operations for graph modifications; time spent waiting shows up in STATS,
+    // and in LOCKS under the caller's file and line when built with LOCK_PROFILING
+    void lockGraphForWrite(const char* file = __builtin_FILE(), int line = __builtin_LINE()) {
+        if (pthread_mutex_trylock(&graphMutex) == 0) {
+            stats::recordLockWait(0);
+            graphTracker.acquired(file, line, 0);
+            return;
+        }
+        uint64_t started = stats::nowNanos();
+        pthread_mutex_lock(&graphMutex);
+        uint64_t acquired = stats::nowNanos();
+        stats::recordLockWait(acquired - started);
+        trace::phase("lock_wait", started, acquired);
+        graphTracker.acquired(file, line, started);
+    }
+    void unlockGraphForWrite() {
+        graphTracker.releasing();
+        pthread_mutex_unlock(&graphMutex);
+    }
 
     Proactor(const Proactor&) = delete;
     Proactor& operator=(const Proactor&) = delete;
@@ -7,6 +7,19 @@
  */
 
 #include "../q8/proactor.hpp"
+#include "../common/convex_hull.hpp"
+#include "../common/line_buffer.hpp"
+#include "../common/point_parser.hpp"
+#include "../common/response_buffer.hpp"
+#include "../common/log.hpp"
+#include "../common/stats.hpp"
+#include "../common/hull_cache.hpp"
+#include "../common/metrics_http.hpp"
+#include "../common/snapshot.hpp"
+#include "../common/wal.hpp"
+#include "../common/hot_restart.hpp"
+#include "../common/lock_profiler.hpp"
+#include "../common/trace.hpp"
 #include <iostream>
 #include <vector>
 #include <algorithm>
@@ -17,107 +30,138 @@
 #include <netinet/in.h>
 #include <unistd.h>
 #include <cstring>
+#include <string_view>
+#include <charconv>
 #include <signal.h>
+#include <poll.h>
 #include <atomic>
 
 using namespace std;
 
 #define PORT 9034
-#define MAX_BUFFER_SIZE 1024
+#define RECV_BUFFER_SIZE (64 * 1024)
+#define MAX_REPORTED_ERRORS 10
 
-// Basic Point structure
-struct Point {
-    double x, y;
-    Point() : x(0), y(0) {}
-    Point(double x, double y) : x(x), y(y) {}
-};
+using hull::Point;
 
 // Global shared resources (same as q7, but now protected by Proactor's mutex)
 vector<Point> sharedGraphPoints;
+HullCache hullCache;  // Last CH area, valid until the graph changes; guarded by the graph lock
+snapshot::BackgroundSaver snapshotSaver(snapshot::pathFromEnv(), snapshot::intervalFromEnv());
+wal::Log walLog(wal::pathFromEnv(), wal::durabilityFromEnv(), wal::commitWindowFromEnv());
+handoff::WriteGate writeGate;  // Closed once the graph is handed to a new process
 Proactor globalProactor;
 atomic<bool> serverRunning(true);
 int serverSocket = -1;
 
 // Utility functions (identical to q7)
-Point parsePointFromString(const string& pointString) {
-    try {
-        size_t comma = pointString.find(',');
-        if (comma == string::npos) {
-            throw invalid_argument("Invalid point format: missing comma");
-        }
-        
-        string xStr = pointString.substr(0, comma);
-        string yStr = pointString.substr(comma + 1);
-        
-        xStr.erase(remove_if(xStr.begin(), xStr.end(), ::isspace), xStr.end());
-        yStr.erase(remove_if(yStr.begin(), yStr.end(), ::isspace), yStr.end());
-        
-        if (xStr.empty() || yStr.empty()) {
-            throw invalid_argument("Invalid point format: empty coordinate");
-        }
-        
-        return Point(stod(xStr), stod(yStr));
-    } catch (const exception& e) {
-        throw invalid_argument("Invalid point format: " + string(e.what()));
+// Parse the arguments of "Newgraph n [bulk]"
+bool parseNewgraphArguments(string_view args, int& numPoints, bool& bulk) {
+    args = LineBuffer::trim(args);
+    auto [end, ec] = from_chars(args.data(), args.data() + args.size(), numPoints);
+    if (ec != errc() || numPoints <= 0) return false;
+
+    string_view mode = LineBuffer::trim(args.substr(end - args.data()));
+    bulk = (mode == "bulk");
+    return bulk || mode.empty();
+}
+
+/**
+ * Bulk upload: parse point lines straight from the receive buffer in one pass.
+ * Only complete lines are consumed and blank lines are skipped. A malformed line
+ * still counts towards the block so client and server stay in step; it is
+ * recorded in errors by its 1-based position in the block.
+ */
+void parsePointBlock(LineBuffer& input, int pointsToRead, int& pointsRead,
+                     vector<Point>& points, vector<string>& errors) {
+    vector<LineError> lineErrors;
+    size_t linesParsed;
+    input.consume(parsePointLines(input.completeLines(), pointsToRead - pointsRead, points, lineErrors, linesParsed));
+
+    for (const LineError& error : lineErrors) {
+        errors.push_back("line " + to_string(pointsRead + error.line) + ": " + parseErrorMessage(error.status));
+    }
+    pointsRead += linesParsed;
+}
+
+// Single acknowledgement for a bulk upload: accepted count plus per-line errors
+string bulkUploadSummary(int pointsRead, const vector<string>& errors) {
+    string summary = "Graph created with " + to_string(pointsRead - (int)errors.size()) + " points";
+    if (errors.empty()) return summary;
+
+    summary += " (" + to_string(errors.size()) + " rejected: ";
+    for (size_t i = 0; i < errors.size() && i < MAX_REPORTED_ERRORS; i++) {
+        if (i > 0) summary += "; ";
+        summary += errors[i];
     }
+    if (errors.size() > MAX_REPORTED_ERRORS) summary += "; ...";
+    return summary + ")";
 }
 
-double crossProduct(const Point& o, const Point& a, const Point& b) {
-    return (a.x - o.x)*(b.y - o.y) - (a.y - o.y)*(b.x - o.x);
+// Record a change to the shared graph; call with the graph lock held
+void graphChanged() {
+    hullCache.invalidate();
+    stats::graphPoints.store(sharedGraphPoints.size(), memory_order_relaxed);
+    snapshotSaver.graphChanged();
 }
 
-vector<Point> computeConvexHull(const vector<Point>& points) {
-    if (points.size() <= 1) return points;
-    
-    vector<Point> pts = points;
-    sort(pts.begin(), pts.end(), [](const Point& a, const Point& b) {
-        return (a.x != b.x) ? a.x < b.x : a.y < b.y;
-    });
-
-    vector<Point> hull;
-    // Build lower hull
-    for (const Point& p : pts) {
-        while (hull.size() >= 2 && 
-               crossProduct(hull[hull.size()-2], hull[hull.size()-1], p) <= 0)
-            hull.pop_back();
-        hull.push_back(p);
+// Fork a background save of the graph; call with the graph lock held. The reply for SAVE
+string startSnapshot() {
+    if (!snapshotSaver.start(sharedGraphPoints, walLog.lastLsn())) {
+        return errno == EBUSY ? "Error: Snapshot already in progress" : "Error: Snapshot failed: " + string(strerror(errno));
     }
-    
-    // Build upper hull
-    size_t lower = hull.size();
-    for (int i = pts.size()-2; i >= 0; i--) {
-        while (hull.size() > lower && 
-               crossProduct(hull[hull.size()-2], hull[hull.size()-1], pts[i]) <= 0)
-            hull.pop_back();
-        hull.push_back(pts[i]);
+    walLog.rotate();   // Changes from here on go to a segment the snapshot does not cover
+    LOG_INFO("[Snapshot] Started for " << sharedGraphPoints.size() << " points");
+    return "Snapshot started (" + to_string(sharedGraphPoints.size()) + " points)";
+}
+
+// Reap a finished save, then start the periodic one if it is due
+void serviceSnapshots() {
+    int finished = snapshotSaver.poll();
+    if (finished > 0) {
+        LOG_INFO("[Snapshot] Saved to " << snapshotSaver.file() << ": " << snapshotSaver.lastSavedPoints()
+                 << " points in " << snapshotSaver.lastSaveMillis() << " ms");
+        walLog.discardUpTo(snapshotSaver.lastSavedLsn());
+    } else if (finished < 0) {
+        LOG_ERROR("[Snapshot] Saving to " << snapshotSaver.file() << " failed");
+    }
+    if (snapshotSaver.due() && !writeGate.frozen()) {
+        globalProactor.lockGraphForWrite();
+        startSnapshot();
+        globalProactor.unlockGraphForWrite();
     }
-    
-    if (hull.size() > 1) hull.pop_back();
-    return hull;
 }
 
-double calculatePolygonArea(const vector<Point>& poly) {
-    if (poly.size() < 3) return 0.0;
-    
-    double area = 0;
-    for (size_t i = 0; i < poly.size(); i++) {
-        size_t j = (i + 1) % poly.size();
-        area += poly[i].x * poly[j].y - poly[j].x * poly[i].y;
+// Queue a reply for the client; it goes out with the rest of the batch on flush
+bool sendMessageToClient(ResponseBuffer& replies, const string& msg) {
+    if (!replies.append(msg)) {
+        LOG_ERROR("[Client " << replies.socket() << "] Error sending message: " << strerror(errno));
+        return false;
     }
-    return fabs(area) / 2.0;
+    stats::addBytesOut(msg.size() + 1);
+    LOG_DEBUG("[Client " << replies.socket() << "] Sent: " << msg);
+    return true;
 }
 
-bool sendMessageToClient(int clientSocket, const string& msg) {
-    string formatted = msg + "\n";
-    ssize_t sent = send(clientSocket, formatted.c_str(), formatted.length(), MSG_NOSIGNAL);
-    if (sent < 0) {
-        cout << "[Client " << clientSocket << "] Error sending message: " << strerror(errno) << endl;
+// Write all replies queued for the client in one go, once the changes they acknowledge are logged
+bool flushClientResponses(ResponseBuffer& replies) {
+    walLog.waitDurable();
+    uint64_t started = trace::mark();
+    bool sent = replies.flush();
+    trace::sent(started);
+    if (!sent) {
+        LOG_ERROR("[Client " << replies.socket() << "] Error sending message: " << strerror(errno));
         return false;
     }
-    cout << "[Client " << clientSocket << "] Sent: " << msg << endl;
     return true;
 }
 
+// Proactor handler for the metrics port: one scrape per connection, no graph lock
+void* handleScrape(int scrapeSocket) {
+    metrics::serveScrape(scrapeSocket);
+    return nullptr;
+}
+
 /**
  * Client handler function - this is called by the Proactor for each new client
  * This function replaces the handleClient function from q7, but uses Proactor's 
@@ -127,21 +171,29 @@ bool sendMessageToClient(int clientSocket, const string& msg) {
  * void* (*proactorFunc)(int sockfd) - returns void*, takes int sockfd
  */
 void* handleClientWithProactor(int clientSocket) {
-    cout << "[Proactor] Client handler started for socket " << clientSocket << endl;
+    LOG_INFO("[Proactor] Client handler started for socket " << clientSocket);
+    stats::ConnectionScope connection;
+
+    // Replies are queued here and written once per read batch
+    ResponseBuffer replies(clientSocket);
     
     // Send welcome messages (same as q7)
-    if (!sendMessageToClient(clientSocket, "Convex Hull Server Ready (Step 9 - Proactor Version)")) {
+    if (!sendMessageToClient(replies, "Convex Hull Server Ready (Step 9 - Proactor Version)")) {
         return nullptr;
     }
-    if (!sendMessageToClient(clientSocket, "Commands: Newgraph n, CH, Newpoint x,y, Removepoint x,y, exit")) {
+    if (!sendMessageToClient(replies, "Commands: Newgraph n [bulk], CH, Newpoint x,y, Removepoint x,y, STATS, SAVE, exit") ||
+        !flushClientResponses(replies)) {
         return nullptr;
     }
 
-    char buffer[MAX_BUFFER_SIZE];
-    string accumulatedInput;
+    LineBuffer input(RECV_BUFFER_SIZE);
+    string_view command;
     int pointsToRead = 0;
     int pointsRead = 0;
     bool readingPoints = false;
+    bool bulkUpload = false;
+    vector<Point> bulkPoints;              // The bulk block read so far
+    vector<string> bulkErrors;
 
     // Main client communication loop (same logic as q7)
     while (serverRunning) {
@@ -151,53 +203,108 @@ void* handleClientWithProactor(int clientSocket) {
         tv.tv_usec = 0;
         setsockopt(clientSocket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof tv);
         
-        ssize_t bytesRead = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
+        if (!input.prepareWrite()) {
+            sendMessageToClient(replies, "Error: Line too long");
+            flushClientResponses(replies);
+            break;
+        }
+
+        ssize_t bytesRead = recv(clientSocket, input.writePtr(), input.writable(), 0);
+        trace::received();   // Blocking read: only the moment the data arrived is meaningful
         if (bytesRead <= 0) {
             if (bytesRead == 0) {
-                cout << "[Client " << clientSocket << "] Disconnected normally" << endl;
+                LOG_INFO("[Client " << clientSocket << "] Disconnected normally");
             } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
                 continue; // Timeout, check serverRunning and continue
             } else {
-                cout << "[Client " << clientSocket << "] Disconnected with error: " << strerror(errno) << endl;
+                LOG_ERROR("[Client " << clientSocket << "] Disconnected with error: " << strerror(errno));
             }
             break;
         }
 
-        buffer[bytesRead] = '\0';
-        accumulatedInput += buffer;
+        input.commit(bytesRead);
+        stats::addBytesIn(bytesRead);
 
         // Process complete commands (same logic as q7)
-        size_t pos;
-        while ((pos = accumulatedInput.find('\n')) != string::npos) {
-            string command = accumulatedInput.substr(0, pos);
-            accumulatedInput.erase(0, pos + 1);
-
-            // Clean command string
-            command.erase(0, command.find_first_not_of(" \t\r\n"));
-            command.erase(command.find_last_not_of(" \t\r\n") + 1);
-            
+        while (input.hasLine()) {
+            if (readingPoints && bulkUpload) {
+                // Bulk upload: take every complete point line of this read in one pass
+                int pointsBefore = pointsRead;
+                parsePointBlock(input, pointsToRead, pointsRead, bulkPoints, bulkErrors);
+                stats::countCommands(stats::CMD_POINT, pointsRead - pointsBefore);
+
+                if (pointsRead >= pointsToRead) {
+                    // The whole block replaces the graph at once, so no one sees it half uploaded
+                    readingPoints = false;
+                    string summary = handoff::FROZEN_REPLY;
+                    {
+                        handoff::WriteGate::Pass pass(writeGate, true);
+                        if (pass) {
+                            globalProactor.lockGraphForWrite();
+                            sharedGraphPoints.swap(bulkPoints);
+                            walLog.append(wal::RECORD_CLEAR);
+                            walLog.appendPoints(sharedGraphPoints.begin(), sharedGraphPoints.end());
+                            graphChanged();
+                            globalProactor.unlockGraphForWrite();
+                            summary = bulkUploadSummary(pointsRead, bulkErrors);
+                        }
+                    }
+                    bulkPoints = vector<Point>();
+                    bulkErrors.clear();
+                    if (!sendMessageToClient(replies, summary)) {
+                        goto client_disconnected;
+                    }
+                }
+                continue;
+            }
+
+            input.nextLine(command);
             if (command.empty()) continue;
+            stats::Command kind = stats::classifyCommand(command, readingPoints);
+            stats::CommandTimer timer(kind);
+            trace::Request traced(command, clientSocket);
 
-            cout << "[Client " << clientSocket << "] Command: " << command << endl;
+            LOG_DEBUG("[Client " << clientSocket << "] Command: " << command);
+
+            // After a handoff the graph belongs to the new process; this one only reads it
+            handoff::WriteGate::Pass pass(writeGate, handoff::mutates(kind));
+            if (!pass) {
+                readingPoints = false;
+                if (!sendMessageToClient(replies, handoff::FROZEN_REPLY)) {
+                    goto client_disconnected;
+                }
+                continue;
+            }
 
             try {
                 if (readingPoints) {
                     // Handle point input for Newgraph command
-                    Point p = parsePointFromString(command);
+                    Point p;
+                    trace::Phase parsing("parse");
+                    ParseStatus status = parsePoint(command, p.x, p.y);
+                    parsing.end();
+                    if (status != ParseStatus::Ok) {
+                        if (!sendMessageToClient(replies, "Error: " + parseErrorMessage(status))) {
+                            goto client_disconnected;
+                        }
+                        continue;
+                    }
                     
                     // KEY DIFFERENCE: Use Proactor's mutex instead of separate graphMutex
                     globalProactor.lockGraphForWrite();
                     sharedGraphPoints.push_back(p);
+                    walLog.append(wal::RECORD_ADD, p.x, p.y);
+                    graphChanged();
                     globalProactor.unlockGraphForWrite();
                     
                     pointsRead++;
-                    if (!sendMessageToClient(clientSocket, "Point " + to_string(pointsRead) + " accepted")) {
+                    if (!sendMessageToClient(replies, "Point " + to_string(pointsRead) + " accepted")) {
                         goto client_disconnected;
                     }
 
                     if (pointsRead >= pointsToRead) {
                         readingPoints = false;
-                        if (!sendMessageToClient(clientSocket, 
+                        if (!sendMessageToClient(replies, 
                             "Graph created with " + to_string(pointsRead) + " points")) {
                             goto client_disconnected;
                         }
@@ -207,99 +314,165 @@ void* handleClientWithProactor(int clientSocket) {
 
                 // Handle main commands (same logic as q7, but with Proactor mutex)
                 if (command.substr(0, 9) == "Newgraph ") {
-                    try {
-                        pointsToRead = stoi(command.substr(9));
-                        if (pointsToRead <= 0) {
-                            throw invalid_argument("Number of points must be positive");
-                        }
-                    } catch (const exception& e) {
-                        if (!sendMessageToClient(clientSocket, "Error: Invalid number of points")) {
+                    trace::Phase parsing("parse");
+                    bool valid = parseNewgraphArguments(command.substr(9), pointsToRead, bulkUpload);
+                    parsing.end();
+                    if (!valid) {
+                        if (!sendMessageToClient(replies, "Error: Invalid number of points")) {
                             goto client_disconnected;
                         }
                         continue;
                     }
 
-                    globalProactor.lockGraphForWrite();
-                    sharedGraphPoints.clear();
-                    globalProactor.unlockGraphForWrite();
+                    // A bulk block is buffered and replaces the graph when complete
+                    if (!bulkUpload) {
+                        globalProactor.lockGraphForWrite();
+                        sharedGraphPoints.clear();
+                        walLog.append(wal::RECORD_CLEAR);
+                        graphChanged();
+                        globalProactor.unlockGraphForWrite();
+                    }
                     
                     pointsRead = 0;
                     readingPoints = true;
-                    if (!sendMessageToClient(clientSocket, "Enter " + to_string(pointsToRead) + " points (x,y):")) {
+                    // Bulk uploads are acknowledged once, after the whole block
+                    if (!bulkUpload && !sendMessageToClient(replies, "Enter " + to_string(pointsToRead) + " points (x,y):")) {
                         goto client_disconnected;
                     }
                 }
                 else if (command == "CH") {
+                    // Served from the cache until the graph changes
+                    double area = 0.0;
+                    uint64_t version = 0;
                     vector<Point> points;
-                    
+                    bool cached;
+
                     globalProactor.lockGraphForWrite();
-                    points = sharedGraphPoints;
+                    cached = hullCache.lookup(area);
+                    if (!cached) {
+                        version = hullCache.currentVersion();
+                        points = sharedGraphPoints;
+                    }
                     globalProactor.unlockGraphForWrite();
-                    
-                    if (points.size() < 3) {
-                        if (!sendMessageToClient(clientSocket, "0.0")) {
-                            goto client_disconnected;
-                        }
-                    } else {
-                        auto hull = computeConvexHull(points);
-                        double area = calculatePolygonArea(hull);
-                        ostringstream out;
-                        out << fixed << setprecision(1) << area;
-                        if (!sendMessageToClient(clientSocket, out.str())) {
-                            goto client_disconnected;
+                    stats::recordHullCache(cached);
+
+                    if (!cached) {
+                        {
+                            trace::Phase computing("hull_compute");
+                            area = points.size() < 3 ? 0.0 : hull::convexHullArea(points);
                         }
+                        globalProactor.lockGraphForWrite();
+                        hullCache.store(version, area);
+                        globalProactor.unlockGraphForWrite();
+                    }
+
+                    ostringstream out;
+                    out << fixed << setprecision(1) << area;
+                    if (!sendMessageToClient(replies, out.str())) {
+                        goto client_disconnected;
                     }
                 }
                 else if (command.substr(0, 9) == "Newpoint ") {
-                    Point p = parsePointFromString(command.substr(9));
+                    Point p;
+                    trace::Phase parsing("parse");
+                    ParseStatus status = parsePoint(command.substr(9), p.x, p.y);
+                    parsing.end();
+                    if (status != ParseStatus::Ok) {
+                        if (!sendMessageToClient(replies, "Error: " + parseErrorMessage(status))) {
+                            goto client_disconnected;
+                        }
+                        continue;
+                    }
                     
                     globalProactor.lockGraphForWrite();
                     sharedGraphPoints.push_back(p);
+                    walLog.append(wal::RECORD_ADD, p.x, p.y);
+                    graphChanged();
                     globalProactor.unlockGraphForWrite();
                     
-                    if (!sendMessageToClient(clientSocket, "Point added")) {
+                    if (!sendMessageToClient(replies, "Point added")) {
                         goto client_disconnected;
                     }
                 }
                 else if (command.substr(0, 12) == "Removepoint ") {
-                    Point p = parsePointFromString(command.substr(12));
+                    Point p;
+                    trace::Phase parsing("parse");
+                    ParseStatus status = parsePoint(command.substr(12), p.x, p.y);
+                    parsing.end();
+                    if (status != ParseStatus::Ok) {
+                        if (!sendMessageToClient(replies, "Error: " + parseErrorMessage(status))) {
+                            goto client_disconnected;
+                        }
+                        continue;
+                    }
                     bool found = false;
                     
                     globalProactor.lockGraphForWrite();
                     for (auto it = sharedGraphPoints.begin(); it != sharedGraphPoints.end(); ++it) {
                         if (fabs(it->x - p.x) < 1e-9 && fabs(it->y - p.y) < 1e-9) {
+                            walLog.append(wal::RECORD_REMOVE, it->x, it->y, it - sharedGraphPoints.begin());
                             sharedGraphPoints.erase(it);
+                            graphChanged();
                             found = true;
                             break;
                         }
                     }
                     globalProactor.unlockGraphForWrite();
                     
-                    if (!sendMessageToClient(clientSocket, found ? "Point removed" : "Point not found")) {
+                    if (!sendMessageToClient(replies, found ? "Point removed" : "Point not found")) {
+                        goto client_disconnected;
+                    }
+                }
+                else if (command == "STATS") {
+                    for (const string& line : stats::formatReport(stats::collect())) {
+                        if (!sendMessageToClient(replies, line)) {
+                            goto client_disconnected;
+                        }
+                    }
+                }
+                else if (command == "SAVE") {
+                    // The snapshot is written by a forked child; only the fork holds the lock
+                    string reply;
+                    globalProactor.lockGraphForWrite();
+                    reply = startSnapshot();
+                    globalProactor.unlockGraphForWrite();
+                    if (!sendMessageToClient(replies, reply)) {
                         goto client_disconnected;
                     }
                 }
+                else if (command == "LOCKS") {
+                    for (const string& line : lockprof::formatReport()) {
+                        if (!sendMessageToClient(replies, line)) {
+                            goto client_disconnected;
+                        }
+                    }
+                }
                 else if (command == "exit" || command == "quit") {
-                    sendMessageToClient(clientSocket, "Goodbye!");
+                    sendMessageToClient(replies, "Goodbye!");
                     break;
                 }
                 else {
-                    if (!sendMessageToClient(clientSocket, "Error: Unknown command")) {
+                    if (!sendMessageToClient(replies, "Error: Unknown command")) {
                         goto client_disconnected;
                     }
                 }
             }
             catch (const exception& e) {
                 string errorMsg = "Error: " + string(e.what());
-                if (!sendMessageToClient(clientSocket, errorMsg)) {
+                if (!sendMessageToClient(replies, errorMsg)) {
                     goto client_disconnected;
                 }
             }
         }
+
+        // Everything this read produced leaves in a single send
+        if (!flushClientResponses(replies)) {
+            break;
+        }
     }
 
 client_disconnected:
-    cout << "[Proactor] Client handler ending for socket " << clientSocket << endl;
+    LOG_INFO("[Proactor] Client handler ending for socket " << clientSocket);
     
     // NOTE: Socket cleanup is handled by the Proactor library, not manually here
     // This is a key difference from q7 where we manually managed socket cleanup
@@ -320,26 +493,19 @@ void signalHandler(int signum) {
     }
 }
 
-int main() {
-    // Set up signal handlers
-    signal(SIGINT, signalHandler);
-    signal(SIGTERM, signalHandler);
-    
-    cout << "=== Step 9: Convex Hull Server using Proactor Library ===" << endl;
-    cout << "This server reimplements Step 7 using the Proactor pattern from Step 8" << endl;
-    
-    // Create server socket (same as q7)
-    serverSocket = socket(AF_INET, SOCK_STREAM, 0);
+// Listening socket on PORT, or -1 after reporting why not
+int openServerSocket() {
+    int serverSocket = socket(AF_INET, SOCK_STREAM, 0);
     if (serverSocket < 0) {
         cerr << "Error creating socket: " << strerror(errno) << endl;
-        return 1;
+        return -1;
     }
     
     // Set socket options
     int opt = 1;
     if (setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
         cerr << "Error setting socket options: " << strerror(errno) << endl;
-        return 1;
+        return -1;
     }
     
     // Configure server address
@@ -351,12 +517,64 @@ int main() {
     
     if (bind(serverSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
         cerr << "Error binding socket: " << strerror(errno) << endl;
-        return 1;
+        return -1;
     }
     
     if (listen(serverSocket, 10) < 0) {
         cerr << "Error listening on socket: " << strerror(errno) << endl;
-        return 1;
+        return -1;
+    }
+    
+    return serverSocket;
+}
+
+// Restore the graph from the last snapshot and the write-ahead log; lastLsn is where logging resumes
+bool restoreGraph(uint64_t& lastLsn) {
+    uint64_t restoredPoints = 0, snapshotLsn = 0, replayedChanges = 0;
+    string restoreError;
+    if (!snapshot::load(snapshotSaver.file(), sharedGraphPoints, restoredPoints, snapshotLsn, restoreError)) {
+        cerr << "Could not load snapshot " << restoreError << endl;
+    }
+    if (!wal::replay(walLog.file(), snapshotLsn, sharedGraphPoints, lastLsn, replayedChanges, restoreError)) {
+        cerr << "Could not replay the write-ahead log: " << restoreError << endl;
+        return false;
+    }
+    if (restoredPoints > 0 || replayedChanges > 0) {
+        graphChanged();
+        cout << "Restored " << sharedGraphPoints.size() << " points from " << snapshotSaver.file()
+             << " and " << replayedChanges << " logged changes" << endl;
+    }
+    return true;
+}
+
+int main() {
+    // Set up signal handlers
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+    
+    cout << "=== Step 9: Convex Hull Server using Proactor Library ===" << endl;
+    cout << "This server reimplements Step 7 using the Proactor pattern from Step 8" << endl;
+    
+    // With hot restart on, take the sockets and graph over from a running server if there is one
+    string handoffPath = handoff::pathFromEnv();
+    int metricsSocket = -1;
+    uint64_t lastLsn = 0;
+    string handoffError;
+    bool tookOver = !handoffPath.empty() &&
+                    handoff::receive(handoffPath, serverSocket, metricsSocket, sharedGraphPoints, lastLsn, handoffError);
+    if (!handoffError.empty()) {
+        cerr << "Hot restart failed, starting cold: " << handoffError << endl;
+    }
+    if (tookOver) {
+        graphChanged();
+        cout << "Took over from the running server with " << sharedGraphPoints.size() << " points" << endl;
+    } else {
+        serverSocket = openServerSocket();
+        if (serverSocket < 0 || !restoreGraph(lastLsn)) return 1;
+    }
+    walLog.start(lastLsn);
+    if (walLog.enabled()) {
+        cout << "Write-ahead log: " << walLog.file() << " (" << wal::durabilityName(walLog.mode()) << ")" << endl;
     }
     
     cout << "Server started on port " << PORT << " using Step 8 Proactor library" << endl;
@@ -375,16 +593,72 @@ int main() {
     cout << "Proactor started with thread ID: " << proactorThread << endl;
     cout << "Waiting for connections..." << endl;
     
-    // Main thread waits for shutdown signal (same as q7 concept, but simpler)
+    // Optional Prometheus endpoint on a second proactor; a hot restart hands its socket over too
+    pthread_t metricsThread = 0;
+    int metricsPort = metrics::portFromEnv();
+    if (metricsSocket < 0 && metricsPort) metricsSocket = metrics::openListener(metricsPort);
+    if (metricsSocket >= 0) metricsThread = globalProactor.startProactor(metricsSocket, handleScrape);
+    if (metricsThread != 0) {
+        cout << "Metrics: http://127.0.0.1:" << metricsPort << "/metrics" << endl;
+    } else {
+        if (metricsPort) cerr << "Could not open metrics port " << metricsPort << endl;
+        if (metricsSocket >= 0) close(metricsSocket);
+        metricsSocket = -1;
+    }
+    
+    // A successor started with the same CH_HANDOFF_PATH connects here
+    handoff::Endpoint endpoint;
+    if (!handoffPath.empty()) {
+        if (endpoint.open(handoffPath, handoffError)) {
+            cout << "Hot restart: " << handoffPath << endl;
+        } else {
+            cerr << "Could not open handoff socket " << handoffError << endl;
+        }
+    }
+    handoff::Drain drain;
+    
+    // Main thread waits for shutdown signal, a successor or a drained handoff, and looks
+    // after background snapshots; the handoff socket doubles as its one second tick
     while (serverRunning) {
-        sleep(1);
+        pollfd successorReady = {endpoint.fd(), POLLIN, 0};
+        if (poll(&successorReady, 1, 1000) > 0 && (successorReady.revents & POLLIN)) {
+            int successor = endpoint.accept();
+            if (successor >= 0) {
+                if (handoff::handOver(successor, writeGate, walLog, sharedGraphPoints, serverSocket, metricsSocket, handoffError)) {
+                    // The successor accepts from now on; stopping the proactors closes this process's copies
+                    globalProactor.stopProactor(proactorThread);
+                    proactorThread = 0;
+                    serverSocket = -1;
+                    if (metricsThread != 0) globalProactor.stopProactor(metricsThread);
+                    metricsThread = 0;
+                    metricsSocket = -1;
+                    endpoint.close();
+                    cout << "[Server] Handed over to a new process; draining "
+                         << stats::activeConnections.load() << " clients" << endl;
+                    drain.start(handoff::drainSecondsFromEnv());
+                } else {
+                    cerr << "[Server] Handoff failed: " << handoffError << endl;
+                }
+                close(successor);
+            }
+        }
+        serviceSnapshots();
+        if (drain.finished()) {
+            cout << "[Server] Drained after handoff" << endl;
+            serverRunning = false;
+        }
     }
     
     // Graceful shutdown using Proactor
     cout << "[Server] Shutting down..." << endl;
     
     // Stop the proactor (this handles all thread cleanup automatically)
-    globalProactor.stopProactor(proactorThread);
+    if (proactorThread != 0) globalProactor.stopProactor(proactorThread);
+    if (metricsThread != 0) globalProactor.stopProactor(metricsThread);
+    
+    // Commit whatever the clients logged last
+    walLog.stop();
+    endpoint.close();
     
     // Close server socket
     if (serverSocket >= 0) {
@@ -0,0 +1,136 @@
+/**
+ * Text to Binary Point File Converter
+ * -----------------------------------
+ * Converts the calculators' text input ("n" then one "x,y" line per point)
+ * into a binary point file (common/point_file.hpp) that q1 and q2 can map
+ * directly. The input is read in fixed-size chunks and parsed with the
+ * servers' from_chars parser, so files of any size convert in constant memory.
+ *
+ * Usage:
+ *   ./points_to_binary [--type f64|f32] INPUT.txt|- OUTPUT.bin
+ *
+ * Fails on the first malformed line, naming it, or if the number of points
+ * does not match the count on the first line.
+ */
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "../common/point_file.hpp"
+#include "../common/point_parser.hpp"
+
+using namespace std;
+
+const size_t CHUNK_BYTES = 4 << 20;
+
+void usage() {
+    cerr << "Usage: points_to_binary [--type f64|f32] INPUT.txt|- OUTPUT.bin" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    string type = "f64";
+    vector<string> paths;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--type" && i + 1 < argc) type = argv[++i];
+        else if (arg.size() > 1 && arg[0] == '-' && arg != "-") {
+            usage();
+            return 2;
+        } else paths.push_back(arg);
+    }
+    if (paths.size() != 2 || (type != "f64" && type != "f32")) {
+        usage();
+        return 2;
+    }
+
+    FILE* input = paths[0] == "-" ? stdin : fopen(paths[0].c_str(), "rb");
+    if (!input) {
+        perror(paths[0].c_str());
+        return 1;
+    }
+    pointfile::Writer writer(paths[1], type == "f32" ? pointfile::COORD_FLOAT32 : pointfile::COORD_FLOAT64);
+    if (!writer.ok()) {
+        perror(paths[1].c_str());
+        return 1;
+    }
+
+    // First non-blank line is the count, then one point per non-blank line
+    vector<char> buffer(CHUNK_BYTES);
+    size_t filled = 0;
+    uint64_t lineNumber = 0;
+    uint64_t expected = 0, converted = 0;
+    bool haveCount = false, atEnd = false;
+    string failure;
+
+    while (failure.empty()) {
+        if (!atEnd) {
+            if (filled == buffer.size()) buffer.resize(buffer.size() * 2);   // A line longer than the buffer
+            size_t got = fread(buffer.data() + filled, 1, buffer.size() - filled, input);
+            filled += got;
+            if (got == 0) {
+                atEnd = true;
+                // Terminate a last line without a newline
+                if (filled > 0 && buffer[filled - 1] != '\n') {
+                    if (filled == buffer.size()) buffer.resize(buffer.size() + 1);
+                    buffer[filled++] = '\n';
+                }
+            }
+        }
+
+        const char* begin = buffer.data();
+        const char* end = begin + filled;
+        const char* p = begin;
+        while (const char* newline = static_cast<const char*>(memchr(p, '\n', end - p))) {
+            lineNumber++;
+            const char* lineBegin = skipBlanks(p, newline);
+            string_view line(lineBegin, newline - lineBegin);
+            p = newline + 1;
+            if (line.empty()) continue;
+
+            if (!haveCount) {
+                char* parsedEnd = nullptr;
+                string text(line);
+                expected = strtoull(text.c_str(), &parsedEnd, 10);
+                if (parsedEnd == text.c_str() || skipBlanks(parsedEnd, text.c_str() + text.size()) != text.c_str() + text.size()) {
+                    failure = "line " + to_string(lineNumber) + ": expected the number of points";
+                    break;
+                }
+                haveCount = true;
+                continue;
+            }
+
+            double x, y;
+            ParseStatus status = parsePoint(line, x, y);
+            if (status != ParseStatus::Ok) {
+                failure = "line " + to_string(lineNumber) + ": " + parseErrorMessage(status);
+                break;
+            }
+            writer.add(x, y);
+            converted++;
+        }
+
+        // Keep the incomplete last line for the next chunk
+        size_t consumed = p - begin;
+        memmove(buffer.data(), buffer.data() + consumed, filled - consumed);
+        filled -= consumed;
+        if (atEnd && filled == 0) break;
+    }
+    if (input != stdin) fclose(input);
+
+    if (failure.empty() && !haveCount) failure = "empty input";
+    if (failure.empty() && converted != expected) {
+        failure = "expected " + to_string(expected) + " points, found " + to_string(converted);
+    }
+    bool written = writer.close();
+    if (!failure.empty() || !written) {
+        cerr << "Error: " << (failure.empty() ? "failed writing " + paths[1] : paths[0] + ": " + failure) << endl;
+        remove(paths[1].c_str());
+        return 1;
+    }
+    cerr << "Converted " << converted << " points to " << paths[1] << " (" << type << ")" << endl;
+    return 0;
+}